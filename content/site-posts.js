@@ -0,0 +1,49 @@
+const SITE_POSTS_TAGNAME = "site-posts";
+
+// Appends the posts the index leaves out, read from the post data written by the generator
+class SitePosts extends HTMLElement {
+	connectedCallback() {
+		const button = document.createElement("button");
+		button.type = "button";
+		button.className = "site-posts-more";
+		button.textContent = "Older posts";
+		button.addEventListener("click", () => {
+			button.disabled = true;
+			this.load().catch((error) => {
+				button.disabled = false;
+				console.error(error);
+			});
+		});
+
+		// The link to the archive stays in place for clients without scripts
+		this.replaceChildren(button);
+	}
+
+	async load() {
+		const response = await fetch(this.dataset.src);
+		if (!response.ok) {
+			throw new Error(`${SITE_POSTS_TAGNAME}: Failed to fetch ${this.dataset.src}`);
+		}
+
+		const posts = await response.json();
+		const list = document.querySelector("#post-list ul");
+		for (const [path, title, year] of posts.slice(Number(this.dataset.offset))) {
+			const li = document.createElement("li");
+			const date = document.createElement("span");
+			const a = document.createElement("a");
+			const span = document.createElement("span");
+			date.className = "date";
+			date.textContent = year;
+			a.href = path;
+			span.className = "title";
+			span.textContent = title;
+			a.appendChild(span);
+			li.append(date, a);
+			list.appendChild(li);
+		}
+
+		this.remove();
+	}
+}
+
+customElements.define(SITE_POSTS_TAGNAME, SitePosts);
@@ -0,0 +1,189 @@
+const SITE_SEARCH_TAGNAME = "site-search";
+const SITE_SEARCH_INDEX_PATH = "/search/index.json";
+const SITE_SEARCH_VERSION = 1;
+
+// Terms are split and bounded like the generator does, see src/search.h
+const SITE_SEARCH_TERM_MIN = 2;
+const SITE_SEARCH_TERM_MAX = 32;
+const SITE_SEARCH_RESULTS_MAX = 20;
+
+class SiteSearch extends HTMLElement {
+	// Files are fetched once per page load and only when a query needs them
+	static files = new Map();
+
+	connectedCallback() {
+		this.innerHTML = `<input
+			type="search"
+			class="site-search-input"
+			placeholder="Search"
+			aria-label="Search posts"
+		>
+		<ol class="site-search-results"></ol>`;
+
+		this.input = this.querySelector(":scope > input");
+		this.results = this.querySelector(":scope > ol");
+		this.generation = 0;
+
+		this.input.addEventListener("input", () => {
+			this.search(this.input.value).catch((error) => console.error(error));
+		});
+	}
+
+	static fetchFile(path, type) {
+		if (!SiteSearch.files.has(path)) {
+			const file = fetch(path).then((response) => {
+				if (!response.ok) {
+					throw new Error(`${SITE_SEARCH_TAGNAME}: Failed to fetch ${path}`);
+				}
+				return type === "json" ? response.json() : response.arrayBuffer();
+			});
+			SiteSearch.files.set(path, file);
+		}
+
+		return SiteSearch.files.get(path);
+	}
+
+	// Terms are compared as bytes, one character per UTF-8 byte
+	static terms(query) {
+		const encoder = new TextEncoder();
+
+		return (query.match(/[A-Za-z0-9\u0080-\uFFFF]+/g) ?? [])
+			.map((word) => encoder.encode(word.replace(/[A-Z]/g, (c) => c.toLowerCase())))
+			.filter((bytes) => bytes.length >= SITE_SEARCH_TERM_MIN)
+			.filter((bytes) => bytes.length <= SITE_SEARCH_TERM_MAX)
+			.map((bytes) => String.fromCharCode(...bytes));
+	}
+
+	static shardName(term) {
+		const byte = term.charCodeAt(0);
+		return byte < 0x80 ? term[0] : `x${byte.toString(16).padStart(2, "0")}`;
+	}
+
+	static async shard(manifest, term) {
+		const path = manifest.files[SiteSearch.shardName(term)];
+		if (!path) {
+			return null;
+		}
+
+		const buffer = await SiteSearch.fetchFile(path, "binary");
+		if (!buffer.decoded) {
+			buffer.decoded = SiteSearch.decode(new Uint8Array(buffer));
+		}
+
+		return buffer.decoded;
+	}
+
+	// Front-coded terms followed by their delta-coded postings, all numbers are varints
+	static decode(bytes) {
+		let pos = 0;
+		const varint = () => {
+			let value = 0;
+			let scale = 1;
+			let byte = 0;
+			do {
+				byte = bytes[pos++];
+				value += (byte & 0x7f) * scale;
+				scale *= 128;
+			} while (byte & 0x80);
+			return value;
+		};
+
+		if (varint() !== SITE_SEARCH_VERSION) {
+			throw new Error(`${SITE_SEARCH_TAGNAME}: Unknown index version`);
+		}
+
+		const docs = varint();
+		const terms = [];
+		let previous = "";
+		for (let count = varint(); count > 0; count--) {
+			const shared = varint();
+			const suffix = varint();
+			const term =
+				previous.slice(0, shared) +
+				String.fromCharCode(...bytes.subarray(pos, pos + suffix));
+			pos += suffix;
+
+			const postings = new Map();
+			let doc = 0;
+			for (let postingCount = varint(); postingCount > 0; postingCount--) {
+				doc += varint();
+				postings.set(doc, varint());
+			}
+
+			terms.push({ term, postings });
+			previous = term;
+		}
+
+		return { docs, terms };
+	}
+
+	static async doc(manifest, doc) {
+		const list = Math.floor(doc / manifest.per_list);
+		const docs = await SiteSearch.fetchFile(manifest.files[`docs-${list}`], "json");
+		const [path, title] = docs[doc % manifest.per_list];
+
+		return { path, title };
+	}
+
+	async search(query) {
+		const generation = ++this.generation;
+		const terms = SiteSearch.terms(query);
+		if (terms.length === 0) {
+			this.results.replaceChildren();
+			return;
+		}
+
+		const manifest = await SiteSearch.fetchFile(SITE_SEARCH_INDEX_PATH, "json");
+		if (manifest.version !== SITE_SEARCH_VERSION) {
+			throw new Error(`${SITE_SEARCH_TAGNAME}: Unknown index version`);
+		}
+
+		// Every term has to occur, the last one may still be typed and matches as a prefix
+		let scores = null;
+		for (const [i, term] of terms.entries()) {
+			const shard = await SiteSearch.shard(manifest, term);
+			const matches = new Map();
+			for (const entry of shard?.terms ?? []) {
+				const isLast = i === terms.length - 1;
+				if (isLast ? !entry.term.startsWith(term) : entry.term !== term) {
+					continue;
+				}
+
+				const weight = Math.log(1 + shard.docs / entry.postings.size);
+				for (const [doc, count] of entry.postings) {
+					if (scores === null || scores.has(doc)) {
+						matches.set(doc, (matches.get(doc) ?? 0) + count * weight);
+					}
+				}
+			}
+
+			for (const [doc, score] of matches) {
+				matches.set(doc, score + (scores?.get(doc) ?? 0));
+			}
+			scores = matches;
+		}
+
+		const ranked = [...scores]
+			.sort((a, b) => b[1] - a[1])
+			.slice(0, SITE_SEARCH_RESULTS_MAX);
+		const docs = await Promise.all(ranked.map(([doc]) => SiteSearch.doc(manifest, doc)));
+
+		// A newer query has taken over
+		if (generation !== this.generation) {
+			return;
+		}
+
+		this.results.replaceChildren(
+			...docs.map(({ path, title }) => {
+				const li = document.createElement("li");
+				const a = document.createElement("a");
+				a.href = path;
+				a.textContent = title;
+				li.appendChild(a);
+				return li;
+			}),
+		);
+	}
+}
+
+customElements.define(SITE_SEARCH_TAGNAME, SiteSearch);
@@ -0,0 +1,839 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "asset.h"
+#include "buf.h"
+#include "cache.h"
+#include "error.h"
+#include "image.h"
+#include "minify.h"
+#include "output.h"
+#include "site.h"
+
+#ifndef _SITE_EXT_MINIFY
+#define _SITE_EXT_MINIFY 1
+#endif
+
+// length of the hash prefix used in file names
+#define _SITE_ASSET_HASH_LEN 10
+
+asset_manifest manifest = {
+    .elems = NULL,
+    .len = 0,
+    .capacity = 0,
+};
+
+// manifest indices by name with linear probing, the capacity is a power of two. the manifest
+// itself moves as it grows
+static int *asset_slots = NULL;
+static int asset_slots_capacity = 0;
+
+// an asset read and minified by a worker, waiting to be written in order
+typedef struct {
+        char *content;
+        size_t len;
+        bool done;
+} asset_input;
+
+typedef struct {
+        pthread_mutex_t lock;
+        pthread_cond_t changed;
+        source_file **sources;
+        asset_input *inputs;
+        int len;
+        int next;    // next to be read
+        int written; // written in order so far
+} asset_queue;
+
+static int __asset_rewrite_css(const char *, char **, size_t *);
+
+static const char *asset_excempt_arr[] = {_SITE_ASSET_EXCEMPT_LIST};
+#define _SITE_ASSET_EXCEMPT_LIST_COUNT (sizeof(asset_excempt_arr) / sizeof(asset_excempt_arr[0]))
+
+int asset_read(const char *path, char **content, size_t *len) {
+        FILE *file = NULL;
+        char *data = NULL;
+        int res = -1;
+
+        if ((file = fopen(path, "r")) == NULL) {
+                ERRORF(SITE_ERROR_FILE_OPEN_READ, path);
+                goto cleanup;
+        }
+
+        if (fseek(file, 0, SEEK_END) != 0) {
+                ERRORF(SITE_ERROR_FILE_SEEK, path);
+                goto cleanup;
+        }
+
+        long file_size = ftell(file);
+        if (file_size < 0) {
+                ERRORF(SITE_ERROR_FILE_TELL, path);
+                goto cleanup;
+        }
+        rewind(file);
+
+        if ((data = malloc((size_t)file_size + 1)) == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                goto cleanup;
+        }
+
+        size_t bytes_read = fread(data, 1, (size_t)file_size, file);
+        if (bytes_read != (size_t)file_size) {
+                ERRORF(SITE_ERROR_FILE_READ, path);
+                goto cleanup;
+        }
+        data[bytes_read] = '\0';
+
+        *content = data;
+        *len = bytes_read;
+        data = NULL;
+        res = 0;
+
+cleanup:
+        if (file) fclose(file);
+        if (data) free(data);
+
+        return res;
+}
+
+// insert the hash in front of the extension: style.css -> style.<hash>.css
+static void __asset_hashed_name(const char *name, const char *hash, char *out, size_t out_size) {
+        const char *slash = strrchr(name, '/');
+        const char *dot = strrchr(slash ? slash : name, '.');
+
+        // dotfiles have no extension
+        if (dot == (slash ? slash + 1 : name)) dot = NULL;
+
+        if (dot) {
+                snprintf(out, out_size, "%.*s.%.*s%s", (int)(dot - name), name,
+                         _SITE_ASSET_HASH_LEN, hash, dot);
+        } else {
+                snprintf(out, out_size, "%s.%.*s", name, _SITE_ASSET_HASH_LEN, hash);
+        }
+}
+
+// minify stylesheets, scripts and images, results are cached by the hash of their input
+static int __asset_minify(const char *name, char **content, size_t *len) {
+        const char *ext = strrchr(name, '.');
+        int (*minify)(const char *, size_t, text_buf *) = NULL;
+
+        if (ext && strcmp(ext, ".css") == 0) minify = minify_css;
+        else if (ext && strcmp(ext, ".js") == 0) minify = minify_js;
+        else if (ext && _SITE_EXT_OPTIMIZE_IMAGES && strcmp(ext, ".svg") == 0) minify = minify_svg;
+        else if (ext && _SITE_EXT_OPTIMIZE_IMAGES && strcmp(ext, ".png") == 0) {
+                minify = image_optimize_png;
+        }
+        if (!_SITE_EXT_MINIFY || minify == NULL) return 0;
+
+        hash_ctx ctx;
+        unsigned char digest[_SITE_HASH_SIZE];
+        char key[_SITE_HASH_HEX_SIZE];
+        int options[] = {_SITE_EXT_SVG_PRECISION};
+
+        hash_init(&ctx);
+        hash_update(&ctx, ext, strlen(ext) + 1);
+        hash_update(&ctx, _SITE_MINIFY_VERSION, sizeof(_SITE_MINIFY_VERSION));
+        hash_update(&ctx, options, sizeof(options));
+        hash_update(&ctx, *content, *len);
+        hash_final(&ctx, digest);
+        hash_to_hex(digest, key);
+
+        char *cached = NULL;
+        size_t cached_len = 0;
+        if (cache_get("minify", key, &cached, &cached_len) == 0) {
+                free(*content);
+                *content = cached;
+                *len = cached_len;
+                return 0;
+        }
+
+        text_buf out = {0};
+        if (minify(*content, *len, &out) != 0) {
+                buf_free(&out);
+                return -1;
+        }
+
+        // a failed cache write only costs us the next build
+        cache_put("minify", key, out.data ? out.data : "", out.len);
+
+        free(*content);
+        *len = out.len;
+        *content = buf_detach(&out);
+
+        return 0;
+}
+
+static uint32_t __asset_hash(const char *name) {
+        uint32_t hash = 2166136261u;
+        for (const char *p = name; *p; p++) {
+                hash ^= (unsigned char)*p;
+                hash *= 16777619u;
+        }
+        return hash;
+}
+
+// the first asset of a name wins
+static void __asset_slot_put(int index) {
+        const char *name = manifest.elems[index].name;
+        int slot = (int)(__asset_hash(name) & (uint32_t)(asset_slots_capacity - 1));
+        while (asset_slots[slot] >= 0) {
+                if (strcmp(manifest.elems[asset_slots[slot]].name, name) == 0) return;
+                slot = (slot + 1) & (asset_slots_capacity - 1);
+        }
+        asset_slots[slot] = index;
+}
+
+// index the latest asset, keeping the table at most half full
+static int __asset_index(void) {
+        int index = manifest.len - 1;
+
+        if ((index + 1) * 2 > asset_slots_capacity) {
+                int capacity = asset_slots_capacity ? asset_slots_capacity * 2 : 64;
+                int *slots = malloc(capacity * sizeof(int));
+                if (slots == NULL) {
+                        ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                        return -1;
+                }
+                for (int i = 0; i < capacity; i++) {
+                        slots[i] = -1;
+                }
+
+                free(asset_slots);
+                asset_slots = slots;
+                asset_slots_capacity = capacity;
+                for (int i = 0; i < index; i++) {
+                        __asset_slot_put(i);
+                }
+        }
+
+        __asset_slot_put(index);
+
+        return 0;
+}
+
+static asset *__asset_add(void) {
+        if (manifest.elems == NULL) {
+                manifest.elems = malloc(sizeof(asset) * 16);
+                manifest.capacity = 16;
+        } else if (manifest.capacity == manifest.len) {
+                manifest.capacity *= 2;
+                manifest.elems = realloc(manifest.elems, manifest.capacity * sizeof(asset));
+        }
+        if (manifest.elems == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                return NULL;
+        }
+
+        asset *entry = &manifest.elems[manifest.len++];
+        memset(entry, 0, sizeof(*entry));
+
+        return entry;
+}
+
+int asset_add_content(const char *name, char *content, size_t len) {
+        int res = -1;
+
+        // fingerprinted names must fit as well
+        if (strlen(name) + _SITE_ASSET_HASH_LEN + 1 >= _SITE_PATH_MAX) {
+                errno = 0;
+                ERRORF(SITE_ERROR_PATH_LENGTH, name, _SITE_PATH_MAX - _SITE_ASSET_HASH_LEN - 2);
+                goto cleanup;
+        }
+
+        asset *entry = NULL;
+        if ((entry = __asset_add()) == NULL) goto cleanup;
+
+        snprintf(entry->name, sizeof(entry->name), "%s", name);
+        if (__asset_index() != 0) goto cleanup;
+        hash_hex(content, len, entry->hash);
+        entry->len = len;
+        entry->output = -1;
+
+        bool excempt = false;
+        for (size_t i = 0; i < _SITE_ASSET_EXCEMPT_LIST_COUNT; i++) {
+                if (strcmp(name, asset_excempt_arr[i]) == 0) excempt = true;
+        }
+
+        if (excempt) {
+                snprintf(entry->hashed_name, sizeof(entry->hashed_name), "%s", name);
+        } else {
+                __asset_hashed_name(name, entry->hash, entry->hashed_name,
+                                    sizeof(entry->hashed_name));
+        }
+
+        // fingerprinted names change with their content, so clients never need to revalidate.
+        // history may still be walked, the time is filled in later
+        output_meta meta = {.modified = 0,
+                            .tier = excempt ? OUTPUT_CACHE_SHORT : OUTPUT_CACHE_IMMUTABLE};
+
+        // identical assets of other sites are linked from the cache they share
+        char cached_path[_SITE_CACHE_PATH_MAX];
+        int linked = 1;
+        if (site.share_assets && cache_file("asset", entry->hash, cached_path,
+                                            sizeof(cached_path)) == 0) {
+                if ((linked = output_link(entry->hashed_name, &meta, cached_path)) < 0) {
+                        goto cleanup;
+                }
+        }
+        if (linked != 0) {
+                if (output_write(entry->hashed_name, &meta, content, len) != 0) goto cleanup;
+                if (site.share_assets) {
+                        char output[_SITE_PATH_MAX * 2];
+                        output_path(entry->hashed_name, output, sizeof(output));
+                        cache_link("asset", entry->hash, output);
+                }
+        }
+        entry->output = output_entries.len - 1;
+
+        // keep small assets around for inlining
+        if (len <= _SITE_ASSET_KEEP_MAX) {
+                entry->content = content;
+                content = NULL;
+        }
+
+        res = 0;
+
+cleanup:
+        if (content) free(content);
+
+        return res;
+}
+
+// read and minify on a worker, NULL content if it failed
+static void __asset_prepare(asset_queue *queue, int i) {
+        asset_input *input = &queue->inputs[i];
+        const source_file *source = queue->sources[i];
+
+        if (asset_read(source->path, &input->content, &input->len) != 0 ||
+            __asset_minify(source->name, &input->content, &input->len) != 0) {
+                free(input->content);
+                input->content = NULL;
+        }
+}
+
+static void *__asset_worker(void *arg) {
+        asset_queue *queue = arg;
+
+        pthread_mutex_lock(&queue->lock);
+        for (;;) {
+                // stay within a window ahead of the assets written so far
+                while (queue->next < queue->len &&
+                       queue->next >= queue->written + _SITE_ASSET_WINDOW) {
+                        pthread_cond_wait(&queue->changed, &queue->lock);
+                }
+                if (queue->next >= queue->len) break;
+
+                int i = queue->next++;
+                pthread_mutex_unlock(&queue->lock);
+                __asset_prepare(queue, i);
+                pthread_mutex_lock(&queue->lock);
+
+                queue->inputs[i].done = true;
+                pthread_cond_broadcast(&queue->changed);
+        }
+        pthread_mutex_unlock(&queue->lock);
+
+        return NULL;
+}
+
+int asset_process(source_file *sources[], int len) {
+        int res = 0;
+        pthread_t threads[_SITE_ASSET_THREADS_MAX];
+        int threads_len = 0;
+
+        asset_queue queue = {.sources = sources, .len = len};
+        if (len == 0) return 0;
+        if ((queue.inputs = calloc((size_t)len, sizeof(asset_input))) == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                return -1;
+        }
+
+        pthread_mutex_init(&queue.lock, NULL);
+        pthread_cond_init(&queue.changed, NULL);
+
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        int wanted = cpus < 1 ? 1 : cpus > _SITE_ASSET_THREADS_MAX ? _SITE_ASSET_THREADS_MAX
+                                                                    : (int)cpus;
+        for (int i = 0; i < wanted && i < len; i++) {
+                if (pthread_create(&threads[threads_len], NULL, __asset_worker, &queue) != 0) {
+                        break;
+                }
+                threads_len++;
+        }
+
+        // assets are added in order, so their manifest doesn't depend on the workers
+        for (int i = 0; i < len; i++) {
+                asset_input *input = &queue.inputs[i];
+                if (threads_len == 0) {
+                        __asset_prepare(&queue, i);
+                } else {
+                        pthread_mutex_lock(&queue.lock);
+                        while (!input->done) {
+                                pthread_cond_wait(&queue.changed, &queue.lock);
+                        }
+                        pthread_mutex_unlock(&queue.lock);
+                }
+
+                const char *ext = strrchr(sources[i]->name, '.');
+                if (input->content != NULL && ext && strcmp(ext, ".css") == 0 &&
+                    __asset_rewrite_css(sources[i]->name, &input->content, &input->len) != 0) {
+                        free(input->content);
+                        input->content = NULL;
+                }
+
+                if (input->content == NULL ||
+                    asset_add_content(sources[i]->name, input->content, input->len) != 0) {
+                        res = -1;
+                }
+                input->content = NULL;
+
+                pthread_mutex_lock(&queue.lock);
+                queue.written = i + 1;
+                pthread_cond_broadcast(&queue.changed);
+                pthread_mutex_unlock(&queue.lock);
+        }
+
+        for (int i = 0; i < threads_len; i++) {
+                pthread_join(threads[i], NULL);
+        }
+        pthread_cond_destroy(&queue.changed);
+        pthread_mutex_destroy(&queue.lock);
+        free(queue.inputs);
+
+        return res;
+}
+
+void asset_cleanup(void) {
+        for (int i = 0; i < manifest.len; i++) {
+                free(manifest.elems[i].content);
+                free(manifest.elems[i].data_uri);
+                free(manifest.elems[i].sprite);
+        }
+        free(manifest.elems);
+        manifest.elems = NULL;
+        manifest.len = 0;
+        manifest.capacity = 0;
+        free(asset_slots);
+        asset_slots = NULL;
+        asset_slots_capacity = 0;
+}
+
+asset *asset_find(const char *name) {
+        if (asset_slots_capacity == 0) return NULL;
+
+        int slot = (int)(__asset_hash(name) & (uint32_t)(asset_slots_capacity - 1));
+        while (asset_slots[slot] >= 0) {
+                asset *entry = &manifest.elems[asset_slots[slot]];
+                if (strcmp(entry->name, name) == 0) return entry;
+                slot = (slot + 1) & (asset_slots_capacity - 1);
+        }
+        return NULL;
+}
+
+const char *asset_path(const char *name) {
+        asset *entry = asset_find(name);
+        return entry ? entry->hashed_name : name;
+}
+
+// collapse "." and ".." segments in place, false if the path leaves the source dir
+static bool __asset_normalize(char *path) {
+        char *out = path;
+        const char *segment = path;
+
+        while (*segment) {
+                const char *end = strchr(segment, '/');
+                if (end == NULL) end = segment + strlen(segment);
+                size_t len = (size_t)(end - segment);
+
+                if (len == 2 && segment[0] == '.' && segment[1] == '.') {
+                        if (out == path) return false;
+                        while (out > path && *--out != '/') {
+                        }
+                } else if (len > 0 && !(len == 1 && segment[0] == '.')) {
+                        if (out > path) *out++ = '/';
+                        memmove(out, segment, len);
+                        out += len;
+                }
+
+                segment = *end ? end + 1 : end;
+        }
+        *out = '\0';
+
+        return true;
+}
+
+asset *asset_resolve(const char *base, const char *value, size_t len) {
+        size_t skip = (len > 0 && value[0] == '/') ? 1 : 0;
+        size_t base_len = skip || !*base ? 0 : strlen(base) + 1;
+        char name[_SITE_PATH_MAX * 2];
+        if (len - skip == 0 || base_len + len - skip >= sizeof(name)) return NULL;
+        snprintf(name, sizeof(name), "%s%s%.*s", base_len ? base : "", base_len ? "/" : "",
+                 (int)(len - skip), value + skip);
+
+        if (!__asset_normalize(name) || strlen(name) >= _SITE_PATH_MAX) return NULL;
+
+        return asset_find(name);
+}
+
+// local references to stylesheets, scripts and images have to be among the assets, anything
+// else may be a page or an output generated later
+static bool __asset_expected(const char *value, size_t len) {
+        static const char *exts[] = {".css", ".js",   ".svg",  ".png", ".jpg",
+                                     ".jpeg", ".gif", ".webp", ".avif", ".ico"};
+
+        if (len == 0 || value[0] == '#' || (len > 1 && value[0] == '/' && value[1] == '/')) {
+                return false;
+        }
+
+        // schemes like https: or data: come before any slash
+        const char *ext = NULL;
+        for (size_t i = 0; i < len; i++) {
+                if (value[i] == ':' && ext == NULL && memchr(value, '/', i) == NULL) return false;
+                if (value[i] == '.') ext = value + i;
+                else if (value[i] == '/') ext = NULL;
+        }
+        if (ext == NULL) return false;
+
+        size_t ext_len = (size_t)(value + len - ext);
+        for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); i++) {
+                if (strlen(exts[i]) == ext_len && strncasecmp(ext, exts[i], ext_len) == 0) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+static const char *__asset_mime_type(const char *name) {
+        static const char *types[][2] = {
+            {".svg", "image/svg+xml"},
+            {".png", "image/png"},
+            {".jpg", "image/jpeg"},
+            {".jpeg", "image/jpeg"},
+            {".gif", "image/gif"},
+            {".webp", "image/webp"},
+            {".avif", "image/avif"},
+            {".ico", "image/x-icon"},
+        };
+
+        const char *ext = strrchr(name, '.');
+        for (size_t i = 0; ext && i < sizeof(types) / sizeof(types[0]); i++) {
+                if (strcasecmp(ext, types[i][0]) == 0) return types[i][1];
+        }
+        return NULL;
+}
+
+// large assets aren't kept, their size is read from the head of the written file
+static void __asset_measure(asset *entry) {
+        char *cached = NULL;
+        size_t cached_len = 0;
+        if (cache_get("image", entry->hash, &cached, &cached_len) == 0) {
+                if (sscanf(cached, "%d %d", &entry->size.width, &entry->size.height) != 2) {
+                        entry->size = (image_size){0};
+                }
+                free(cached);
+                return;
+        }
+
+        char *head = NULL;
+        const char *data = entry->content;
+        size_t len = entry->len;
+        if (data == NULL) {
+                char path[_SITE_PATH_MAX * 2];
+                output_path(entry->hashed_name, path, sizeof(path));
+
+                FILE *file = fopen(path, "r");
+                if (file == NULL) {
+                        ERRORF(SITE_ERROR_FILE_OPEN_READ, path);
+                        return;
+                }
+                if ((head = malloc(_SITE_IMAGE_HEAD_MAX)) != NULL) {
+                        len = fread(head, 1, _SITE_IMAGE_HEAD_MAX, file);
+                } else {
+                        ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                }
+                fclose(file);
+                if (head == NULL) return;
+                data = head;
+        }
+
+        // unknown formats are remembered as well
+        image_measure(entry->name, data, len, &entry->size);
+        free(head);
+
+        char value[32];
+        int value_len = snprintf(value, sizeof(value), "%d %d", entry->size.width,
+                                 entry->size.height);
+        cache_put("image", entry->hash, value, (size_t)value_len);
+}
+
+bool asset_image_size(asset *entry, image_size *size) {
+        if (__asset_mime_type(entry->name) == NULL) return false;
+
+        if (!entry->measured) {
+                __asset_measure(entry);
+                entry->measured = true;
+        }
+
+        *size = entry->size;
+        return size->width > 0 && size->height > 0;
+}
+
+static bool __asset_inlinable(const asset *entry) {
+        return entry->content != NULL && entry->len <= _SITE_EXT_INLINE_MAX &&
+               __asset_mime_type(entry->name) != NULL;
+}
+
+// encoded once and shared by every page referencing the asset
+static const char *__asset_data_uri(asset *entry) {
+        static const char digits[] =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+        if (entry->data_uri) return entry->data_uri;
+
+        text_buf uri = {0};
+        if (buf_printf(&uri, "data:%s;base64,", __asset_mime_type(entry->name)) != 0) {
+                return NULL;
+        }
+
+        const unsigned char *data = (const unsigned char *)entry->content;
+        for (size_t i = 0; i < entry->len; i += 3) {
+                size_t n = entry->len - i < 3 ? entry->len - i : 3;
+                unsigned long group = (unsigned long)data[i] << 16;
+                if (n > 1) group |= (unsigned long)data[i + 1] << 8;
+                if (n > 2) group |= data[i + 2];
+
+                char quad[4] = {
+                    digits[(group >> 18) & 0x3f],
+                    digits[(group >> 12) & 0x3f],
+                    n > 1 ? digits[(group >> 6) & 0x3f] : '=',
+                    n > 2 ? digits[group & 0x3f] : '=',
+                };
+                if (buf_append(&uri, quad, sizeof(quad)) != 0) {
+                        buf_free(&uri);
+                        return NULL;
+                }
+        }
+
+        entry->data_uri = buf_detach(&uri);
+
+        return entry->data_uri;
+}
+
+// the children of the root <svg> element, to be placed into an inline sprite
+static const char *__asset_sprite(asset *entry) {
+        if (entry->sprite) return entry->sprite;
+
+        const char *root = strstr(entry->content, "<svg");
+        const char *open_end = root ? strchr(root, '>') : NULL;
+        const char *close = NULL;
+        for (const char *pos = entry->content; (pos = strstr(pos, "</svg")) != NULL; pos++) {
+                close = pos;
+        }
+        if (open_end == NULL || close == NULL || close < open_end) return NULL;
+
+        size_t len = (size_t)(close - open_end - 1);
+        if ((entry->sprite = malloc(len + 1)) == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                return NULL;
+        }
+        memcpy(entry->sprite, open_end + 1, len);
+        entry->sprite[len] = '\0';
+
+        return entry->sprite;
+}
+
+typedef struct {
+        text_buf *sprite; // NULL disables inlining
+        const char *base; // dir relative references are resolved against, empty for the top
+        text_buf defs;
+        bool shared;
+        int generation;
+} asset_inliner;
+
+// small assets are embedded instead of being referenced, NULL if the value is kept as a reference
+static const char *__asset_inline(asset_inliner *inliner, asset *entry, const char *attr,
+                                  const char *fragment) {
+        if (inliner->sprite == NULL || !__asset_inlinable(entry)) return NULL;
+
+        // images become data: URIs
+        if (strcmp(attr, "src=") == 0 && *fragment == '\0') return __asset_data_uri(entry);
+
+        // symbols referenced from SVG are moved into a sprite of the page
+        if (strcmp(attr, "href=") != 0 || *fragment != '#') return NULL;
+        if (strcasecmp(strrchr(entry->name, '.'), ".svg") != 0) return NULL;
+
+        // the shared sprite is part of every page already
+        if (entry->sprite_shared) return fragment;
+
+        if (entry->sprite_generation != inliner->generation) {
+                const char *sprite = __asset_sprite(entry);
+                if (sprite == NULL) return NULL;
+                if (buf_puts(&inliner->defs, sprite) != 0) return NULL;
+
+                entry->sprite_generation = inliner->generation;
+                if (inliner->shared) entry->sprite_shared = true;
+        }
+
+        return fragment;
+}
+
+// resolve a single attribute value, keeping a leading slash and any #fragment or ?query
+static int __asset_rewrite_value(asset_inliner *inliner, text_buf *out, const char *attr,
+                                 const char *value, size_t len) {
+        size_t path_len = 0;
+        while (path_len < len && value[path_len] != '#' && value[path_len] != '?') {
+                path_len++;
+        }
+
+        asset *entry = asset_resolve(inliner->base, value, path_len);
+        if (entry == NULL && __asset_expected(value, path_len)) {
+                // only fingerprinted names are written, the reference would be broken
+                errno = 0;
+                ERRORF(SITE_ERROR_ASSET_MISSING, (int)path_len, value);
+                return -1;
+        }
+        if (entry == NULL) return buf_append(out, value, len);
+
+        char fragment[_SITE_PATH_MAX];
+        snprintf(fragment, sizeof(fragment), "%.*s", (int)(len - path_len), value + path_len);
+
+        const char *inlined = __asset_inline(inliner, entry, attr, fragment);
+        if (inlined) return buf_puts(out, inlined);
+
+        // fingerprinted names stay in the dir of the asset, so the reference keeps its own
+        size_t dir_len = path_len;
+        while (dir_len > 0 && value[dir_len - 1] != '/') {
+                dir_len--;
+        }
+        const char *hashed_base = strrchr(entry->hashed_name, '/');
+        hashed_base = hashed_base ? hashed_base + 1 : entry->hashed_name;
+
+        if (buf_append(out, value, dir_len) != 0) return -1;
+        if (buf_puts(out, hashed_base) != 0) return -1;
+        return buf_append(out, value + path_len, len - path_len);
+}
+
+// point url() references of a stylesheet at fingerprinted names, resolved against its dir
+static int __asset_rewrite_css(const char *name, char **content, size_t *len) {
+        char base[_SITE_PATH_MAX];
+        const char *slash = strrchr(name, '/');
+        snprintf(base, sizeof(base), "%.*s", slash ? (int)(slash - name) : 0, name);
+
+        asset_inliner inliner = {.sprite = NULL, .base = base};
+        text_buf out = {0};
+        const char *css = *content;
+        const char *copied = css;
+
+        for (const char *pos = css; (pos = strchr(pos, '(')) != NULL; pos++) {
+                if (pos - css < 3 || strncasecmp(pos - 3, "url", 3) != 0) continue;
+
+                const char *value = pos + 1;
+                while (*value == ' ') {
+                        value++;
+                }
+                char quote = (*value == '"' || *value == '\'') ? *value++ : ')';
+                const char *end = strchr(value, quote);
+                if (end == NULL) break;
+                while (quote == ')' && end > value && end[-1] == ' ') {
+                        end--;
+                }
+
+                if (buf_append(&out, copied, (size_t)(value - copied)) != 0 ||
+                    __asset_rewrite_value(&inliner, &out, "url(", value, (size_t)(end - value)) !=
+                        0) {
+                        buf_free(&out);
+                        return -1;
+                }
+                copied = end;
+                pos = end;
+        }
+
+        if (copied == css) return 0;
+        if (buf_append(&out, copied, *len - (size_t)(copied - css)) != 0) {
+                buf_free(&out);
+                return -1;
+        }
+
+        free(*content);
+        *len = out.len;
+        *content = buf_detach(&out);
+
+        return 0;
+}
+
+char *asset_rewrite_refs(const char *html, const char *base, text_buf *sprite, bool shared) {
+        static const char *attrs[] = {"href=", "src="};
+        static int generation = 0;
+        asset_inliner inliner = {
+            .sprite = _SITE_EXT_INLINE_MAX > 0 ? sprite : NULL,
+            .base = base,
+            .defs = {0},
+            .shared = shared,
+            .generation = ++generation,
+        };
+        text_buf out = {0};
+        const char *pos = html;
+        const char *copied = html;
+
+        while (*pos) {
+                // attribute names are preceded by whitespace
+                if (pos == html || !strchr(" \t\n", pos[-1])) {
+                        pos++;
+                        continue;
+                }
+
+                const char *attr = NULL;
+                size_t attr_len = 0;
+                for (size_t i = 0; i < sizeof(attrs) / sizeof(attrs[0]); i++) {
+                        size_t n = strlen(attrs[i]);
+                        if (strncmp(pos, attrs[i], n) == 0) {
+                                attr = attrs[i];
+                                attr_len = n;
+                        }
+                }
+
+                char quote = attr_len ? pos[attr_len] : '\0';
+                if (quote != '"' && quote != '\'') {
+                        pos++;
+                        continue;
+                }
+
+                const char *value = pos + attr_len + 1;
+                const char *end = strchr(value, quote);
+                if (end == NULL) break;
+
+                if (buf_append(&out, copied, (size_t)(value - copied)) != 0) goto error;
+                if (__asset_rewrite_value(&inliner, &out, attr, value, (size_t)(end - value)) !=
+                    0) {
+                        goto error;
+                }
+
+                copied = end;
+                pos = end;
+        }
+
+        if (buf_puts(&out, copied) != 0) goto error;
+
+        if (inliner.defs.len > 0) {
+                int res = buf_printf(sprite,
+                                     "<svg width=\"0\" height=\"0\" style=\"position:absolute\" "
+                                     "aria-hidden=\"true\"><defs>%s</defs></svg>\n",
+                                     inliner.defs.data);
+                if (res != 0) goto error;
+        }
+        buf_free(&inliner.defs);
+
+        return buf_detach(&out);
+
+error:
+        buf_free(&inliner.defs);
+        buf_free(&out);
+        return NULL;
+}
@@ -0,0 +1,88 @@
+#ifndef ASSET_H
+#define ASSET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "buf.h"
+#include "hash.h"
+#include "image.h"
+#include "page.h"
+#include "scan.h"
+
+// content of assets up to this size stays in memory for inlining
+#define _SITE_ASSET_KEEP_MAX (256 * 1024)
+
+// images and SVG symbols up to this size are embedded into pages, 0 disables it
+#ifndef _SITE_EXT_INLINE_MAX
+#define _SITE_EXT_INLINE_MAX 4096
+#endif
+
+// strip and recompress SVG and PNG images along with minifying stylesheets and scripts
+#ifndef _SITE_EXT_OPTIMIZE_IMAGES
+#define _SITE_EXT_OPTIMIZE_IMAGES 1
+#endif
+
+// assets are read and minified by this many threads at most, staying this many assets ahead
+// of the ones written
+#define _SITE_ASSET_THREADS_MAX 8
+#define _SITE_ASSET_WINDOW      32
+
+// files which are linked from outside and must keep their name
+#define _SITE_ASSET_EXCEMPT_LIST "robots.txt", "favicon.ico"
+
+typedef struct {
+        char name[_SITE_PATH_MAX];        // path relative to the source dir
+        char hashed_name[_SITE_PATH_MAX]; // fingerprinted name, e.g. style.<hash>.css
+        char hash[_SITE_HASH_HEX_SIZE];
+        char *content; // NULL for large assets
+        size_t len;
+        int output; // index into output_entries, -1 until written
+
+        // encodings for inlining, created on first use
+        char *data_uri;
+        char *sprite;
+        int sprite_generation;
+        bool sprite_shared;
+
+        // intrinsic size of images, measured on first use
+        image_size size;
+        bool measured;
+} asset;
+
+typedef struct {
+        asset *elems;
+        int len;
+        int capacity;
+} asset_manifest;
+
+extern asset_manifest manifest;
+
+// minify, hash, fingerprint and copy assets into the target dir, in the given order. stylesheets
+// refer to the fingerprinted names of other assets and have to come after them
+int asset_process(source_file *[], int);
+void asset_cleanup(void);
+
+// read a whole file, NUL-terminated
+int asset_read(const char *, char **, size_t *);
+
+// fingerprint and write an asset read and minified before, taking ownership of its content
+int asset_add_content(const char *, char *, size_t);
+
+// manifest lookups
+asset *asset_find(const char *);
+const char *asset_path(const char *);
+
+// the asset an attribute value of the given length refers to, relative values are resolved
+// against the dir of the page within the source dir
+asset *asset_resolve(const char *, const char *, size_t);
+
+// size of an image asset, remembered across builds by its hash
+bool asset_image_size(asset *, image_size *);
+
+// rewrite href/src attributes referencing known assets, appending an SVG sprite for inlined
+// symbols to the given buffer; shared sprites are expected to be part of every page. relative
+// references are resolved against the dir of the page within the source dir
+char *asset_rewrite_refs(const char *, const char *, text_buf *, bool);
+
+#endif // ASSET_H
@@ -0,0 +1,95 @@
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "buf.h"
+#include "error.h"
+
+static int __buf_reserve(text_buf *buf, size_t extra) {
+        if (buf->len + extra + 1 <= buf->capacity) return 0;
+
+        size_t capacity = buf->capacity ? buf->capacity : 256;
+        while (capacity < buf->len + extra + 1) {
+                capacity *= 2;
+        }
+
+        char *data = realloc(buf->data, capacity);
+        if (data == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                return -1;
+        }
+
+        buf->data = data;
+        buf->capacity = capacity;
+
+        return 0;
+}
+
+int buf_append(text_buf *buf, const char *data, size_t len) {
+        if (__buf_reserve(buf, len) != 0) return -1;
+
+        memcpy(buf->data + buf->len, data, len);
+        buf->len += len;
+        buf->data[buf->len] = '\0';
+
+        return 0;
+}
+
+int buf_puts(text_buf *buf, const char *str) { return buf_append(buf, str, strlen(str)); }
+
+int buf_printf(text_buf *buf, const char *format, ...) {
+        va_list args;
+
+        va_start(args, format);
+        int len = vsnprintf(NULL, 0, format, args);
+        va_end(args);
+        if (len < 0) return -1;
+
+        if (__buf_reserve(buf, (size_t)len) != 0) return -1;
+
+        va_start(args, format);
+        vsnprintf(buf->data + buf->len, (size_t)len + 1, format, args);
+        va_end(args);
+        buf->len += (size_t)len;
+
+        return 0;
+}
+
+int buf_json_string(text_buf *buf, const char *str) {
+        if (buf_puts(buf, "\"") != 0) return -1;
+        for (const char *p = str; *p; p++) {
+                unsigned char c = (unsigned char)*p;
+                int res = 0;
+                if (c == '"' || c == '\\') {
+                        res = buf_printf(buf, "\\%c", c);
+                } else if (c < 0x20) {
+                        res = buf_printf(buf, "\\u%04x", c);
+                } else {
+                        res = buf_append(buf, p, 1);
+                }
+                if (res != 0) return -1;
+        }
+        return buf_puts(buf, "\"");
+}
+
+char *buf_detach(text_buf *buf) {
+        char *data = buf->data;
+
+        // keep the "always a string" promise for empty buffers
+        if (data == NULL) data = calloc(1, 1);
+
+        buf->data = NULL;
+        buf->len = 0;
+        buf->capacity = 0;
+
+        return data;
+}
+
+void buf_free(text_buf *buf) {
+        free(buf->data);
+        buf->data = NULL;
+        buf->len = 0;
+        buf->capacity = 0;
+}
@@ -0,0 +1,24 @@
+#ifndef BUF_H
+#define BUF_H
+
+#include <stddef.h>
+
+typedef struct {
+        char *data;
+        size_t len;
+        size_t capacity;
+} text_buf;
+
+// append to a growable, always NUL-terminated buffer
+int buf_append(text_buf *, const char *, size_t);
+int buf_puts(text_buf *, const char *);
+int buf_printf(text_buf *, const char *, ...);
+
+// append a string as a quoted JSON string
+int buf_json_string(text_buf *, const char *);
+
+// hand the content over to the caller
+char *buf_detach(text_buf *);
+void buf_free(text_buf *);
+
+#endif // BUF_H
@@ -0,0 +1,271 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <fts.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "error.h"
+#include "page.h"
+#include "site.h"
+
+// entries live in <cache dir>/<namespace>/<first two key chars>/<key>
+static void __cache_path(const char *ns, const char *key, char *path, size_t path_size) {
+        snprintf(path, path_size, "%s/%s/%.2s/%s", site.cache_dir, ns, key, key);
+}
+
+static int __cache_create_dirs(const char *path) {
+        mode_t mode = S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
+        char dir[_SITE_CACHE_PATH_MAX];
+
+        snprintf(dir, sizeof(dir), "%s", path);
+        for (char *p = dir + 1; *p; p++) {
+                if (*p != '/') continue;
+
+                *p = '\0';
+                if (mkdir(dir, mode) != 0 && errno != EEXIST) {
+                        ERRORF(SITE_ERROR_DIRECTORY_CREATE, dir);
+                        return -1;
+                }
+                *p = '/';
+        }
+
+        return 0;
+}
+
+// private names for entries being written, unique across processes and their threads
+static void __cache_tmp_path(const char *path, char *tmp_path, size_t tmp_path_size) {
+        static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+        static unsigned long counter = 0;
+
+        pthread_mutex_lock(&lock);
+        unsigned long n = counter++;
+        pthread_mutex_unlock(&lock);
+
+        snprintf(tmp_path, tmp_path_size, "%s.%ld.%lu.tmp", path, (long)getpid(), n);
+}
+
+// entries are ranked by access time for eviction
+static void __cache_touch(const char *path) {
+        struct timespec times[2] = {{.tv_sec = 0, .tv_nsec = UTIME_NOW},
+                                    {.tv_sec = 0, .tv_nsec = UTIME_OMIT}};
+        utimensat(AT_FDCWD, path, times, 0);
+}
+
+static int __cache_read(const char *path, char **data, size_t *len) {
+        FILE *file = NULL;
+        char *content = NULL;
+        int res = 1;
+
+        struct stat file_stat;
+        if (stat(path, &file_stat) != 0) return 1;
+
+        if ((file = fopen(path, "r")) == NULL) return 1;
+
+        size_t size = (size_t)file_stat.st_size;
+        if ((content = malloc(size + 1)) == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                res = -1;
+                goto cleanup;
+        }
+
+        // treat short reads as a miss, the entry will simply be rewritten
+        if (fread(content, 1, size, file) != size) goto cleanup;
+        content[size] = '\0';
+
+        *data = content;
+        *len = size;
+        content = NULL;
+        res = 0;
+
+cleanup:
+        if (file) fclose(file);
+        if (content) free(content);
+
+        return res;
+}
+
+int cache_get(const char *ns, const char *key, char **data, size_t *len) {
+        char path[_SITE_CACHE_PATH_MAX];
+        __cache_path(ns, key, path, sizeof(path));
+
+        int res = __cache_read(path, data, len);
+        if (res == 0) __cache_touch(path);
+
+        return res;
+}
+
+int cache_file(const char *ns, const char *key, char *path, size_t path_size) {
+        __cache_path(ns, key, path, path_size);
+
+        struct stat file_stat;
+        if (stat(path, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) return 1;
+
+        __cache_touch(path);
+
+        return 0;
+}
+
+int cache_put(const char *ns, const char *key, const char *data, size_t len) {
+        struct iovec iov = {.iov_base = (void *)data, .iov_len = len};
+        return cache_putv(ns, key, &iov, 1);
+}
+
+int cache_putv(const char *ns, const char *key, const struct iovec *iov, int iov_len) {
+        char path[_SITE_CACHE_PATH_MAX];
+        char tmp_path[_SITE_CACHE_PATH_MAX + 32];
+        FILE *file = NULL;
+
+        __cache_path(ns, key, path, sizeof(path));
+        if (__cache_create_dirs(path) != 0) return -1;
+
+        // write to a private file first and publish it with an atomic rename, entries are
+        // never modified in place since outputs may be linked to them
+        __cache_tmp_path(path, tmp_path, sizeof(tmp_path));
+
+        if ((file = fopen(tmp_path, "w")) == NULL) {
+                ERRORF(SITE_ERROR_FILE_OPEN_WRITE, tmp_path);
+                return -1;
+        }
+
+        for (int i = 0; i < iov_len; i++) {
+                if (fwrite(iov[i].iov_base, 1, iov[i].iov_len, file) != iov[i].iov_len) {
+                        ERRORF(SITE_ERROR_FILE_WRITE, tmp_path);
+                        fclose(file);
+                        unlink(tmp_path);
+                        return -1;
+                }
+        }
+
+        if (fclose(file) != 0 || rename(tmp_path, path) != 0) {
+                ERRORF(SITE_ERROR_FILE_WRITE, tmp_path);
+                unlink(tmp_path);
+                return -1;
+        }
+
+        return 0;
+}
+
+int cache_link(const char *ns, const char *key, const char *source_path) {
+        char path[_SITE_CACHE_PATH_MAX];
+        char tmp_path[_SITE_CACHE_PATH_MAX + 32];
+
+        __cache_path(ns, key, path, sizeof(path));
+        if (__cache_create_dirs(path) != 0) return -1;
+
+        __cache_tmp_path(path, tmp_path, sizeof(tmp_path));
+
+        unlink(tmp_path);
+        if (link(source_path, tmp_path) == 0) {
+                if (rename(tmp_path, path) == 0) return 0;
+
+                ERRORF(SITE_ERROR_FILE_WRITE, tmp_path);
+                unlink(tmp_path);
+                return -1;
+        }
+
+        // the cache lives on another file system
+        char *data = NULL;
+        size_t len = 0;
+        int res = __cache_read(source_path, &data, &len);
+        if (res != 0) return res;
+
+        res = cache_put(ns, key, data, len);
+        free(data);
+
+        return res;
+}
+
+typedef struct {
+        char *path;
+        time_t used;
+        size_t size;
+} cache_entry;
+
+static int __cache_entry_cmp(const void *a, const void *b) {
+        const cache_entry *entry_a = a;
+        const cache_entry *entry_b = b;
+
+        // ascending order (least recently used first)
+        if (entry_a->used < entry_b->used) return -1;
+        if (entry_a->used > entry_b->used) return 1;
+        return 0;
+}
+
+int cache_evict(void) {
+        int res = 0;
+        char *paths[] = {site.cache_dir, NULL};
+        cache_entry *entries = NULL;
+        int len = 0;
+        int capacity = 0;
+        size_t total = 0;
+
+        struct stat dir_stat;
+        if (stat(site.cache_dir, &dir_stat) != 0) return 0;
+
+        FTS *ftsp = NULL;
+        if ((ftsp = fts_open(paths, FTS_PHYSICAL | FTS_NOCHDIR, NULL)) == NULL) {
+                ERROR(SITE_ERROR_FTS_INIT);
+                return -1;
+        }
+
+        time_t now = time(NULL);
+        FTSENT *ftsentp = NULL;
+        while ((ftsentp = fts_read(ftsp)) != NULL) {
+                if (ftsentp->fts_info != FTS_F) continue;
+
+                // leftovers of writers that died, anything younger may still be in progress
+                size_t name_len = ftsentp->fts_namelen;
+                if (name_len > 4 && strcmp(ftsentp->fts_name + name_len - 4, ".tmp") == 0) {
+                        if (now - ftsentp->fts_statp->st_mtime > _SITE_CACHE_TMP_MAX_AGE) {
+                                unlink(ftsentp->fts_accpath);
+                        }
+                        continue;
+                }
+
+                if (len == capacity) {
+                        capacity = capacity ? capacity * 2 : 256;
+                        cache_entry *grown = realloc(entries, capacity * sizeof(cache_entry));
+                        if (grown == NULL) {
+                                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                                res = -1;
+                                goto cleanup;
+                        }
+                        entries = grown;
+                }
+
+                if ((entries[len].path = strdup(ftsentp->fts_path)) == NULL) {
+                        ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                        res = -1;
+                        goto cleanup;
+                }
+                entries[len].used = ftsentp->fts_statp->st_atime;
+                entries[len].size = (size_t)ftsentp->fts_statp->st_size;
+                total += entries[len].size;
+                len++;
+        }
+
+        if (total <= _SITE_EXT_CACHE_MAX) goto cleanup;
+
+        // concurrent builds holding an evicted entry still have their copy or link
+        qsort(entries, len, sizeof(cache_entry), __cache_entry_cmp);
+        for (int i = 0; i < len && total > _SITE_EXT_CACHE_MAX; i++) {
+                if (unlink(entries[i].path) == 0 || errno == ENOENT) total -= entries[i].size;
+        }
+
+cleanup:
+        for (int i = 0; i < len; i++) {
+                free(entries[i].path);
+        }
+        free(entries);
+        fts_close(ftsp);
+
+        return res;
+}
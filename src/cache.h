@@ -0,0 +1,39 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+
+#include <sys/uio.h>
+
+#ifndef _SITE_EXT_CACHE_DIR
+#define _SITE_EXT_CACHE_DIR ".cache"
+#endif
+
+// size limit in bytes, least recently used entries are evicted beyond it
+#ifndef _SITE_EXT_CACHE_MAX
+#define _SITE_EXT_CACHE_MAX (64 * 1024 * 1024)
+#endif
+
+// paths of entries, the cache dir is set per site
+#define _SITE_CACHE_PATH_MAX 512
+
+// age in seconds after which unfinished entries are considered abandoned
+#define _SITE_CACHE_TMP_MAX_AGE (60 * 60)
+
+// look up an entry by namespace and key, 0 on hit, 1 on miss
+int cache_get(const char *, const char *, char **, size_t *);
+
+// path of an entry to link to, 0 on hit, 1 on miss
+int cache_file(const char *, const char *, char *, size_t);
+
+// store an entry, concurrent writers of the same key are harmless
+int cache_put(const char *, const char *, const char *, size_t);
+int cache_putv(const char *, const char *, const struct iovec *, int);
+
+// store a file written elsewhere by linking to it, it must never be modified in place
+int cache_link(const char *, const char *, const char *);
+
+// trim the cache down to its size limit, safe while other builds use it
+int cache_evict(void);
+
+#endif // CACHE_H
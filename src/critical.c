@@ -0,0 +1,431 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "buf.h"
+#include "critical.h"
+#include "error.h"
+#include "hash.h"
+
+#define _SITE_CRITICAL_NAME_MAX 128
+
+typedef struct {
+        char key[_SITE_HASH_HEX_SIZE];
+        char *css;
+} critical_entry;
+
+// filtered stylesheets shared by pages with the same feature set
+static struct {
+        critical_entry *entries;
+        int len;
+        int capacity;
+} critical_cache = {0};
+
+static int __critical_add(critical_features *features, char kind, const char *name, size_t len) {
+        if (len == 0 || len >= _SITE_CRITICAL_NAME_MAX) return 0;
+
+        if (features->elems == NULL) {
+                features->elems = malloc(sizeof(char *) * 64);
+                features->capacity = 64;
+        } else if (features->capacity == features->len) {
+                features->capacity *= 2;
+                features->elems = realloc(features->elems, features->capacity * sizeof(char *));
+        }
+        if (features->elems == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                return -1;
+        }
+
+        char *elem = malloc(len + 3);
+        if (elem == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                return -1;
+        }
+        elem[0] = kind;
+        elem[1] = ':';
+        for (size_t i = 0; i < len; i++) {
+                // tag names are case-insensitive
+                elem[i + 2] = kind == 't' ? (char)tolower((unsigned char)name[i]) : name[i];
+        }
+        elem[len + 2] = '\0';
+
+        features->elems[features->len++] = elem;
+
+        return 0;
+}
+
+static bool __critical_is_name(char c) {
+        return isalnum((unsigned char)c) || c == '-' || c == '_' || (unsigned char)c >= 0x80;
+}
+
+// record classes and ids of a single attribute
+static int __critical_collect_attr(critical_features *features, const char *name, size_t name_len,
+                                   const char *value, size_t value_len) {
+        if (name_len == 2 && strncasecmp(name, "id", 2) == 0) {
+                return __critical_add(features, 'i', value, value_len);
+        }
+        if (name_len != 5 || strncasecmp(name, "class", 5) != 0) return 0;
+
+        size_t i = 0;
+        while (i < value_len) {
+                while (i < value_len && isspace((unsigned char)value[i])) {
+                        i++;
+                }
+                size_t start = i;
+                while (i < value_len && !isspace((unsigned char)value[i])) {
+                        i++;
+                }
+                if (__critical_add(features, 'c', value + start, i - start) != 0) return -1;
+        }
+
+        return 0;
+}
+
+int critical_collect(critical_features *features, const char *html) {
+        const char *pos = html;
+
+        while ((pos = strchr(pos, '<')) != NULL) {
+                pos++;
+
+                if (strncmp(pos, "!--", 3) == 0) {
+                        const char *end = strstr(pos, "-->");
+                        if (end == NULL) break;
+                        pos = end + 3;
+                        continue;
+                }
+                if (!isalpha((unsigned char)*pos)) continue;
+
+                const char *tag = pos;
+                while (__critical_is_name(*pos)) {
+                        pos++;
+                }
+                size_t tag_len = (size_t)(pos - tag);
+                if (__critical_add(features, 't', tag, tag_len) != 0) return -1;
+
+                // attributes
+                while (*pos && *pos != '>') {
+                        while (isspace((unsigned char)*pos) || *pos == '/') {
+                                pos++;
+                        }
+
+                        const char *name = pos;
+                        while (*pos && !isspace((unsigned char)*pos) && !strchr("=>/", *pos)) {
+                                pos++;
+                        }
+                        size_t name_len = (size_t)(pos - name);
+                        if (*pos != '=') {
+                                if (name_len == 0 && *pos && *pos != '>') pos++;
+                                continue;
+                        }
+
+                        pos++;
+                        const char *value = pos;
+                        size_t value_len = 0;
+                        if (*pos == '"' || *pos == '\'') {
+                                const char *end = strchr(pos + 1, *pos);
+                                if (end == NULL) return 0;
+                                value = pos + 1;
+                                value_len = (size_t)(end - value);
+                                pos = end + 1;
+                        } else {
+                                while (*pos && !isspace((unsigned char)*pos) && *pos != '>') {
+                                        pos++;
+                                }
+                                value_len = (size_t)(pos - value);
+                        }
+
+                        if (__critical_collect_attr(features, name, name_len, value, value_len) !=
+                            0) {
+                                return -1;
+                        }
+                }
+
+                // raw text elements contain no markup
+                if ((tag_len == 6 && strncasecmp(tag, "script", 6) == 0) ||
+                    (tag_len == 5 && strncasecmp(tag, "style", 5) == 0)) {
+                        const char *end = strstr(pos, tag_len == 6 ? "</script" : "</style");
+                        if (end == NULL) break;
+                        pos = end;
+                }
+        }
+
+        return 0;
+}
+
+void critical_features_free(critical_features *features) {
+        for (int i = 0; i < features->len; i++) {
+                free(features->elems[i]);
+        }
+        free(features->elems);
+        features->elems = NULL;
+        features->len = 0;
+        features->capacity = 0;
+}
+
+static int __critical_cmp(const void *a, const void *b) {
+        return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static bool __critical_has(critical_features *features, char kind, const char *name, size_t len) {
+        char elem[_SITE_CRITICAL_NAME_MAX + 3];
+        if (len >= _SITE_CRITICAL_NAME_MAX) return true;
+
+        elem[0] = kind;
+        elem[1] = ':';
+        for (size_t i = 0; i < len; i++) {
+                elem[i + 2] = kind == 't' ? (char)tolower((unsigned char)name[i]) : name[i];
+        }
+        elem[len + 2] = '\0';
+
+        char *key = elem;
+        return bsearch(&key, features->elems, features->len, sizeof(char *), __critical_cmp) !=
+               NULL;
+}
+
+static const char *__critical_skip_parens(const char *pos, const char *end) {
+        int depth = 0;
+        for (; pos < end; pos++) {
+                if (*pos == '(') depth++;
+                if (*pos == ')' && --depth == 0) return pos + 1;
+        }
+        return end;
+}
+
+// conservative: every tag, class and id of the selector must occur somewhere in the page
+static bool __critical_selector_matches(critical_features *features, const char *pos,
+                                        const char *end) {
+        bool compound_start = true;
+
+        while (pos < end) {
+                char c = *pos;
+
+                if (isspace((unsigned char)c) || c == '>' || c == '+' || c == '~') {
+                        compound_start = true;
+                        pos++;
+                        continue;
+                }
+
+                if (c == '*') {
+                        pos++;
+                } else if (c == '[') {
+                        const char *close = memchr(pos, ']', (size_t)(end - pos));
+                        pos = close ? close + 1 : end;
+                } else if (c == ':') {
+                        // pseudo-classes and -elements never rule out a match
+                        while (pos < end && *pos == ':') {
+                                pos++;
+                        }
+                        while (pos < end && __critical_is_name(*pos)) {
+                                pos++;
+                        }
+                        if (pos < end && *pos == '(') pos = __critical_skip_parens(pos, end);
+                } else if (c == '.' || c == '#') {
+                        const char *name = ++pos;
+                        while (pos < end && (__critical_is_name(*pos) || *pos == '\\')) {
+                                pos++;
+                        }
+                        char kind = c == '.' ? 'c' : 'i';
+                        if (!__critical_has(features, kind, name, (size_t)(pos - name))) {
+                                return false;
+                        }
+                } else if (compound_start && __critical_is_name(c)) {
+                        const char *name = pos;
+                        while (pos < end && __critical_is_name(*pos)) {
+                                pos++;
+                        }
+                        if (!__critical_has(features, 't', name, (size_t)(pos - name))) {
+                                return false;
+                        }
+                } else {
+                        pos++;
+                }
+
+                compound_start = false;
+        }
+
+        return true;
+}
+
+static bool __critical_rule_matches(critical_features *features, const char *pos,
+                                    const char *end) {
+        const char *start = pos;
+        int depth = 0;
+
+        // split the selector list, ignoring commas inside of functional pseudo-classes
+        for (; pos <= end; pos++) {
+                if (pos < end && *pos == '(') depth++;
+                if (pos < end && *pos == ')') depth--;
+                if (pos < end && (*pos != ',' || depth > 0)) continue;
+
+                if (__critical_selector_matches(features, start, pos)) return true;
+                start = pos + 1;
+        }
+
+        return false;
+}
+
+// find the next '{', ';' or the closing '}' of the current block, skipping strings and comments
+static const char *__critical_next(const char *pos, const char *end, const char *stops) {
+        while (pos < end) {
+                if (*pos == '/' && pos + 1 < end && pos[1] == '*') {
+                        const char *close = strstr(pos + 2, "*/");
+                        pos = close && close < end ? close + 2 : end;
+                        continue;
+                }
+                if (*pos == '"' || *pos == '\'') {
+                        char quote = *pos++;
+                        while (pos < end && *pos != quote) {
+                                if (*pos == '\\') pos++;
+                                pos++;
+                        }
+                        pos++;
+                        continue;
+                }
+                if (strchr(stops, *pos)) return pos;
+                pos++;
+        }
+        return end;
+}
+
+static const char *__critical_block_end(const char *pos, const char *end) {
+        int depth = 0;
+        while ((pos = __critical_next(pos, end, "{}")) < end) {
+                if (*pos == '{') depth++;
+                else if (--depth == 0) return pos;
+                pos++;
+        }
+        return end;
+}
+
+static bool __critical_is_group_rule(const char *prelude) {
+        return strncasecmp(prelude, "@media", 6) == 0 ||
+               strncasecmp(prelude, "@supports", 9) == 0 ||
+               strncasecmp(prelude, "@layer", 6) == 0 ||
+               strncasecmp(prelude, "@container", 10) == 0;
+}
+
+static int __critical_filter(critical_features *features, const char *pos, const char *end,
+                             text_buf *out) {
+        while (pos < end) {
+                // skip whitespace and comments between rules
+                if (isspace((unsigned char)*pos)) {
+                        pos++;
+                        continue;
+                }
+                if (*pos == '/' && pos + 1 < end && pos[1] == '*') {
+                        const char *close = strstr(pos + 2, "*/");
+                        pos = close && close < end ? close + 2 : end;
+                        continue;
+                }
+
+                const char *start = pos;
+                const char *stop = __critical_next(pos, end, "{;");
+                if (stop == end) break;
+
+                // statement at-rules such as @import are always kept
+                if (*stop == ';') {
+                        if (*start == '@' && buf_append(out, start, (size_t)(stop - start) + 1))
+                                return -1;
+                        pos = stop + 1;
+                        continue;
+                }
+
+                const char *close = __critical_block_end(stop, end);
+                pos = close < end ? close + 1 : end;
+
+                if (*start == '@' && __critical_is_group_rule(start)) {
+                        text_buf inner = {0};
+                        if (__critical_filter(features, stop + 1, close, &inner) != 0) {
+                                buf_free(&inner);
+                                return -1;
+                        }
+                        if (inner.len > 0) {
+                                buf_append(out, start, (size_t)(stop - start) + 1);
+                                buf_append(out, inner.data, inner.len);
+                                buf_append(out, "}", 1);
+                        }
+                        buf_free(&inner);
+                        continue;
+                }
+
+                // other at-rules (@font-face, @keyframes, ...) are kept as a whole
+                if (*start == '@' || __critical_rule_matches(features, start, stop)) {
+                        if (buf_append(out, start, (size_t)(pos - start)) != 0) return -1;
+                }
+        }
+
+        return 0;
+}
+
+const char *critical_css(const asset *sheet, critical_features *features) {
+        if (sheet->content == NULL) return NULL;
+
+        // sort and deduplicate to make feature sets comparable
+        qsort(features->elems, features->len, sizeof(char *), __critical_cmp);
+        int len = 0;
+        for (int i = 0; i < features->len; i++) {
+                if (len > 0 && strcmp(features->elems[len - 1], features->elems[i]) == 0) {
+                        free(features->elems[i]);
+                        continue;
+                }
+                features->elems[len++] = features->elems[i];
+        }
+        features->len = len;
+
+        hash_ctx ctx;
+        unsigned char digest[_SITE_HASH_SIZE];
+        char key[_SITE_HASH_HEX_SIZE];
+
+        hash_init(&ctx);
+        hash_update(&ctx, sheet->hash, sizeof(sheet->hash));
+        for (int i = 0; i < features->len; i++) {
+                hash_update(&ctx, features->elems[i], strlen(features->elems[i]) + 1);
+        }
+        hash_final(&ctx, digest);
+        hash_to_hex(digest, key);
+
+        for (int i = 0; i < critical_cache.len; i++) {
+                if (strcmp(critical_cache.entries[i].key, key) == 0) {
+                        return critical_cache.entries[i].css;
+                }
+        }
+
+        text_buf out = {0};
+        if (__critical_filter(features, sheet->content, sheet->content + sheet->len, &out) != 0) {
+                buf_free(&out);
+                return NULL;
+        }
+
+        if (critical_cache.entries == NULL) {
+                critical_cache.entries = malloc(sizeof(critical_entry) * 16);
+                critical_cache.capacity = 16;
+        } else if (critical_cache.capacity == critical_cache.len) {
+                critical_cache.capacity *= 2;
+                critical_cache.entries = realloc(critical_cache.entries,
+                                                 critical_cache.capacity * sizeof(critical_entry));
+        }
+        if (critical_cache.entries == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                buf_free(&out);
+                return NULL;
+        }
+
+        critical_entry *entry = &critical_cache.entries[critical_cache.len++];
+        memcpy(entry->key, key, sizeof(key));
+        entry->css = buf_detach(&out);
+
+        return entry->css;
+}
+
+void critical_cleanup(void) {
+        for (int i = 0; i < critical_cache.len; i++) {
+                free(critical_cache.entries[i].css);
+        }
+        free(critical_cache.entries);
+        critical_cache.entries = NULL;
+        critical_cache.len = 0;
+        critical_cache.capacity = 0;
+}
@@ -0,0 +1,21 @@
+#ifndef CRITICAL_H
+#define CRITICAL_H
+
+#include "asset.h"
+
+// tag names, classes and ids occurring in a page
+typedef struct {
+        char **elems;
+        int len;
+        int capacity;
+} critical_features;
+
+// collect the features of generated markup, may be called repeatedly
+int critical_collect(critical_features *, const char *);
+void critical_features_free(critical_features *);
+
+// rules of a stylesheet which may apply to the collected features
+const char *critical_css(const asset *, critical_features *);
+void critical_cleanup(void);
+
+#endif // CRITICAL_H
@@ -0,0 +1,20 @@
+#ifndef EMBED_H
+#define EMBED_H
+
+#include <stddef.h>
+
+#include "template.h"
+
+// template and block files compiled into the binary by tools/embed.c
+typedef struct {
+        const char *name;
+        const char *content;
+        size_t len;
+        const template_segment *segments;
+        int segments_len;
+} embedded_block;
+
+extern const embedded_block embedded_blocks[];
+extern const int embedded_blocks_len;
+
+#endif // EMBED_H
@@ -25,6 +25,22 @@ const char *get_error_format(site_error_t error) {
 	case SITE_ERROR_EMPTY_CONTENT:		return "Page has no content. Aborting.";
 	case SITE_ERROR_NO_PAGES_FOUND:		return "No pages to convert. Aborting";
 	
+	case SITE_ERROR_TEMPLATE_SLOT:		return "Unknown template slot {{%.*s}} in %s";
+	case SITE_ERROR_TEMPLATE_SIZE:		return "Too many template segments in %s";
+	
+	case SITE_ERROR_ASSET_MISSING:		return "Reference to %.*s, which is not an asset";
+	case SITE_ERROR_PATH_LENGTH:		return "Path of %s is longer than %d bytes";
+	
+	case SITE_ERROR_FONT_FORMAT:		return "Unsupported or malformed font %s";
+	
+	case SITE_ERROR_PUBLISH_LINK:		return "Failed to link %s";
+	case SITE_ERROR_PUBLISH_SWAP:		return "Failed to switch %s to the new generation";
+	case SITE_ERROR_PUBLISH_PRUNE:		return "Failed to remove generation %s";
+	case SITE_ERROR_PUBLISH_TARGET:		return "%s is a directory, move it aside once to publish generations";
+	
+	case SITE_ERROR_SITE_CONFIG:		return "Invalid site config %s, line %d";
+	case SITE_ERROR_SITE_BUILD:		return "Failed to build site %s";
+	
 	case SITE_ERROR_GIT_OPERATION:		return "Git operation failed";
 	default:				return "Unknown error";
         }
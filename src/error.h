@@ -29,6 +29,27 @@ typedef enum {
         SITE_ERROR_EMPTY_CONTENT,
         SITE_ERROR_NO_PAGES_FOUND,
 
+        // templates
+        SITE_ERROR_TEMPLATE_SLOT,
+        SITE_ERROR_TEMPLATE_SIZE,
+
+        // assets
+        SITE_ERROR_ASSET_MISSING,
+        SITE_ERROR_PATH_LENGTH,
+
+        // fonts
+        SITE_ERROR_FONT_FORMAT,
+
+        // publishing
+        SITE_ERROR_PUBLISH_LINK,
+        SITE_ERROR_PUBLISH_SWAP,
+        SITE_ERROR_PUBLISH_PRUNE,
+        SITE_ERROR_PUBLISH_TARGET,
+
+        // sites
+        SITE_ERROR_SITE_CONFIG,
+        SITE_ERROR_SITE_BUILD,
+
         // Git operations
         SITE_ERROR_GIT_OPERATION
 } site_error_t;
@@ -1,22 +1,37 @@
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "buf.h"
 #include "error.h"
 #include "feed.h"
 #include "ghist.h"
 #include "html.h"
+#include "minify.h"
+#include "output.h"
 
-int create_feed(char *output_path, page_header_arr *header_arr) {
+// the feed embeds the same markup as the pages
+static int __feed_minify(const char *content, text_buf *out) {
+        minify_html_state st = {0};
+        int res = minify_html(&st, content, strlen(content), out);
 
-        int res = 0;
+        if (minify_html_end(&st, out) != 0) res = -1;
+        if (res == 0) res = buf_puts(out, "\n");
 
-        FILE *dest_file = NULL;
-        if ((dest_file = fopen(output_path, "w")) == NULL) {
-                ERRORF(SITE_ERROR_FILE_CREATE, output_path)
-                return -1;
-        }
+        return res;
+}
+
+int create_feed(char *output_name, page_header_arr *header_arr) {
+
+        int res = -1;
+
+        // rendered in memory so an unchanged feed is left alone
+        text_buf feed = {0};
 
-        char feed_uri[] = _SITE_URL "/feed.atom";
+        char site_url[_SITE_CONFIG_VALUE_MAX + 8];
+        char feed_uri[_SITE_CONFIG_VALUE_MAX + 32];
+        snprintf(site_url, sizeof(site_url), "https://%s", site.host);
+        snprintf(feed_uri, sizeof(feed_uri), "%s/feed.atom", site_url);
 
         // make feed updated date RFC-3339 compliant
         size_t feed_modified_size = 256;
@@ -24,21 +39,25 @@ int create_feed(char *output_path, page_header_arr *header_arr) {
         ghist_format_ts("%Y-%m-%dT00:00:00Z", feed_modified,
                         header_arr->elems[header_arr->len - 1]->meta.modified);
 
-        res = fprintf(dest_file,
-                      "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
-                      "<feed xmlns=\"http://www.w3.org/2005/Atom\">\n"
-                      "    <title>%s</title>\n"
-                      "    <link href=\"%s\" rel=\"alternate\"/>\n"
-                      "    <link href=\"%s\" rel=\"self\"/>\n"
-                      "    <updated>%s</updated>\n"
-                      "    <author>\n"
-                      "        <name>%s</name>\n"
-                      "    </author>\n",
-                      _SITE_TITLE, _SITE_URL, feed_uri, feed_modified, _SITE_AUTHOR);
+        if (buf_printf(&feed,
+                       "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                       "<feed xmlns=\"http://www.w3.org/2005/Atom\">\n"
+                       "    <title>%s</title>\n"
+                       "    <link href=\"%s\" rel=\"alternate\"/>\n"
+                       "    <link href=\"%s\" rel=\"self\"/>\n"
+                       "    <updated>%s</updated>\n"
+                       "    <author>\n"
+                       "        <name>%s</name>\n"
+                       "    </author>\n",
+                       site.title, site_url, feed_uri, feed_modified, site.author) != 0) {
+                goto cleanup;
+        }
 
         // use date-only format for TAG URI
-        res = fprintf(dest_file, "    <id>tag:www.%s,%s:%s</id>\n", _SITE_HOST,
-                      _SITE_TAG_SCHEME_DATE, _SITE_FEED_ID);
+        if (buf_printf(&feed, "    <id>tag:www.%s,%s:%s</id>\n", site.host, site.tag_date,
+                       site.feed_id) != 0) {
+                goto cleanup;
+        }
 
         for (int i = 0; i < header_arr->len; i++) {
                 page_header header = *header_arr->elems[i];
@@ -47,36 +66,60 @@ int create_feed(char *output_path, page_header_arr *header_arr) {
                 char created_formatted[created_formatted_size];
                 ghist_format_ts("%Y-%m-%dT00:00:00Z", created_formatted, header.meta.created);
 
+                // never modified since it was created
                 char modified_formatted[256];
-                if (header.meta.modified) {
-                        ghist_format_ts("%Y-%m-%dT00:00:00Z", modified_formatted,
-                                        header.meta.modified);
+                ghist_format_ts("%Y-%m-%dT00:00:00Z", modified_formatted,
+                                header.meta.modified ? header.meta.modified
+                                                     : header.meta.created);
+
+                // the index has sorted the headers, the content is still in render order
+                int idx = 0;
+                while (idx < content_arr.len &&
+                       strcmp(content_arr.elems[idx]->meta.path, header.meta.path) != 0) {
+                        idx++;
                 }
-
-                int idx = -1;
-                while (++idx) {
-                        if (content_arr.elems[idx]->meta.path == header.meta.path) break;
+                if (idx == content_arr.len) continue;
+
+                const char *content = content_arr.elems[idx]->content;
+                text_buf minified = {0};
+                if (_SITE_EXT_MINIFY_HTML) {
+                        if (__feed_minify(content, &minified) != 0) {
+                                buf_free(&minified);
+                                goto cleanup;
+                        }
+                        content = minified.data;
                 }
 
-                char *escaped_content = html_escape_content(content_arr.elems[i]->content);
-
-                res = fprintf(dest_file,
-                              "    <entry>\n"
-                              "        <title>%s</title>\n"
-                              "        <content type=\"html\">\n"
-                              "%s"
-                              "        </content>\n"
-                              "        <link href=\"%s\"/>\n"
-                              "        <id>tag:www.%s,%s:%s</id>\n"
-                              "        <published>%s</published>\n"
-                              "        <updated>%s</updated>\n"
-                              "    </entry>\n",
-                              header.title, escaped_content, header.meta.path, _SITE_HOST,
-                              _SITE_TAG_SCHEME_DATE, header.meta.path, created_formatted,
-                              modified_formatted);
+                char *escaped_content = html_escape_content(content);
+                buf_free(&minified);
+                if (escaped_content == NULL) goto cleanup;
+
+                int entry_res = buf_printf(&feed,
+                                           "    <entry>\n"
+                                           "        <title>%s</title>\n"
+                                           "        <content type=\"html\">\n"
+                                           "%s"
+                                           "        </content>\n"
+                                           "        <link href=\"%s\"/>\n"
+                                           "        <id>tag:www.%s,%s:%s</id>\n"
+                                           "        <published>%s</published>\n"
+                                           "        <updated>%s</updated>\n"
+                                           "    </entry>\n",
+                                           header.title, escaped_content, header.meta.path,
+                                           site.host, site.tag_date, header.meta.path,
+                                           created_formatted, modified_formatted);
+                free(escaped_content);
+                if (entry_res != 0) goto cleanup;
         }
 
-        res = fprintf(dest_file, "</feed>\n");
+        if (buf_puts(&feed, "</feed>\n") != 0) goto cleanup;
+
+        output_meta meta = {.modified = html_last_modified(header_arr),
+                            .tier = OUTPUT_CACHE_REVALIDATE};
+        res = output_write(output_name, &meta, feed.data, feed.len);
+
+cleanup:
+        buf_free(&feed);
 
         return res;
 }
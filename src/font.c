@@ -0,0 +1,1068 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include "asset.h"
+#include "buf.h"
+#include "cache.h"
+#include "error.h"
+#include "font.h"
+#include "hash.h"
+#include "html.h"
+#include "prerender.h"
+#include "site.h"
+
+#define _SITE_FONT_CODE_POINTS 0x110000
+
+char *font_head = NULL;
+
+// code points used by the site, one bit each
+static unsigned char *font_used = NULL;
+
+// a table of the source font or one replaced while subsetting
+typedef struct {
+        uint32_t tag;
+        const unsigned char *data;
+        uint32_t len;
+        unsigned char *owned;
+} font_table;
+
+typedef struct {
+        uint32_t flavor;
+        font_table tables[_SITE_FONT_TABLES_MAX];
+        int len;
+} font_file;
+
+typedef struct {
+        uint32_t code_point;
+        uint32_t glyph;
+} font_mapping;
+
+typedef struct {
+        font_mapping *elems;
+        int len;
+        int capacity;
+} font_mapping_arr;
+
+// named references likely to show up in text, others only keep the ASCII of their name
+static const struct {
+        const char *name;
+        uint32_t code_point;
+} font_entities[] = {
+    {"amp", '&'},       {"lt", '<'},        {"gt", '>'},         {"quot", '"'},
+    {"apos", '\''},     {"nbsp", 0xa0},     {"shy", 0xad},       {"copy", 0xa9},
+    {"reg", 0xae},      {"deg", 0xb0},      {"middot", 0xb7},    {"times", 0xd7},
+    {"ndash", 0x2013},  {"mdash", 0x2014},  {"lsquo", 0x2018},   {"rsquo", 0x2019},
+    {"ldquo", 0x201c},  {"rdquo", 0x201d},  {"bull", 0x2022},    {"hellip", 0x2026},
+    {"larr", 0x2190},   {"rarr", 0x2192},   {"euro", 0x20ac},    {"trade", 0x2122},
+};
+
+// tables referring to glyphs that may be emptied, or of no use to browsers
+static const char *font_dropped[] = {"GSUB", "morx", "mort", "COLR", "CPAL", "SVG ",
+                                     "DSIG", "hdmx", "LTSH", "VDMX"};
+
+static uint32_t __font_be16(const unsigned char *p) { return (uint32_t)p[0] << 8 | p[1]; }
+
+static uint32_t __font_be32(const unsigned char *p) {
+        return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void __font_put16(unsigned char *p, uint32_t value) {
+        p[0] = (unsigned char)(value >> 8);
+        p[1] = (unsigned char)value;
+}
+
+static void __font_put32(unsigned char *p, uint32_t value) {
+        p[0] = (unsigned char)(value >> 24);
+        p[1] = (unsigned char)(value >> 16);
+        p[2] = (unsigned char)(value >> 8);
+        p[3] = (unsigned char)value;
+}
+
+static uint32_t __font_tag(const char *tag) { return __font_be32((const unsigned char *)tag); }
+
+static uint32_t __font_pad(uint32_t len) { return (len + 3) & ~(uint32_t)3; }
+
+static void __font_use(uint32_t code_point) {
+        if (code_point < _SITE_FONT_CODE_POINTS) {
+                font_used[code_point >> 3] |= (unsigned char)(1 << (code_point & 7));
+        }
+}
+
+static bool __font_is_used(uint32_t code_point) {
+        return code_point < _SITE_FONT_CODE_POINTS &&
+               (font_used[code_point >> 3] & (1 << (code_point & 7)));
+}
+
+// decode one UTF-8 sequence, 0 for invalid ones
+static uint32_t __font_utf8(const unsigned char **pos) {
+        const unsigned char *p = *pos;
+        int extra = p[0] >= 0xf0 ? 3 : p[0] >= 0xe0 ? 2 : p[0] >= 0xc0 ? 1 : 0;
+        uint32_t code_point = extra ? p[0] & (0x3f >> extra) : p[0];
+
+        *pos += 1;
+        if (p[0] >= 0x80 && extra == 0) return 0;
+        for (int i = 1; i <= extra; i++) {
+                if ((p[i] & 0xc0) != 0x80) return 0;
+                code_point = code_point << 6 | (p[i] & 0x3f);
+                *pos += 1;
+        }
+
+        return code_point;
+}
+
+// decode a character reference, 0 if there is none
+static uint32_t __font_entity(const unsigned char **pos) {
+        const char *start = (const char *)*pos + 1;
+        const char *end = strchr(start, ';');
+        if (end == NULL || end - start > 16 || end == start) return 0;
+
+        uint32_t code_point = 0;
+        if (*start == '#') {
+                char *number_end = NULL;
+                bool hex = start[1] == 'x' || start[1] == 'X';
+                unsigned long value = strtoul(start + (hex ? 2 : 1), &number_end, hex ? 16 : 10);
+                if (number_end != end || value >= _SITE_FONT_CODE_POINTS) return 0;
+                code_point = (uint32_t)value;
+        } else {
+                for (size_t i = 0; i < sizeof(font_entities) / sizeof(font_entities[0]); i++) {
+                        if (strlen(font_entities[i].name) == (size_t)(end - start) &&
+                            strncmp(font_entities[i].name, start, end - start) == 0) {
+                                code_point = font_entities[i].code_point;
+                        }
+                }
+                if (code_point == 0) return 0;
+        }
+
+        *pos = (const unsigned char *)end + 1;
+        return code_point;
+}
+
+// mark the characters of text outside of tags and comments
+static void __font_collect(const char *text) {
+        const unsigned char *pos = (const unsigned char *)text;
+        while (*pos) {
+                if (*pos == '<' && strncmp((const char *)pos, "<!--", 4) == 0) {
+                        const char *end = strstr((const char *)pos + 4, "-->");
+                        if (end == NULL) return;
+                        pos = (const unsigned char *)end + 3;
+                        continue;
+                }
+                if (*pos == '<' && (isalpha(pos[1]) || pos[1] == '/' || pos[1] == '!')) {
+                        const char *end = strchr((const char *)pos, '>');
+                        if (end == NULL) return;
+                        pos = (const unsigned char *)end + 1;
+                        continue;
+                }
+
+                uint32_t code_point = 0;
+                if (*pos == '&') code_point = __font_entity(&pos);
+                if (code_point == 0) code_point = __font_utf8(&pos);
+                if (code_point != 0) __font_use(code_point);
+        }
+}
+
+static int __font_load(const char *name, const unsigned char *data, size_t len, font_file *font) {
+        if (len < 12) goto error;
+
+        font->flavor = __font_be32(data);
+        if (font->flavor != 0x00010000 && font->flavor != __font_tag("true") &&
+            font->flavor != __font_tag("OTTO")) {
+                goto error;
+        }
+
+        font->len = (int)__font_be16(data + 4);
+        if (font->len > _SITE_FONT_TABLES_MAX || 12 + 16 * (size_t)font->len > len) goto error;
+
+        for (int i = 0; i < font->len; i++) {
+                const unsigned char *record = data + 12 + 16 * i;
+                uint32_t offset = __font_be32(record + 8);
+                uint32_t table_len = __font_be32(record + 12);
+                if ((uint64_t)offset + table_len > len) goto error;
+
+                font->tables[i] = (font_table){
+                    .tag = __font_be32(record),
+                    .data = data + offset,
+                    .len = table_len,
+                };
+        }
+
+        return 0;
+
+error:
+        ERRORF(SITE_ERROR_FONT_FORMAT, name);
+        return -1;
+}
+
+static void __font_free(font_file *font) {
+        for (int i = 0; i < font->len; i++) {
+                free(font->tables[i].owned);
+        }
+}
+
+static font_table *__font_find(font_file *font, const char *tag) {
+        for (int i = 0; i < font->len; i++) {
+                if (font->tables[i].tag == __font_tag(tag)) return &font->tables[i];
+        }
+        return NULL;
+}
+
+// take ownership of a new table content
+static void __font_replace(font_table *table, unsigned char *data, uint32_t len) {
+        free(table->owned);
+        table->owned = data;
+        table->data = data;
+        table->len = len;
+}
+
+static void __font_drop(font_file *font, const char *tag) {
+        font_table *table = __font_find(font, tag);
+        if (table == NULL) return;
+
+        free(table->owned);
+        *table = font->tables[--font->len];
+}
+
+static int __font_map_add(font_mapping_arr *mappings, uint32_t code_point, uint32_t glyph) {
+        if (mappings->len == mappings->capacity) {
+                int capacity = mappings->capacity ? mappings->capacity * 2 : 256;
+                font_mapping *elems = realloc(mappings->elems, capacity * sizeof(font_mapping));
+                if (elems == NULL) {
+                        ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                        return -1;
+                }
+                mappings->elems = elems;
+                mappings->capacity = capacity;
+        }
+
+        mappings->elems[mappings->len++] = (font_mapping){code_point, glyph};
+        return 0;
+}
+
+static int __font_mapping_cmp(const void *a, const void *b) {
+        uint32_t code_point_a = ((const font_mapping *)a)->code_point;
+        uint32_t code_point_b = ((const font_mapping *)b)->code_point;
+        return code_point_a < code_point_b ? -1 : code_point_a > code_point_b;
+}
+
+// the best Unicode subtable of the cmap, format 12 covers more than the BMP
+static const unsigned char *__font_cmap_subtable(const font_table *cmap, uint32_t *len) {
+        const unsigned char *best = NULL;
+        int best_score = 0;
+
+        if (cmap->len < 4) return NULL;
+        uint32_t count = __font_be16(cmap->data + 2);
+        if (4 + 8 * (uint64_t)count > cmap->len) return NULL;
+
+        for (uint32_t i = 0; i < count; i++) {
+                const unsigned char *record = cmap->data + 4 + 8 * i;
+                uint32_t platform = __font_be16(record);
+                uint32_t encoding = __font_be16(record + 2);
+                uint32_t offset = __font_be32(record + 4);
+                if ((uint64_t)offset + 8 > cmap->len) continue;
+
+                const unsigned char *subtable = cmap->data + offset;
+                uint32_t format = __font_be16(subtable);
+                uint32_t subtable_len = format == 12   ? __font_be32(subtable + 4)
+                                        : format == 4 ? __font_be16(subtable + 2)
+                                                      : 0;
+                if ((uint64_t)offset + subtable_len > cmap->len) continue;
+
+                int score = 0;
+                if (format == 12 && (platform == 0 || (platform == 3 && encoding == 10))) {
+                        score = 2;
+                } else if (format == 4 && (platform == 0 || (platform == 3 && encoding == 1))) {
+                        score = 1;
+                }
+                if (score > best_score) {
+                        best = subtable;
+                        best_score = score;
+                        *len = subtable_len;
+                }
+        }
+
+        return best;
+}
+
+// the glyphs of the used code points, in code point order
+static int __font_map(font_file *font, uint32_t glyphs, font_mapping_arr *mappings) {
+        font_table *cmap = __font_find(font, "cmap");
+        uint32_t len = 0;
+        const unsigned char *subtable = cmap ? __font_cmap_subtable(cmap, &len) : NULL;
+        if (subtable == NULL) return 1;
+
+        if (__font_be16(subtable) == 12) {
+                if (len < 16) return 1;
+                uint32_t groups = __font_be32(subtable + 12);
+                if (16 + 12 * (uint64_t)groups > len) return 1;
+
+                for (uint32_t i = 0; i < groups; i++) {
+                        const unsigned char *group = subtable + 16 + 12 * i;
+                        uint32_t start = __font_be32(group);
+                        uint32_t end = __font_be32(group + 4);
+                        uint32_t glyph = __font_be32(group + 8);
+                        if (end >= _SITE_FONT_CODE_POINTS) end = _SITE_FONT_CODE_POINTS - 1;
+
+                        for (uint32_t c = start; c <= end; c++) {
+                                if (!__font_is_used(c) || glyph + (c - start) >= glyphs) continue;
+                                if (__font_map_add(mappings, c, glyph + (c - start)) != 0) {
+                                        return -1;
+                                }
+                        }
+                }
+        } else {
+                if (len < 14) return 1;
+                uint32_t segments_x2 = __font_be16(subtable + 6);
+                if (16 + 4 * (uint64_t)segments_x2 > len) return 1;
+
+                const unsigned char *ends = subtable + 14;
+                const unsigned char *starts = ends + segments_x2 + 2;
+                const unsigned char *deltas = starts + segments_x2;
+                const unsigned char *range_offsets = deltas + segments_x2;
+
+                for (uint32_t i = 0; i < segments_x2; i += 2) {
+                        uint32_t start = __font_be16(starts + i);
+                        uint32_t end = __font_be16(ends + i);
+                        uint32_t delta = __font_be16(deltas + i);
+                        uint32_t range_offset = __font_be16(range_offsets + i);
+
+                        for (uint32_t c = start; c <= end && c < 0xffff; c++) {
+                                if (!__font_is_used(c)) continue;
+
+                                uint32_t glyph = (c + delta) & 0xffff;
+                                if (range_offset != 0) {
+                                        const unsigned char *entry =
+                                            range_offsets + i + range_offset + 2 * (c - start);
+                                        if (entry + 2 > subtable + len) continue;
+                                        glyph = __font_be16(entry);
+                                        if (glyph != 0) glyph = (glyph + delta) & 0xffff;
+                                }
+                                if (glyph == 0 || glyph >= glyphs) continue;
+                                if (__font_map_add(mappings, c, glyph) != 0) return -1;
+                        }
+                }
+        }
+
+        qsort(mappings->elems, mappings->len, sizeof(font_mapping), __font_mapping_cmp);
+        return 0;
+}
+
+// byte range of a glyph within the glyf table
+static bool __font_glyph(font_table *loca, font_table *glyf, bool long_offsets, uint32_t glyph,
+                         uint32_t *start, uint32_t *end) {
+        if (long_offsets) {
+                if ((glyph + 2) * 4 > loca->len) return false;
+                *start = __font_be32(loca->data + glyph * 4);
+                *end = __font_be32(loca->data + glyph * 4 + 4);
+        } else {
+                if ((glyph + 2) * 2 > loca->len) return false;
+                *start = __font_be16(loca->data + glyph * 2) * 2;
+                *end = __font_be16(loca->data + glyph * 2 + 2) * 2;
+        }
+
+        return *start <= *end && *end <= glyf->len;
+}
+
+// add the components of composite glyphs to the kept ones
+static int __font_close(font_table *loca, font_table *glyf, bool long_offsets, bool *kept,
+                        uint32_t glyphs) {
+        uint32_t *stack = NULL;
+        uint32_t stack_len = 0;
+        if ((stack = malloc(glyphs * sizeof(uint32_t))) == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                return -1;
+        }
+
+        for (uint32_t glyph = 0; glyph < glyphs; glyph++) {
+                if (kept[glyph]) stack[stack_len++] = glyph;
+        }
+
+        while (stack_len > 0) {
+                uint32_t start = 0;
+                uint32_t end = 0;
+                if (!__font_glyph(loca, glyf, long_offsets, stack[--stack_len], &start, &end) ||
+                    end - start < 10 || __font_be16(glyf->data + start) < 0x8000) {
+                        continue;
+                }
+
+                uint32_t flags = 0;
+                uint32_t pos = start + 10;
+                do {
+                        if (pos + 4 > end) break;
+                        flags = __font_be16(glyf->data + pos);
+                        uint32_t component = __font_be16(glyf->data + pos + 2);
+                        if (component < glyphs && !kept[component]) {
+                                kept[component] = true;
+                                stack[stack_len++] = component;
+                        }
+
+                        pos += 4 + (flags & 0x1 ? 4 : 2);
+                        pos += flags & 0x8 ? 2 : flags & 0x40 ? 4 : flags & 0x80 ? 8 : 0;
+                } while (flags & 0x20);
+        }
+
+        free(stack);
+        return 0;
+}
+
+// rebuild glyf and loca with all glyphs but the kept ones empty, ids stay the same
+static int __font_subset_glyf(font_file *font, font_table *head, const bool *kept,
+                              uint32_t glyphs) {
+        font_table *loca = __font_find(font, "loca");
+        font_table *glyf = __font_find(font, "glyf");
+        bool long_offsets = __font_be16(head->data + 50) == 1;
+        unsigned char *glyf_data = NULL;
+        unsigned char *loca_data = NULL;
+
+        uint32_t glyf_len = 0;
+        for (uint32_t glyph = 0; glyph < glyphs; glyph++) {
+                uint32_t start = 0;
+                uint32_t end = 0;
+                if (!__font_glyph(loca, glyf, long_offsets, glyph, &start, &end)) return 1;
+                if (kept[glyph]) glyf_len += __font_pad(end - start);
+        }
+
+        // short offsets count words
+        bool long_loca = glyf_len / 2 > 0xffff;
+        uint32_t loca_len = (glyphs + 1) * (long_loca ? 4 : 2);
+        if ((glyf_data = calloc(glyf_len ? glyf_len : 1, 1)) == NULL ||
+            (loca_data = malloc(loca_len)) == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                free(glyf_data);
+                return -1;
+        }
+
+        uint32_t offset = 0;
+        for (uint32_t glyph = 0; glyph <= glyphs; glyph++) {
+                if (long_loca) __font_put32(loca_data + glyph * 4, offset);
+                else __font_put16(loca_data + glyph * 2, offset / 2);
+                if (glyph == glyphs || !kept[glyph]) continue;
+
+                uint32_t start = 0;
+                uint32_t end = 0;
+                __font_glyph(loca, glyf, long_offsets, glyph, &start, &end);
+                memcpy(glyf_data + offset, glyf->data + start, end - start);
+                offset += __font_pad(end - start);
+        }
+
+        __font_replace(glyf, glyf_data, glyf_len);
+        __font_replace(loca, loca_data, loca_len);
+        __font_put16(head->owned + 50, long_loca ? 1 : 0);
+
+        return 0;
+}
+
+// drop the variations of glyphs no longer kept
+static int __font_subset_gvar(font_table *gvar, const bool *kept, uint32_t glyphs) {
+        if (gvar->len < 20 || __font_be16(gvar->data + 12) != glyphs) return 0;
+
+        const unsigned char *data = gvar->data;
+        bool long_offsets = __font_be16(data + 14) & 1;
+        uint32_t shared_len = __font_be16(data + 4) * __font_be16(data + 6) * 2;
+        uint32_t shared_offset = __font_be32(data + 8);
+        uint32_t array_offset = __font_be32(data + 16);
+        uint32_t offsets_len = (glyphs + 1) * (long_offsets ? 4 : 2);
+        if ((uint64_t)shared_offset + shared_len > gvar->len || 20 + offsets_len > gvar->len) {
+                return 0;
+        }
+
+        uint32_t starts[2];
+        uint32_t variations_len = 0;
+        for (uint32_t glyph = 0; glyph < glyphs; glyph++) {
+                for (uint32_t i = 0; i < 2; i++) {
+                        starts[i] = long_offsets ? __font_be32(data + 20 + (glyph + i) * 4)
+                                                 : __font_be16(data + 20 + (glyph + i) * 2) * 2;
+                }
+                if (starts[0] > starts[1] || (uint64_t)array_offset + starts[1] > gvar->len) {
+                        return 0;
+                }
+                if (kept[glyph]) variations_len += starts[1] - starts[0];
+        }
+
+        uint32_t new_offsets_len = (glyphs + 1) * 4;
+        uint32_t len = 20 + new_offsets_len + shared_len + variations_len;
+        unsigned char *out = NULL;
+        if ((out = malloc(len)) == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                return -1;
+        }
+
+        memcpy(out, data, 20);
+        __font_put32(out + 8, 20 + new_offsets_len);
+        __font_put16(out + 14, __font_be16(data + 14) | 1);
+        __font_put32(out + 16, 20 + new_offsets_len + shared_len);
+        memcpy(out + 20 + new_offsets_len, data + shared_offset, shared_len);
+
+        uint32_t offset = 0;
+        unsigned char *variations = out + 20 + new_offsets_len + shared_len;
+        for (uint32_t glyph = 0; glyph <= glyphs; glyph++) {
+                __font_put32(out + 20 + glyph * 4, offset);
+                if (glyph == glyphs || !kept[glyph]) continue;
+
+                for (uint32_t i = 0; i < 2; i++) {
+                        starts[i] = long_offsets ? __font_be32(data + 20 + (glyph + i) * 4)
+                                                 : __font_be16(data + 20 + (glyph + i) * 2) * 2;
+                }
+                memcpy(variations + offset, data + array_offset + starts[0],
+                       starts[1] - starts[0]);
+                offset += starts[1] - starts[0];
+        }
+
+        __font_replace(gvar, out, len);
+        return 0;
+}
+
+// a cmap with a format 4 subtable for the BMP and a format 12 one if anything lies beyond
+static int __font_subset_cmap(font_table *cmap, const font_mapping_arr *mappings) {
+        int segments = 1;
+        int groups = 0;
+        bool beyond_bmp = false;
+        for (int i = 0; i < mappings->len; i++) {
+                const font_mapping *mapping = &mappings->elems[i];
+                const font_mapping *previous = i > 0 ? &mappings->elems[i - 1] : NULL;
+                bool continued = previous && previous->code_point + 1 == mapping->code_point &&
+                                 previous->glyph + 1 == mapping->glyph;
+                if (mapping->code_point >= 0xffff) beyond_bmp = true;
+                else if (!continued) segments++;
+                if (!continued) groups++;
+        }
+
+        uint32_t format4_len = 16 + 8 * (uint32_t)segments;
+        uint32_t format12_len = beyond_bmp ? 16 + 12 * (uint32_t)groups : 0;
+        uint32_t header_len = beyond_bmp ? 20 : 12;
+        if (format4_len > 0xffff) return 1;
+
+        unsigned char *out = NULL;
+        uint32_t len = header_len + format4_len + format12_len;
+        if ((out = calloc(len, 1)) == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                return -1;
+        }
+
+        __font_put16(out + 2, beyond_bmp ? 2 : 1);
+        __font_put16(out + 4, 3);
+        __font_put16(out + 6, 1);
+        __font_put32(out + 8, header_len);
+        if (beyond_bmp) {
+                __font_put16(out + 12, 3);
+                __font_put16(out + 14, 10);
+                __font_put32(out + 16, header_len + format4_len);
+        }
+
+        unsigned char *format4 = out + header_len;
+        uint32_t search_range = 2;
+        uint32_t entry_selector = 0;
+        while (search_range * 2 <= 2 * (uint32_t)segments) {
+                search_range *= 2;
+                entry_selector++;
+        }
+        __font_put16(format4, 4);
+        __font_put16(format4 + 2, format4_len);
+        __font_put16(format4 + 6, 2 * segments);
+        __font_put16(format4 + 8, search_range);
+        __font_put16(format4 + 10, entry_selector);
+        __font_put16(format4 + 12, 2 * segments - search_range);
+
+        // runs of code points mapped to runs of glyphs share a delta
+        unsigned char *ends = format4 + 14;
+        unsigned char *starts = ends + 2 * segments + 2;
+        unsigned char *deltas = starts + 2 * segments;
+        int segment = -1;
+        for (int i = 0; i < mappings->len && mappings->elems[i].code_point < 0xffff; i++) {
+                const font_mapping *mapping = &mappings->elems[i];
+                const font_mapping *previous = i > 0 ? &mappings->elems[i - 1] : NULL;
+                if (!previous || previous->code_point + 1 != mapping->code_point ||
+                    previous->glyph + 1 != mapping->glyph) {
+                        segment++;
+                        __font_put16(starts + 2 * segment, mapping->code_point);
+                        __font_put16(deltas + 2 * segment, mapping->glyph - mapping->code_point);
+                }
+                __font_put16(ends + 2 * segment, mapping->code_point);
+        }
+        segment++;
+        __font_put16(ends + 2 * segment, 0xffff);
+        __font_put16(starts + 2 * segment, 0xffff);
+        __font_put16(deltas + 2 * segment, 1);
+
+        if (beyond_bmp) {
+                unsigned char *format12 = out + header_len + format4_len;
+                __font_put16(format12, 12);
+                __font_put32(format12 + 4, format12_len);
+                __font_put32(format12 + 12, groups);
+
+                unsigned char *group = format12 + 4;
+                for (int i = 0; i < mappings->len; i++) {
+                        const font_mapping *mapping = &mappings->elems[i];
+                        const font_mapping *previous = i > 0 ? &mappings->elems[i - 1] : NULL;
+                        if (!previous || previous->code_point + 1 != mapping->code_point ||
+                            previous->glyph + 1 != mapping->glyph) {
+                                group += 12;
+                                __font_put32(group, mapping->code_point);
+                                __font_put32(group + 8, mapping->glyph);
+                        }
+                        __font_put32(group + 4, mapping->code_point);
+                }
+        }
+
+        __font_replace(cmap, out, len);
+        return 0;
+}
+
+// keep only the glyphs of the used code points and what they are composed of. glyph ids are
+// kept so that metrics, kerning and variations indexed by them stay valid
+static int __font_subset(font_file *font, font_table *head) {
+        int res = -1;
+        font_mapping_arr mappings = {0};
+        bool *kept = NULL;
+
+        font_table *maxp = __font_find(font, "maxp");
+        if (maxp == NULL || maxp->len < 6 || __font_be16(maxp->data + 4) == 0) {
+                res = 1;
+                goto cleanup;
+        }
+        uint32_t glyphs = __font_be16(maxp->data + 4);
+
+        if ((res = __font_map(font, glyphs, &mappings)) != 0) goto cleanup;
+
+        font_table *cmap = __font_find(font, "cmap");
+        if ((res = __font_subset_cmap(cmap, &mappings)) != 0) goto cleanup;
+
+        // outlines of CFF fonts stay as they are
+        font_table *loca = __font_find(font, "loca");
+        font_table *glyf = __font_find(font, "glyf");
+        if (loca && glyf) {
+                if ((kept = calloc(glyphs + 1, sizeof(bool))) == NULL) {
+                        ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                        goto cleanup;
+                }
+                kept[0] = true;
+                for (int i = 0; i < mappings.len; i++) {
+                        kept[mappings.elems[i].glyph] = true;
+                }
+
+                bool long_offsets = __font_be16(head->data + 50) == 1;
+                if (__font_close(loca, glyf, long_offsets, kept, glyphs) != 0) goto cleanup;
+                if ((res = __font_subset_glyf(font, head, kept, glyphs)) != 0) goto cleanup;
+
+                font_table *gvar = __font_find(font, "gvar");
+                if (gvar && __font_subset_gvar(gvar, kept, glyphs) != 0) {
+                        res = -1;
+                        goto cleanup;
+                }
+        }
+
+        // glyph names, version 3 has none
+        font_table *post = __font_find(font, "post");
+        if (post && post->len >= 32 && __font_be32(post->data) == 0x00020000) {
+                unsigned char *out = NULL;
+                if ((out = malloc(32)) == NULL) {
+                        ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                        res = -1;
+                        goto cleanup;
+                }
+                memcpy(out, post->data, 32);
+                __font_put32(out, 0x00030000);
+                __font_replace(post, out, 32);
+        }
+
+        for (size_t i = 0; i < sizeof(font_dropped) / sizeof(font_dropped[0]); i++) {
+                __font_drop(font, font_dropped[i]);
+        }
+
+        res = 0;
+
+cleanup:
+        free(mappings.elems);
+        free(kept);
+
+        return res;
+}
+
+static uint32_t __font_checksum(const unsigned char *data, uint32_t len) {
+        uint32_t sum = 0;
+        for (uint32_t i = 0; i < len; i += 4) {
+                unsigned char word[4] = {0};
+                memcpy(word, data + i, len - i < 4 ? len - i : 4);
+                sum += __font_be32(word);
+        }
+        return sum;
+}
+
+static int __font_table_cmp(const void *a, const void *b) {
+        uint32_t tag_a = ((const font_table *)a)->tag;
+        uint32_t tag_b = ((const font_table *)b)->tag;
+        return tag_a < tag_b ? -1 : tag_a > tag_b;
+}
+
+// wrap the tables into a WOFF file, compressing each of them with zlib
+static int __font_woff(font_file *font, text_buf *out) {
+        unsigned char *compressed = NULL;
+        uint32_t checksums[_SITE_FONT_TABLES_MAX];
+        int res = -1;
+
+        qsort(font->tables, font->len, sizeof(font_table), __font_table_cmp);
+        font_table *head = __font_find(font, "head");
+
+        // the checksum adjustment covers the sfnt a client gets back, its tables laid out in
+        // directory order
+        __font_put32(head->owned + 8, 0);
+        unsigned char directory[12 + 16 * _SITE_FONT_TABLES_MAX] = {0};
+        uint32_t sfnt_len = 12 + 16 * (uint32_t)font->len;
+        uint32_t sum = 0;
+        uint32_t search_range = 16;
+        uint32_t entry_selector = 0;
+        while (search_range * 2 <= 16 * (uint32_t)font->len) {
+                search_range *= 2;
+                entry_selector++;
+        }
+        __font_put32(directory, font->flavor);
+        __font_put16(directory + 4, font->len);
+        __font_put16(directory + 6, search_range);
+        __font_put16(directory + 8, entry_selector);
+        __font_put16(directory + 10, 16 * font->len - search_range);
+        for (int i = 0; i < font->len; i++) {
+                unsigned char *record = directory + 12 + 16 * i;
+                checksums[i] = __font_checksum(font->tables[i].data, font->tables[i].len);
+                __font_put32(record, font->tables[i].tag);
+                __font_put32(record + 4, checksums[i]);
+                __font_put32(record + 8, sfnt_len);
+                __font_put32(record + 12, font->tables[i].len);
+                sfnt_len += __font_pad(font->tables[i].len);
+                sum += checksums[i];
+        }
+        sum += __font_checksum(directory, 12 + 16 * (uint32_t)font->len);
+        __font_put32(head->owned + 8, 0xb1b0afba - sum);
+
+        unsigned char header[44] = {0};
+        unsigned char entries[20 * _SITE_FONT_TABLES_MAX] = {0};
+        if (buf_append(out, (const char *)header, sizeof(header)) != 0 ||
+            buf_append(out, (const char *)entries, 20 * (size_t)font->len) != 0) {
+                goto cleanup;
+        }
+
+        for (int i = 0; i < font->len; i++) {
+                font_table *table = &font->tables[i];
+                uLongf compressed_len = compressBound(table->len);
+                if ((compressed = malloc(compressed_len)) == NULL) {
+                        ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                        goto cleanup;
+                }
+
+                // tables which don't shrink are stored as they are
+                const unsigned char *data = table->data;
+                uint32_t len = table->len;
+                if (compress2(compressed, &compressed_len, table->data, table->len, 9) == Z_OK &&
+                    compressed_len < table->len) {
+                        data = compressed;
+                        len = (uint32_t)compressed_len;
+                }
+
+                unsigned char *entry = (unsigned char *)out->data + 44 + 20 * i;
+                __font_put32(entry, table->tag);
+                __font_put32(entry + 4, (uint32_t)out->len);
+                __font_put32(entry + 8, len);
+                __font_put32(entry + 12, table->len);
+                __font_put32(entry + 16, checksums[i]);
+
+                static const char padding[4] = {0};
+                if (buf_append(out, (const char *)data, len) != 0 ||
+                    buf_append(out, padding, __font_pad(len) - len) != 0) {
+                        goto cleanup;
+                }
+                free(compressed);
+                compressed = NULL;
+        }
+
+        unsigned char *woff = (unsigned char *)out->data;
+        __font_put32(woff, __font_tag("wOFF"));
+        __font_put32(woff + 4, font->flavor);
+        __font_put32(woff + 8, (uint32_t)out->len);
+        __font_put16(woff + 12, font->len);
+        __font_put32(woff + 16, sfnt_len);
+        __font_put16(woff + 20, 1);
+
+        res = 0;
+
+cleanup:
+        free(compressed);
+
+        return res;
+}
+
+// family name, preferring the typographic one
+static void __font_family(font_file *font, const char *name, char *family, size_t size) {
+        font_table *table = __font_find(font, "name");
+        const unsigned char *best = NULL;
+        uint32_t best_id = 0;
+        family[0] = '\0';
+
+        uint32_t count = table && table->len >= 6 ? __font_be16(table->data + 2) : 0;
+        uint32_t strings = table && table->len >= 6 ? __font_be16(table->data + 4) : 0;
+        if (table && 6 + 12 * (uint64_t)count > table->len) count = 0;
+        for (uint32_t i = 0; i < count; i++) {
+                const unsigned char *record = table->data + 6 + 12 * i;
+                uint32_t platform = __font_be16(record);
+                uint32_t encoding = __font_be16(record + 2);
+                uint32_t id = __font_be16(record + 6);
+                bool unicode =
+                    platform == 0 || (platform == 3 && (encoding == 1 || encoding == 10));
+                if ((id != 1 && id != 16) || !unicode || id <= best_id) continue;
+                if ((uint64_t)strings + __font_be16(record + 10) + __font_be16(record + 8) >
+                    table->len) {
+                        continue;
+                }
+                best = record;
+                best_id = id;
+        }
+
+        // UTF-16 to UTF-8, leaving out what would need quoting in CSS or HTML
+        size_t len = 0;
+        if (best) {
+                const unsigned char *text = table->data + strings + __font_be16(best + 10);
+                for (uint32_t i = 0; i + 1 < __font_be16(best + 8); i += 2) {
+                        uint32_t c = __font_be16(text + i);
+                        if (c < 0x20 || c == '"' || c == '\\' || c == '<' || c == '>' ||
+                            (c >= 0xd800 && c < 0xe000) || len + 4 >= size) {
+                                continue;
+                        }
+                        if (c < 0x80) {
+                                family[len++] = (char)c;
+                        } else if (c < 0x800) {
+                                family[len++] = (char)(0xc0 | c >> 6);
+                                family[len++] = (char)(0x80 | (c & 0x3f));
+                        } else {
+                                family[len++] = (char)(0xe0 | c >> 12);
+                                family[len++] = (char)(0x80 | (c >> 6 & 0x3f));
+                                family[len++] = (char)(0x80 | (c & 0x3f));
+                        }
+                }
+                family[len] = '\0';
+        }
+
+        // the file name otherwise, e.g. fonts/Inconsolata.ttf
+        if (len == 0) {
+                const char *base = strrchr(name, '/');
+                base = base ? base + 1 : name;
+                snprintf(family, size, "%.*s", (int)strcspn(base, ".\"\\<>"), base);
+        }
+}
+
+// range of an axis of a variable font, false if there is none
+static bool __font_axis(font_file *font, const char *tag, double *min, double *max) {
+        font_table *fvar = __font_find(font, "fvar");
+        if (fvar == NULL || fvar->len < 16) return false;
+
+        uint32_t offset = __font_be16(fvar->data + 4);
+        uint32_t count = __font_be16(fvar->data + 8);
+        uint32_t size = __font_be16(fvar->data + 10);
+        if (size < 20 || offset + (uint64_t)count * size > fvar->len) return false;
+
+        for (uint32_t i = 0; i < count; i++) {
+                const unsigned char *axis = fvar->data + offset + i * size;
+                if (__font_be32(axis) != __font_tag(tag)) continue;
+                *min = (int32_t)__font_be32(axis + 4) / 65536.0;
+                *max = (int32_t)__font_be32(axis + 12) / 65536.0;
+                return true;
+        }
+
+        return false;
+}
+
+// preload the font and describe it, taking what the font says about itself
+static int __font_face(font_file *font, const char *name, const char *hashed_name,
+                       text_buf *preloads, text_buf *faces) {
+        static const char *widths[] = {"50%",  "62.5%", "75%",  "87.5%", "100%",
+                                       "112.5%", "125%", "150%", "200%"};
+        char family[_SITE_PATH_MAX];
+        char weight[32] = "400";
+        char stretch[32] = "";
+        double min = 0;
+        double max = 0;
+
+        __font_family(font, name, family, sizeof(family));
+
+        font_table *os2 = __font_find(font, "OS/2");
+        font_table *head = __font_find(font, "head");
+        bool italic = (os2 && os2->len >= 64 && (__font_be16(os2->data + 62) & 0x201)) ||
+                      (!os2 && head->len >= 46 && (__font_be16(head->data + 44) & 0x2));
+
+        if (__font_axis(font, "wght", &min, &max)) {
+                snprintf(weight, sizeof(weight), "%g %g", min, max);
+        } else if (os2 && os2->len >= 6) {
+                snprintf(weight, sizeof(weight), "%u", (unsigned)__font_be16(os2->data + 4));
+        }
+
+        if (__font_axis(font, "wdth", &min, &max)) {
+                snprintf(stretch, sizeof(stretch), ";font-stretch:%g%% %g%%", min, max);
+        } else if (os2 && os2->len >= 8) {
+                uint32_t width = __font_be16(os2->data + 6);
+                if (width >= 1 && width <= 9 && width != 5) {
+                        snprintf(stretch, sizeof(stretch), ";font-stretch:%s", widths[width - 1]);
+                }
+        }
+
+        if (buf_printf(preloads,
+                       "    <link rel=\"preload\" href=\"/%s\" as=\"font\" type=\"font/woff\" "
+                       "crossorigin>\n",
+                       hashed_name) != 0 ||
+            buf_printf(faces,
+                       "@font-face{font-family:\"%s\";src:url(/%s) format(\"woff\");"
+                       "font-weight:%s%s;font-style:%s;font-display:%s}",
+                       family, hashed_name, weight, stretch, italic ? "italic" : "normal",
+                       _SITE_EXT_FONT_DISPLAY) != 0) {
+                return -1;
+        }
+
+        return 0;
+}
+
+// fonts/<name>.ttf becomes fonts/<name>.woff
+static void __font_woff_name(const char *name, char *woff_name, size_t size) {
+        const char *ext = strrchr(name, '.');
+        snprintf(woff_name, size, "%.*s.woff", (int)(ext - name), name);
+}
+
+static int __font_add(const source_file *source, text_buf *preloads, text_buf *faces) {
+        int res = -1;
+        char *content = NULL;
+        size_t len = 0;
+        font_file font = {0};
+        text_buf woff = {0};
+
+        if (asset_read(source->path, &content, &len) != 0) goto cleanup;
+        if (__font_load(source->name, (const unsigned char *)content, len, &font) != 0) {
+                goto cleanup;
+        }
+
+        // the head is written to in any case
+        font_table *head = __font_find(&font, "head");
+        if (head == NULL || head->len < 54) {
+                ERRORF(SITE_ERROR_FONT_FORMAT, source->name);
+                goto cleanup;
+        }
+        unsigned char *head_data = NULL;
+        if ((head_data = malloc(head->len)) == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                goto cleanup;
+        }
+        memcpy(head_data, head->data, head->len);
+        __font_replace(head, head_data, head->len);
+
+        hash_ctx ctx;
+        unsigned char digest[_SITE_HASH_SIZE];
+        char key[_SITE_HASH_HEX_SIZE];
+        int options[] = {_SITE_EXT_FONT_SUBSET};
+
+        hash_init(&ctx);
+        hash_update(&ctx, _SITE_FONT_VERSION, sizeof(_SITE_FONT_VERSION));
+        hash_update(&ctx, options, sizeof(options));
+        hash_update(&ctx, font_used, _SITE_FONT_CODE_POINTS / 8);
+        hash_update(&ctx, content, len);
+        hash_final(&ctx, digest);
+        hash_to_hex(digest, key);
+
+        char woff_name[_SITE_PATH_MAX];
+        __font_woff_name(source->name, woff_name, sizeof(woff_name));
+
+        char *cached = NULL;
+        size_t cached_len = 0;
+        if (cache_get("font", key, &cached, &cached_len) == 0) {
+                woff.data = cached;
+                woff.len = cached_len;
+        } else {
+                // fonts without a usable cmap or glyph table are kept whole, the head may move
+                // along with the tables from here on
+                int subset = _SITE_EXT_FONT_SUBSET ? __font_subset(&font, head) : 1;
+                if (subset < 0) goto cleanup;
+                if (subset > 0 && _SITE_EXT_FONT_SUBSET) {
+                        fprintf(stderr, "Warning: %s not subset (%s:%d)\n", source->name,
+                                __FILE__, __LINE__);
+                }
+                if (__font_woff(&font, &woff) != 0) goto cleanup;
+
+                // a failed cache write only costs us the next build
+                cache_put("font", key, woff.data, woff.len);
+        }
+
+        size_t woff_len = woff.len;
+        if (asset_add_content(woff_name, buf_detach(&woff), woff_len) != 0) goto cleanup;
+
+        if (__font_face(&font, source->name, asset_path(woff_name), preloads, faces) != 0) {
+                goto cleanup;
+        }
+
+        res = 0;
+
+cleanup:
+        __font_free(&font);
+        buf_free(&woff);
+        free(content);
+
+        return res;
+}
+
+bool font_is_source(const source_file *source) {
+        const char *ext = strrchr(source->name, '.');
+        return strncmp(source->name, _SITE_FONT_DIR "/", sizeof(_SITE_FONT_DIR)) == 0 && ext &&
+               (strcmp(ext, ".ttf") == 0 || strcmp(ext, ".otf") == 0);
+}
+
+int font_process(source_file *fonts[], int fonts_len, source_file *pages[], int pages_len) {
+        int res = -1;
+        text_buf preloads = {0};
+        text_buf faces = {0};
+
+        if (fonts_len == 0) return 0;
+
+        if ((font_used = calloc(_SITE_FONT_CODE_POINTS / 8, 1)) == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                goto cleanup;
+        }
+
+        // printable ASCII for whatever the generator adds, e.g. dates
+        for (uint32_t c = 0x20; c < 0x7f; c++) {
+                __font_use(c);
+        }
+
+        // every page, not only the ones built, so partial builds don't change the subset
+        for (int i = 0; i < pages_len; i++) {
+                char *content = NULL;
+                size_t len = 0;
+                if (asset_read(pages[i]->path, &content, &len) != 0) goto cleanup;
+                __font_collect(content);
+                free(content);
+        }
+        // and the few characters beyond ASCII the generator adds itself
+        __font_collect(_SITE_PRERENDER_FOOTNOTE_BACK);
+        __font_collect(site_menu);
+        __font_collect(site.title);
+        __font_collect(site.author);
+
+        for (int i = 0; i < fonts_len; i++) {
+                if (__font_add(fonts[i], &preloads, &faces) != 0) goto cleanup;
+        }
+
+        if (buf_printf(&preloads, "    <style>%s</style>\n", faces.data) != 0) goto cleanup;
+        font_head = buf_detach(&preloads);
+
+        res = 0;
+
+cleanup:
+        buf_free(&preloads);
+        buf_free(&faces);
+
+        return res;
+}
+
+void font_cleanup(void) {
+        free(font_head);
+        free(font_used);
+        font_head = NULL;
+        font_used = NULL;
+}
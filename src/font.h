@@ -0,0 +1,46 @@
+#ifndef FONT_H
+#define FONT_H
+
+#include <stdbool.h>
+
+#include "scan.h"
+
+// vendored TrueType and OpenType fonts live below this dir of the source dir
+#define _SITE_FONT_DIR "fonts"
+
+// subset vendored fonts to the code points the site uses, keep them whole otherwise
+#ifndef _SITE_EXT_FONT_SUBSET
+#define _SITE_EXT_FONT_SUBSET 1
+#endif
+
+// font-display of the generated @font-face rules
+#ifndef _SITE_EXT_FONT_DISPLAY
+#define _SITE_EXT_FONT_DISPLAY "swap"
+#endif
+
+// bump whenever subsets change in ways their cache key doesn't cover
+#define _SITE_FONT_VERSION "1"
+
+#define _SITE_FONT_TABLES_MAX 64
+
+// loaded from their hosts as long as no fonts are vendored
+#define _SITE_FONT_REMOTE                                                                          \
+        "<link rel=\"preconnect\" href=\"https://fonts.googleapis.com\">\n"                        \
+        "<link rel=\"preconnect\" href=\"https://fonts.gstatic.com\" crossorigin>\n"               \
+        "<link href=\"https://fonts.googleapis.com/css2?family=Inconsolata:wdth,wght@95.3,"        \
+        "200..900&family=Roboto+Flex:opsz,wght@8..144,100..1000&display=swap\" "                   \
+        "rel=\"stylesheet\">\n"                                                                    \
+        "<style>@import url('https://fonts.googleapis.com/css2?family=Rock+3D&display=swap');"     \
+        "</style>\n"
+
+// markup preloading and declaring the fonts, filling the fonts slot of the page shells
+extern char *font_head;
+
+bool font_is_source(const source_file *);
+
+// subset the given fonts to the code points of the pages, the menu and the site config, and
+// add them to the assets as WOFF
+int font_process(source_file *[], int, source_file *[], int);
+void font_cleanup(void);
+
+#endif // FONT_H
@@ -1,11 +1,20 @@
 #include <errno.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include <pthread.h>
 #include <unistd.h>
 
+#include <git2/sys/commit_graph.h>
+#include <sys/stat.h>
+
 #include "error.h"
 #include "ghist.h"
+#include "site.h"
+
+ghist_stats ghist_count = {0};
 
 typedef struct {
         char *old_path;
@@ -140,12 +149,262 @@ tracked_file *ghist_find_by_path(char *file_path) {
         return NULL;
 }
 
-int ghist_times(void) {
+// a single file followed back through the history, newest commit first
+typedef struct {
+        char *path; // name at the commit being looked at, older at each rename
+        int changes;
+        git_time_t first_change;
+        git_time_t last_change;
+        git_time_t first_rename;
+        git_time_t last_rename;
+        bool added; // added by the commit being looked at
+        bool done;
+} ghist_trace;
+
+typedef struct {
+        ghist_trace *traces;
+        int len;
+        git_time_t time;
+} ghist_trace_set;
+
+static int __trace_changes_cb(const git_diff_delta *delta, __attribute__((unused)) float progress,
+                              void *payload) {
+        ghist_trace_set *set = payload;
+        const char *path = delta->status == GIT_DELTA_DELETED ? delta->old_file.path
+                                                              : delta->new_file.path;
+
+        for (int i = 0; i < set->len; i++) {
+                ghist_trace *trace = &set->traces[i];
+                if (trace->done || strcmp(trace->path, path) != 0) continue;
+
+                trace->changes++;
+                trace->first_change = set->time;
+                if (trace->last_change == 0) trace->last_change = set->time;
+                trace->added = delta->status == GIT_DELTA_ADDED;
+        }
+
+        return 0;
+}
+
+static int __trace_renames_cb(const git_diff_delta *delta,
+                              __attribute__((unused)) float progress, void *payload) {
+        ghist_trace_set *set = payload;
+        if (delta->similarity <= 50 || strcmp(delta->old_file.path, delta->new_file.path) == 0) {
+                return 0;
+        }
+
+        for (int i = 0; i < set->len; i++) {
+                ghist_trace *trace = &set->traces[i];
+                if (!trace->added || strcmp(trace->path, delta->new_file.path) != 0) continue;
+
+                char *old_path = NULL;
+                if ((old_path = strdup(delta->old_file.path)) == NULL) return -1;
+                free(trace->path);
+                trace->path = old_path;
+
+                trace->first_rename = set->time;
+                if (trace->last_rename == 0) trace->last_rename = set->time;
+                trace->added = false;
+        }
+
+        return 0;
+}
+
+// look for renames only in commits adding a traced file, diffing the whole tree is expensive
+static int __trace_renames(git_repository *repo, git_tree *parent_tree, git_tree *tree,
+                           ghist_trace_set *set) {
+        git_diff *diff = NULL;
+        git_diff_find_options find_opts;
+        int res = -1;
+
+        if (git_diff_tree_to_tree(&diff, repo, parent_tree, tree, NULL)) goto cleanup;
+        if (git_diff_find_options_init(&find_opts, GIT_DIFF_FIND_OPTIONS_VERSION)) goto cleanup;
+        find_opts.flags = GIT_DIFF_FIND_RENAMES | GIT_DIFF_FIND_IGNORE_WHITESPACE;
+        if (git_diff_find_similar(diff, &find_opts)) goto cleanup;
+        if (git_diff_foreach(diff, &__trace_renames_cb, NULL, NULL, NULL, set)) goto cleanup;
+
+        // an addition that wasn't a rename is where the history of a file starts
+        for (int i = 0; i < set->len; i++) {
+                if (set->traces[i].added) set->traces[i].done = true;
+        }
+        res = 0;
+
+cleanup:
+        git_diff_free(diff);
+        return res;
+}
+
+// the times of a file as the walk over the whole history would see them
+static int __trace_record(const char *path, const ghist_trace *trace) {
+        if (trace->changes == 0) return 0;
+
+        if (tracked_arr.capacity == tracked_arr.len) {
+                int capacity = tracked_arr.capacity ? tracked_arr.capacity * 2 : 100;
+                tracked_file *grown = realloc(tracked_arr.files, capacity * sizeof(tracked_file));
+                if (grown == NULL) return -1;
+                tracked_arr.files = grown;
+                tracked_arr.capacity = capacity;
+        }
+
+        tracked_file file = {.file_path = strdup(path)};
+        if (file.file_path == NULL) return -1;
+        if (trace->last_rename) {
+                file.creat_time = trace->first_rename;
+                file.mod_time = trace->last_rename;
+        } else {
+                file.creat_time = trace->first_change;
+                file.mod_time = trace->changes > 1 ? trace->last_change : 0;
+        }
+        tracked_arr.files[tracked_arr.len++] = file;
+
+        return 0;
+}
+
+// walk from the newest commit back, diffing only the traced paths, until every file has been
+// traced back to its creation
+static int __ghist_trace_paths(git_repository *repo, git_revwalk *walker, const char *paths[],
+                               int len) {
+        int res = -1;
+        git_oid oid;
+        git_oid parent_oid;
+        git_commit *commit = NULL;
+        git_commit *parent = NULL;
+        git_tree *tree = NULL;
+        git_tree *parent_tree = NULL;
+        git_diff *diff = NULL;
+        char **pathspec = NULL;
+
+        ghist_trace_set set = {.len = len};
+        if ((set.traces = calloc(len, sizeof(ghist_trace))) == NULL ||
+            (pathspec = calloc(len, sizeof(char *))) == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                goto cleanup;
+        }
+        for (int i = 0; i < len; i++) {
+                if ((set.traces[i].path = strdup(paths[i])) == NULL) {
+                        ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                        goto cleanup;
+                }
+        }
+
+        if (git_revwalk_sorting(walker, GIT_SORT_TIME)) goto error;
+        if (git_revwalk_push_head(walker)) goto error;
+
+        while (git_revwalk_next(&oid, walker) == 0) {
+                // clang-format off
+                if (commit) { git_commit_free(commit); commit = NULL; }
+                if (parent) { git_commit_free(parent); parent = NULL; }
+                if (tree) { git_tree_free(tree); tree = NULL; }
+                if (diff) { git_diff_free(diff); diff = NULL; }
+                // clang-format on
+                ghist_count.commits++;
+
+                // walking back a linear history, the last parent tree is the tree of this commit
+                if (parent_tree && git_oid_equal(&parent_oid, &oid)) {
+                        tree = parent_tree;
+                        ghist_count.trees_reused++;
+                } else if (parent_tree) {
+                        git_tree_free(parent_tree);
+                }
+                parent_tree = NULL;
+
+                git_diff_options opts;
+                if (git_diff_options_init(&opts, GIT_DIFF_OPTIONS_VERSION)) goto error;
+                opts.flags |= GIT_DIFF_DISABLE_PATHSPEC_MATCH;
+                opts.pathspec.strings = pathspec;
+                opts.pathspec.count = 0;
+                for (int i = 0; i < len; i++) {
+                        if (set.traces[i].done) continue;
+                        pathspec[opts.pathspec.count++] = set.traces[i].path;
+                }
+                if (opts.pathspec.count == 0) break;
+
+                if (git_commit_lookup(&commit, repo, &oid)) goto error;
+                if (git_commit_parentcount(commit) != 1) continue;
+
+                if (tree == NULL) {
+                        if (git_commit_tree(&tree, commit)) goto error;
+                        ghist_count.trees_read++;
+                }
+                if (git_commit_parent(&parent, commit, 0)) goto error;
+                if (git_commit_tree(&parent_tree, parent)) goto error;
+                git_oid_cpy(&parent_oid, git_commit_id(parent));
+                ghist_count.trees_read++;
+                if (git_diff_tree_to_tree(&diff, repo, parent_tree, tree, &opts)) goto error;
+
+                bool added = false;
+                set.time = git_commit_author(commit)->when.time;
+                for (int i = 0; i < len; i++) {
+                        set.traces[i].added = false;
+                }
+                if (git_diff_foreach(diff, &__trace_changes_cb, NULL, NULL, NULL, &set)) goto error;
+                for (int i = 0; i < len; i++) {
+                        if (set.traces[i].added) added = true;
+                }
+                if (added && __trace_renames(repo, parent_tree, tree, &set) != 0) goto error;
+        }
+
+        for (int i = 0; i < len; i++) {
+                if (__trace_record(paths[i], &set.traces[i]) != 0) {
+                        ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                        goto cleanup;
+                }
+        }
+
+        res = 0;
+        goto cleanup;
+
+error:
+        ERRORF(SITE_ERROR_GIT_OPERATION, git_error_last()->message);
+
+cleanup:
+        git_commit_free(commit);
+        git_commit_free(parent);
+        git_tree_free(tree);
+        git_tree_free(parent_tree);
+        git_diff_free(diff);
+        for (int i = 0; set.traces && i < len; i++) {
+                free(set.traces[i].path);
+        }
+        free(set.traces);
+        free(pathspec);
+
+        return res;
+}
+
+// the walk diffs the tree of every commit against that of its parent, keep both decompressed
+static void __ghist_configure(void) {
+        git_libgit2_opts(GIT_OPT_SET_CACHE_OBJECT_LIMIT, GIT_OBJECT_COMMIT,
+                         (size_t)_SITE_GHIST_OBJECT_LIMIT);
+        git_libgit2_opts(GIT_OPT_SET_CACHE_OBJECT_LIMIT, GIT_OBJECT_TREE,
+                         (size_t)_SITE_GHIST_OBJECT_LIMIT);
+        git_libgit2_opts(GIT_OPT_SET_CACHE_MAX_SIZE, (ssize_t)_SITE_EXT_GIT_CACHE_MAX);
+}
+
+// libgit2 reads the commit-graph on its own when walking, if there is one
+static bool __ghist_has_commit_graph(git_repository *repo) {
+        static const char *graph_files[] = {"objects/info/commit-graph",
+                                            "objects/info/commit-graphs/commit-graph-chain"};
+
+        for (size_t i = 0; i < sizeof(graph_files) / sizeof(graph_files[0]); i++) {
+                char path[_SITE_GHIST_PATH_MAX];
+                snprintf(path, sizeof(path), "%s%s", git_repository_path(repo), graph_files[i]);
+
+                struct stat st;
+                if (stat(path, &st) == 0) return true;
+        }
+
+        return false;
+}
+
+int ghist_times(const char *paths[], int len) {
         int res = 0;
 
         git_libgit2_init();
+        __ghist_configure();
 
         git_oid oid;
+        git_oid tree_oid; // commit the kept tree belongs to
         git_repository *repo = NULL;
         git_revwalk *walker = NULL;
         git_commit *commit = NULL;
@@ -154,8 +413,15 @@ int ghist_times(void) {
         git_tree *parent_tree = NULL;
         git_diff *diff = NULL;
 
-        if (git_repository_open(&repo, _SITE_EXT_GIT_DIR) != 0) goto error;
+        if (git_repository_open(&repo, site.git_dir) != 0) goto error;
         if (git_revwalk_new(&walker, repo)) goto error;
+        ghist_count.commit_graph = __ghist_has_commit_graph(repo);
+
+        if (paths) {
+                res = __ghist_trace_paths(repo, walker, paths, len);
+                goto cleanup;
+        }
+
         if (git_revwalk_sorting(walker, GIT_SORT_TIME | GIT_SORT_REVERSE)) goto error;
         if (git_revwalk_push_head(walker)) goto error;
 
@@ -164,27 +430,38 @@ int ghist_times(void) {
                 // clang-format off
                 if (commit) { git_commit_free(commit); commit = NULL; }
                 if (parent) { git_commit_free(parent); parent = NULL; }
-                if (tree) { git_tree_free(tree); tree = NULL; }
                 if (parent_tree) { git_tree_free(parent_tree); parent_tree = NULL; }
                 if (diff) { git_diff_free(diff); diff = NULL; }
                 // clang-format on
+                ghist_count.commits++;
 
                 if (git_commit_lookup(&commit, repo, &oid)) goto error;
 
                 int parent_count = git_commit_parentcount(commit);
                 if (parent_count != 1) continue;
 
-                if (git_commit_parent(&parent, commit, 0)) goto error;
+                // walking a linear history, the parent tree is the tree of the last commit
+                if (tree && git_oid_equal(git_commit_parent_id(commit, 0), &tree_oid)) {
+                        parent_tree = tree;
+                        ghist_count.trees_reused++;
+                } else {
+                        if (tree) git_tree_free(tree);
+                        if (git_commit_parent(&parent, commit, 0)) goto error;
+                        if (git_commit_tree(&parent_tree, parent)) goto error;
+                        ghist_count.trees_read++;
+                }
+                tree = NULL;
                 if (git_commit_tree(&tree, commit)) goto error;
-                if (git_commit_tree(&parent_tree, parent)) goto error;
+                git_oid_cpy(&tree_oid, &oid);
+                ghist_count.trees_read++;
                 if (git_diff_tree_to_tree(&diff, repo, parent_tree, tree, NULL)) goto error;
 
                 // enable dection of renamed files
-                git_diff_find_options *find_opts = malloc(sizeof(git_diff_find_options));
-                if (git_diff_find_options_init(find_opts, GIT_DIFF_FIND_OPTIONS_VERSION))
+                git_diff_find_options find_opts;
+                if (git_diff_find_options_init(&find_opts, GIT_DIFF_FIND_OPTIONS_VERSION))
                         goto error;
-                find_opts->flags = GIT_DIFF_FIND_RENAMES | GIT_DIFF_FIND_IGNORE_WHITESPACE;
-                if (git_diff_find_similar(diff, find_opts)) goto error;
+                find_opts.flags = GIT_DIFF_FIND_RENAMES | GIT_DIFF_FIND_IGNORE_WHITESPACE;
+                if (git_diff_find_similar(diff, &find_opts)) goto error;
 
                 git_signature *signature = (git_signature *)git_commit_author(commit);
                 if (git_diff_foreach(diff, &__get_times_cb, NULL, NULL, NULL, (void *)signature))
@@ -218,6 +495,7 @@ cleanup:
         git_commit_free(parent);
         git_tree_free(tree);
         git_tree_free(parent_tree);
+        git_diff_free(diff);
 
         for (int i = 0; i < rename_arr.len; i++) {
                 free(rename_arr.records[i].old_path);
@@ -227,3 +505,87 @@ cleanup:
 
         return res;
 }
+
+// the walk in flight, if any
+static struct {
+        pthread_t thread;
+        const char **paths;
+        int len;
+        int res;
+        bool running;
+} ghist_walk = {0};
+
+static void *__ghist_walk(void *arg) {
+        (void)arg;
+        ghist_walk.res = ghist_times(ghist_walk.paths, ghist_walk.len);
+        return NULL;
+}
+
+int ghist_start(const char *paths[], int len) {
+        ghist_walk.paths = paths;
+        ghist_walk.len = len;
+
+        // without a thread the walk just runs up front
+        if (pthread_create(&ghist_walk.thread, NULL, __ghist_walk, NULL) != 0) {
+                __ghist_walk(NULL);
+                return 0;
+        }
+        ghist_walk.running = true;
+
+        return 0;
+}
+
+int ghist_wait(void) {
+        if (ghist_walk.running) {
+                pthread_join(ghist_walk.thread, NULL);
+                ghist_walk.running = false;
+        }
+
+        return ghist_walk.res;
+}
+
+int ghist_write_commit_graph(void) {
+        int res = 0;
+        git_repository *repo = NULL;
+        git_revwalk *walker = NULL;
+        git_commit_graph_writer *writer = NULL;
+
+        git_libgit2_init();
+
+        if (git_repository_open(&repo, site.git_dir) != 0) goto error;
+
+        // every commit reachable from HEAD, which is all the history walk visits
+        char info_dir[_SITE_GHIST_PATH_MAX];
+        snprintf(info_dir, sizeof(info_dir), "%sobjects/info", git_repository_path(repo));
+        if (git_commit_graph_writer_new(&writer, info_dir, NULL)) goto error;
+        if (git_revwalk_new(&walker, repo)) goto error;
+        if (git_revwalk_push_head(walker)) goto error;
+        if (git_commit_graph_writer_add_revwalk(writer, walker)) goto error;
+        if (git_commit_graph_writer_commit(writer)) goto error;
+
+        printf("Wrote commit-graph to %s\n", info_dir);
+        goto cleanup;
+
+error:
+        res = -1;
+        ERRORF(SITE_ERROR_GIT_OPERATION, git_error_last()->message);
+
+cleanup:
+        git_commit_graph_writer_free(writer);
+        git_revwalk_free(walker);
+        git_repository_free(repo);
+
+        return res;
+}
+
+void ghist_report(void) {
+        ssize_t cached = 0;
+        ssize_t allowed = 0;
+        git_libgit2_opts(GIT_OPT_GET_CACHED_MEMORY, &cached, &allowed);
+
+        int trees = ghist_count.trees_reused + ghist_count.trees_read;
+        printf("Walked %d commits, reused %d of %d trees, cached %zd of %zd KiB of objects\n",
+               ghist_count.commits, ghist_count.trees_reused, trees, cached / 1024,
+               allowed / 1024);
+        if (!ghist_count.commit_graph) printf("No commit-graph, write one with --commit-graph\n");
+}
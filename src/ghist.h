@@ -1,8 +1,20 @@
 #ifndef GHIST_H
 #define GHIST_H
 
+#include <stdbool.h>
+
 #include <git2.h>
 
+// bytes of decompressed objects libgit2 may keep around while walking history
+#ifndef _SITE_EXT_GIT_CACHE_MAX
+#define _SITE_EXT_GIT_CACHE_MAX (256 * 1024 * 1024)
+#endif
+
+// commits and trees up to this size are cached, libgit2 skips trees over 4 KiB by default
+#define _SITE_GHIST_OBJECT_LIMIT (1024 * 1024)
+
+#define _SITE_GHIST_PATH_MAX 4096
+
 typedef struct {
         char *file_path;
         git_time_t creat_time;
@@ -15,12 +27,32 @@ typedef struct {
         int capacity;
 } tracked_file_arr;
 
+typedef struct {
+        int commits;
+        int trees_reused; // parent trees carried over from the previous commit
+        int trees_read;
+        bool commit_graph;
+} ghist_stats;
+
 extern tracked_file_arr tracked_arr;
+extern ghist_stats ghist_count;
+
+// obtain modification and creation times, of all files or only of the given paths and the
+// names they had before being renamed
+int ghist_times(const char *[], int);
+
+// run ghist_times alongside the rest of the build, the paths must outlive it. tracked files may
+// only be looked up once ghist_wait has returned its result
+int ghist_start(const char *[], int);
+int ghist_wait(void);
 
-// obtain modification and creation times
-int ghist_times(void);
 void ghist_format_ts(char *, char *, time_t timestamp);
 
+// write or refresh the commit-graph of the repository, which speeds up later walks
+int ghist_write_commit_graph(void);
+
+void ghist_report(void);
+
 // match tracked files and files residing in the working dir
 tracked_file *ghist_find_by_path(char *);
 
@@ -0,0 +1,26 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define _SITE_HASH_SIZE     32
+#define _SITE_HASH_HEX_SIZE (_SITE_HASH_SIZE * 2 + 1)
+
+typedef struct {
+        uint32_t state[8];
+        uint64_t len;
+        unsigned char block[64];
+        size_t block_len;
+} hash_ctx;
+
+// incremental SHA-256
+void hash_init(hash_ctx *);
+void hash_update(hash_ctx *, const void *, size_t);
+void hash_final(hash_ctx *, unsigned char[_SITE_HASH_SIZE]);
+
+// one-shot helpers
+void hash_hex(const void *, size_t, char[_SITE_HASH_HEX_SIZE]);
+void hash_to_hex(const unsigned char[_SITE_HASH_SIZE], char[_SITE_HASH_HEX_SIZE]);
+
+#endif // HASH_H
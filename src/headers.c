@@ -0,0 +1,155 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "buf.h"
+#include "ghist.h"
+#include "headers.h"
+#include "output.h"
+
+static const char *headers_cache_control[] = {
+    [OUTPUT_CACHE_REVALIDATE] = _SITE_HEADERS_CACHE_REVALIDATE,
+    [OUTPUT_CACHE_SHORT] = _SITE_HEADERS_CACHE_SHORT,
+    [OUTPUT_CACHE_IMMUTABLE] = _SITE_HEADERS_CACHE_IMMUTABLE,
+};
+
+// HTTP dates, empty if the time is unknown
+static void __headers_date(char *formatted, time_t modified) {
+        formatted[0] = '\0';
+        if (modified) ghist_format_ts("%a, %d %b %Y %H:%M:%S GMT", formatted, modified);
+}
+
+static int __headers_htaccess(text_buf *out, int len) {
+        // apache derives ETag and Last-Modified from the stamped files and answers 304 itself
+        if (buf_puts(out, "# generated by the site generator, do not edit\n"
+                          "<IfModule mod_headers.c>\n") != 0) {
+                return -1;
+        }
+
+        for (int i = 0; i < len; i++) {
+                const output_entry *entry = &output_entries.elems[i];
+
+                // <Files> only matches the last component of a path
+                bool nested = strchr(entry->name, '/') != NULL;
+                if (buf_printf(out,
+                               nested ? "<If \"%%{REQUEST_URI} == '/%s'\">\n"
+                                      : "<Files \"%s\">\n",
+                               entry->name) != 0 ||
+                    buf_printf(out,
+                               "    Header set Cache-Control \"%s\"\n"
+                               "%s\n",
+                               headers_cache_control[entry->meta.tier],
+                               nested ? "</If>" : "</Files>") != 0) {
+                        return -1;
+                }
+        }
+
+        return buf_puts(out, "</IfModule>\n");
+}
+
+static int __headers_nginx(text_buf *out, int len) {
+        if (buf_puts(out, "# generated by the site generator, do not edit\n"
+                          "map $uri $site_etag {\n"
+                          "    default \"\";\n") != 0) {
+                return -1;
+        }
+        for (int i = 0; i < len; i++) {
+                const output_entry *entry = &output_entries.elems[i];
+                if (buf_printf(out, "    /%s \"\\\"%.*s\\\"\";\n", entry->name,
+                               _SITE_HEADERS_ETAG_LEN, entry->hash) != 0) {
+                        return -1;
+                }
+        }
+
+        if (buf_puts(out, "}\n"
+                          "map $uri $site_last_modified {\n"
+                          "    default \"\";\n") != 0) {
+                return -1;
+        }
+        for (int i = 0; i < len; i++) {
+                const output_entry *entry = &output_entries.elems[i];
+                char date[256];
+                __headers_date(date, entry->meta.modified);
+                if (*date && buf_printf(out, "    /%s \"%s\";\n", entry->name, date) != 0) {
+                        return -1;
+                }
+        }
+
+        if (buf_puts(out, "}\n"
+                          "map $uri $site_cache_control {\n"
+                          "    default \"" _SITE_HEADERS_CACHE_REVALIDATE "\";\n") != 0) {
+                return -1;
+        }
+        for (int i = 0; i < len; i++) {
+                const output_entry *entry = &output_entries.elems[i];
+                if (buf_printf(out, "    /%s \"%s\";\n", entry->name,
+                               headers_cache_control[entry->meta.tier]) != 0) {
+                        return -1;
+                }
+        }
+
+        return buf_puts(out, "}\n");
+}
+
+static int __headers_json(text_buf *out, int len) {
+        if (buf_puts(out, "{\n") != 0) return -1;
+
+        for (int i = 0; i < len; i++) {
+                const output_entry *entry = &output_entries.elems[i];
+                char date[256];
+                __headers_date(date, entry->meta.modified);
+
+                if (buf_printf(out,
+                               "    \"/%s\": {\n"
+                               "        \"ETag\": \"\\\"%.*s\\\"\",\n",
+                               entry->name, _SITE_HEADERS_ETAG_LEN, entry->hash) != 0) {
+                        return -1;
+                }
+                if (*date && buf_printf(out, "        \"Last-Modified\": \"%s\",\n", date) != 0) {
+                        return -1;
+                }
+                if (buf_printf(out,
+                               "        \"Cache-Control\": \"%s\"\n"
+                               "    }%s\n",
+                               headers_cache_control[entry->meta.tier],
+                               i + 1 < len ? "," : "") != 0) {
+                        return -1;
+                }
+        }
+
+        return buf_puts(out, "}\n");
+}
+
+int headers_write(void) {
+        int res = -1;
+        text_buf out = {0};
+        const char *name = NULL;
+
+        // the sidecar itself is recorded as an output too, but only once it is written
+        int len = output_entries.len;
+
+        switch (_SITE_EXT_HEADERS) {
+        case _SITE_HEADERS_HTACCESS:
+                name = ".htaccess";
+                if (__headers_htaccess(&out, len) != 0) goto cleanup;
+                break;
+        case _SITE_HEADERS_NGINX:
+                name = "headers.conf";
+                if (__headers_nginx(&out, len) != 0) goto cleanup;
+                break;
+        case _SITE_HEADERS_JSON:
+                name = "headers.json";
+                if (__headers_json(&out, len) != 0) goto cleanup;
+                break;
+        default:
+                return 0;
+        }
+
+        output_meta meta = {.modified = 0, .tier = OUTPUT_CACHE_REVALIDATE};
+        res = output_write(name, &meta, out.data, out.len);
+
+cleanup:
+        buf_free(&out);
+
+        return res;
+}
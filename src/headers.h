@@ -0,0 +1,25 @@
+#ifndef HEADERS_H
+#define HEADERS_H
+
+// response headers sidecar: 0 disables it, 1 writes an Apache .htaccess, 2 an nginx map to be
+// included in the http block, 3 a JSON object keyed by URI
+#ifndef _SITE_EXT_HEADERS
+#define _SITE_EXT_HEADERS 1
+#endif
+
+#define _SITE_HEADERS_HTACCESS 1
+#define _SITE_HEADERS_NGINX    2
+#define _SITE_HEADERS_JSON     3
+
+// a prefix of the content hash is plenty to tell versions apart
+#define _SITE_HEADERS_ETAG_LEN 16
+
+#define _SITE_HEADERS_CACHE_REVALIDATE "no-cache"
+#define _SITE_HEADERS_CACHE_SHORT      "public, max-age=86400"
+#define _SITE_HEADERS_CACHE_IMMUTABLE  "public, max-age=31536000, immutable"
+
+// emit Cache-Control for every output of the build, and a strong ETag from the content hash and
+// Last-Modified from its history except for apache, which derives both from the stamped file
+int headers_write(void);
+
+#endif // HEADERS_H
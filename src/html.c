@@ -4,17 +4,50 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #include <sys/stat.h>
 
+#include "asset.h"
+#include "buf.h"
+#include "cache.h"
+#include "critical.h"
+#include "embed.h"
 #include "error.h"
+#include "font.h"
 #include "ghist.h"
+#include "hash.h"
 #include "html.h"
+#include "image.h"
+#include "minify.h"
+#include "output.h"
 #include "page.h"
+#include "prerender.h"
+#include "template.h"
 
 // global template content
 char *site_menu = NULL;
 
+// page shells, compiled into segments at startup
+static page_block site_page_block = {0};
+static page_block site_index_block = {0};
+static page_template site_page_template = {0};
+static page_template site_index_template = {0};
+
+// hash of everything besides the page itself that ends up in a rendered page
+static char site_state[_SITE_HASH_HEX_SIZE] = "";
+
+time_t html_last_modified(page_header_arr *header_arr) {
+        time_t last = 0;
+        for (int i = 0; i < header_arr->len; i++) {
+                time_t modified = header_arr->elems[i]->meta.modified;
+                if (modified == 0) modified = header_arr->elems[i]->meta.created;
+                if (modified > last) last = modified;
+        }
+
+        return last;
+}
+
 // compare by creation time
 static int __qsort_cb(const void *a, const void *b) {
         page_header *header_a = *(page_header **)a;
@@ -23,9 +56,78 @@ static int __qsort_cb(const void *a, const void *b) {
         // descending order (newest first)
         if (header_a->meta.created > header_b->meta.created) return -1;
         if (header_a->meta.created < header_b->meta.created) return 1;
+
+        // pages of the same time, e.g. drafts, keep a stable order between builds
+        return strcmp(header_a->meta.path, header_b->meta.path);
+}
+
+// pages left out of the index
+static bool __html_is_excempt(const page_header *header, const char *index_excempt_arr[],
+                              int index_excempt_arr_n) {
+        for (int j = 0; j < index_excempt_arr_n; j++) {
+                int path_len = (int)strlen(header->meta.path);
+                if (path_len > 1 &&
+                    strncmp(header->meta.path + 1, index_excempt_arr[j], path_len - 2) == 0)
+                        return true;
+        }
+        return false;
+}
+
+// a page of the listing, drafted by this build or known from an earlier one
+typedef struct {
+        page_header *header;
+        page_draft *draft;
+} html_listed_page;
+
+static int __qsort_listed_cb(const void *a, const void *b) {
+        return __qsort_cb(&((const html_listed_page *)a)->header,
+                          &((const html_listed_page *)b)->header);
+}
+
+int html_link_drafts(page_draft_arr *draft_arr, const page_header_arr *others,
+                     const char *index_excempt_arr[], int index_excempt_arr_n) {
+        html_listed_page *pages = NULL;
+        int len = 0;
+
+        if ((pages = malloc((draft_arr->len + others->len + 1) * sizeof(html_listed_page))) ==
+            NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                return -1;
+        }
+
+        for (int i = 0; i < draft_arr->len; i++) {
+                page_draft *draft = &draft_arr->elems[i];
+                draft->newer = NULL;
+                draft->older = NULL;
+                if (!__html_is_excempt(draft->header, index_excempt_arr, index_excempt_arr_n)) {
+                        pages[len++] = (html_listed_page){draft->header, draft};
+                }
+        }
+
+        // pages of an earlier build which aren't drafted again
+        int drafted = len;
+        for (int i = 0; i < others->len; i++) {
+                page_header *header = others->elems[i];
+                bool seen = __html_is_excempt(header, index_excempt_arr, index_excempt_arr_n);
+                for (int j = 0; j < drafted && !seen; j++) {
+                        seen = strcmp(pages[j].header->meta.path, header->meta.path) == 0;
+                }
+                if (!seen) pages[len++] = (html_listed_page){header, NULL};
+        }
+
+        qsort(pages, len, sizeof(html_listed_page), __qsort_listed_cb);
+
+        for (int i = 0; i < len; i++) {
+                if (pages[i].draft == NULL) continue;
+                if (i > 0) pages[i].draft->newer = pages[i - 1].header;
+                if (i + 1 < len) pages[i].draft->older = pages[i + 1].header;
+        }
+
+        free(pages);
         return 0;
 }
 
+#if !_SITE_EXT_EMBED
 // shared template building blocks
 static int __html_parse_block(const char *block_path, page_block *block) {
         FILE *block_file = NULL;
@@ -80,23 +182,139 @@ cleanup:
 
         return res;
 }
+#else
+static const embedded_block *__html_embedded_block(const char *name) {
+        for (int i = 0; i < embedded_blocks_len; i++) {
+                if (strcmp(embedded_blocks[i].name, name) == 0) return &embedded_blocks[i];
+        }
+        ERRORF(SITE_ERROR_FILE_OPEN_READ, name);
+        return NULL;
+}
+#endif
+
+// source of a block, read from the block directory unless it is compiled into the binary. only
+// blocks read from disk are owned by the caller through block->content
+static const char *__html_block_source(const char *name, page_block *block) {
+#if _SITE_EXT_EMBED
+        const embedded_block *embedded = NULL;
+        if ((embedded = __html_embedded_block(name)) == NULL) return NULL;
+
+        block->content = NULL;
+        block->len = (long)embedded->len;
+        return embedded->content;
+#else
+        char block_path[_SITE_CONFIG_VALUE_MAX + _SITE_PATH_MAX];
+        snprintf(block_path, sizeof(block_path), "%s/%s/%s", site.source_dir, _SITE_BLOCK_DIR,
+                 name);
+
+        if (__html_parse_block(block_path, block) != 0) return NULL;
+        return block->content;
+#endif
+}
+
+static int __html_load_template(const char *name, page_block *block, page_template *template) {
+#if _SITE_EXT_EMBED
+        // segments were split when the binary was built
+        const embedded_block *embedded = NULL;
+        if ((embedded = __html_embedded_block(name)) == NULL) return -1;
+        if (embedded->segments_len > _SITE_TEMPLATE_SEGMENTS_MAX) {
+                ERRORF(SITE_ERROR_TEMPLATE_SIZE, name);
+                return -1;
+        }
+
+        block->content = NULL;
+        block->len = (long)embedded->len;
+        template->source = embedded->content;
+        template->source_len = embedded->len;
+        memcpy(template->segments, embedded->segments,
+               embedded->segments_len * sizeof(template_segment));
+        template->len = embedded->segments_len;
+        return 0;
+#else
+        const char *source = NULL;
+        if ((source = __html_block_source(name, block)) == NULL) return -1;
+        return template_compile(template, source, (size_t)block->len, name);
+#endif
+}
+
+// self-hosted fonts once there are any
+static const char *__html_fonts(void) { return font_head ? font_head : _SITE_FONT_REMOTE; }
+
+void html_init_state(void) {
+        hash_ctx ctx;
+        hash_init(&ctx);
+
+        int options[] = {_SITE_EXT_INLINE_CSS,  _SITE_EXT_INLINE_MAX,  _SITE_EXT_PRERENDER,
+                         _SITE_EXT_MINIFY_HTML, _SITE_EXT_IMAGE_HINTS, _SITE_EXT_PREFETCH_POSTS};
+        hash_update(&ctx, _SITE_PAGE_CACHE_VERSION, sizeof(_SITE_PAGE_CACHE_VERSION));
+        hash_update(&ctx, _SITE_MINIFY_VERSION, sizeof(_SITE_MINIFY_VERSION));
+        hash_update(&ctx, options, sizeof(options));
+        hash_update(&ctx, site_page_template.source, site_page_template.source_len);
+        hash_update(&ctx, site_menu, strlen(site_menu) + 1);
+        hash_update(&ctx, __html_fonts(), strlen(__html_fonts()) + 1);
+
+        // references are rewritten to fingerprinted names and stylesheets may be inlined
+        for (int i = 0; i < manifest.len; i++) {
+                hash_update(&ctx, manifest.elems[i].name, strlen(manifest.elems[i].name) + 1);
+                hash_update(&ctx, manifest.elems[i].hash, sizeof(manifest.elems[i].hash));
+        }
+
+        unsigned char digest[_SITE_HASH_SIZE];
+        hash_final(&ctx, digest);
+        hash_to_hex(digest, site_state);
+}
 
 // initialize all templates
 int html_init_templates(void) {
         page_block menu_block = {0};
+        const char *menu_source = NULL;
+        text_buf menu = {0};
 
         // load menu
-        if (__html_parse_block(_SITE_BLOCK_DIR_PATH "/menu.htm", &menu_block) != 0) {
+        if ((menu_source = __html_block_source("menu.htm", &menu_block)) == NULL) goto error;
+
+        // point asset references to their fingerprinted names or inline them, the menu is
+        // part of every page so its sprite is shared
+        char *rewritten_menu = NULL;
+        if ((rewritten_menu = asset_rewrite_refs(menu_source, "", &menu, true)) == NULL) {
                 goto error;
         }
+        free(menu_block.content);
+        menu_block.content = NULL;
+
+        // expand the menu once instead of on every page view, leaving it to the client if
+        // that fails
+        if (_SITE_EXT_PRERENDER) {
+                char *expanded_menu = NULL;
+                if ((expanded_menu = prerender_menu(rewritten_menu)) != NULL) {
+                        free(rewritten_menu);
+                        rewritten_menu = expanded_menu;
+                } else {
+                        fprintf(stderr, "Warning: menu left to the client (%s:%d)\n", __FILE__,
+                                __LINE__);
+                }
+        }
+
+        int res = buf_puts(&menu, rewritten_menu);
+        free(rewritten_menu);
+        if (res != 0) goto error;
 
         // transfer ownership
-        site_menu = menu_block.content;
+        site_menu = buf_detach(&menu);
+
+        // load page shells
+        if (__html_load_template("page.htm", &site_page_block, &site_page_template) != 0) {
+                goto error;
+        }
+        if (__html_load_template("index.htm", &site_index_block, &site_index_template) != 0) {
+                goto error;
+        }
 
         return 0;
 
 error:
         if (menu_block.content) free(menu_block.content);
+        buf_free(&menu);
         return -1;
 }
 
@@ -106,301 +324,748 @@ void html_cleanup_templates(void) {
                 free(site_menu);
                 site_menu = NULL;
         }
+        free(site_page_block.content);
+        free(site_index_block.content);
+        site_page_block.content = NULL;
+        site_index_block.content = NULL;
+        critical_cleanup();
 }
 
-// package content
-static char *__html_create_content(page_header *header, char *page_content) {
+// whether a line leaves us inside a preformatted element, whose blank lines are content
+static bool __html_preformatted(const char *line, size_t len, bool in_pre) {
+        const char *end = line + len;
+        const char *p = line;
 
-        size_t buf_size = 24 * 1024;
-        char *buf = NULL;
-        if ((buf = malloc(buf_size)) == NULL) {
-                ERROR(SITE_ERROR_MEMORY_ALLOCATION)
-                return NULL;
+        while ((p = memchr(p, '<', (size_t)(end - p))) != NULL) {
+                p++;
+                bool closing = p < end && *p == '/';
+                if (closing) p++;
+
+                size_t left = (size_t)(end - p);
+                size_t tag_len = 0;
+                if (left >= 3 && strncasecmp(p, "pre", 3) == 0) tag_len = 3;
+                else if (left >= 8 && strncasecmp(p, "textarea", 8) == 0) tag_len = 8;
+                if (tag_len == 0) continue;
+
+                // not merely a tag starting with the same letters
+                if (tag_len < left && p[tag_len] != '>' && !isspace((unsigned char)p[tag_len])) {
+                        continue;
+                }
+                in_pre = !closing;
         }
 
-        char *pos = buf;
-        int offset = 0;
+        return in_pre;
+}
 
-        size_t created_formatted_size = 256;
-        char created_formatted[created_formatted_size];
-        if (header->meta.created) {
-                ghist_format_ts("%Y-%m-%d", created_formatted, header->meta.created);
-        } else {
-                snprintf(created_formatted, sizeof(created_formatted), "%s", "DRAFT");
+// copy lines to the output without touching the source, dropping blank lines outside of
+// preformatted elements. runs of lines are copied as single spans
+static int __html_copy_lines(text_buf *out, const char *src, size_t len) {
+        const char *end = src + len;
+        const char *run = src;
+        const char *p = src;
+        bool in_pre = false;
+
+        while (p < end) {
+                const char *newline = memchr(p, '\n', (size_t)(end - p));
+                const char *line_end = newline ? newline : end;
+
+                if (line_end == p && !in_pre) {
+                        if (buf_append(out, run, (size_t)(p - run)) != 0) return -1;
+                        run = line_end + 1;
+                } else {
+                        in_pre = __html_preformatted(p, (size_t)(line_end - p), in_pre);
+                }
+
+                p = line_end + 1;
         }
 
-        // check for errors
-        if (offset < 0) {
-                ERROR(SITE_ERROR_FILE_WRITE);
-                free(buf);
-                return NULL;
+        if (run < end) {
+                if (buf_append(out, run, (size_t)(end - run)) != 0) return -1;
+                if (end[-1] != '\n' && buf_puts(out, "\n") != 0) return -1;
         }
 
-        pos += offset;
+        return 0;
+}
+
+// package content
+// everything of the content but its dates, which are known only once history is resolved
+static char *__html_create_body(page_header *header, const char *page_content,
+                                const char *footnotes) {
+        text_buf out = {0};
 
         // separate main content from header group
-        offset = snprintf(pos, buf_size - offset, "%s\n", "<div id=\"post-body\">");
-        pos += offset;
+        if (buf_puts(&out, "<div id=\"post-body\">\n<h1>") != 0) goto error;
 
         // add header
-        char *upper = malloc(strlen(header->title) + 1);
-        if (upper == NULL) {
-                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
-                free(buf);
-                return NULL;
+        size_t title_start = out.len;
+        if (buf_puts(&out, header->title) != 0) goto error;
+        for (size_t i = title_start; i < out.len; i++) {
+                out.data[i] = (char)toupper((unsigned char)out.data[i]);
         }
-        strcpy(upper, header->title);
-        char *p = upper;
-        while (*p) {
-                *p = (char)toupper((unsigned char)*p);
-                p++;
-        }
-        offset = snprintf(pos, buf_size - offset, "<h1>%s</h1>\n", upper);
-        free(upper);
-        pos += offset;
+        if (buf_puts(&out, "</h1>\n") != 0) goto error;
 
         // add content
-        char *line = strtok(page_content, "\n");
-        while (line) {
-                if (*line) {
-                        offset = snprintf(pos, buf_size, "%s\n", line);
-                        pos += offset;
-                }
-                line = strtok(NULL, "\n");
-        }
+        if (__html_copy_lines(&out, page_content, strlen(page_content)) != 0) goto error;
 
         // close main content
-        offset = snprintf(pos, buf_size - offset, "%s\n", "</div>");
-        pos += offset;
+        if (buf_puts(&out, "</div>\n") != 0) goto error;
+
+        // footnotes go right before the date
+        if (footnotes && buf_puts(&out, footnotes) != 0) goto error;
+
+        return buf_detach(&out);
+
+error:
+        buf_free(&out);
+        return NULL;
+}
+
+static int __html_add_dates(text_buf *out, page_header *header) {
+        char created_formatted[256];
+        if (header->meta.created) {
+                ghist_format_ts("%Y-%m-%d", created_formatted, header->meta.created);
+        } else {
+                snprintf(created_formatted, sizeof(created_formatted), "%s", "DRAFT");
+        }
 
         // add updated date at the end if present
-        int has_modified = header->meta.modified != 0;
-        if (has_modified) {
+        if (header->meta.modified != 0) {
                 char modified_formatted[256];
                 ghist_format_ts("%Y-%m-%d", modified_formatted, header->meta.modified);
-                offset = snprintf(pos, buf_size - offset,
+                return buf_printf(out,
                                   // clang-format off
                                   "<div id=\"post-date\">\n"
                                       "<div id=\"date-created\">\n"
                                           "<small>Created on %s</small>\n"
                                       "</div>\n"
-				      "|\n"
+                                      "|\n"
                                       "<div id=\"date-updated\">\n"
                                           "<small>Last Updated on %s</small>\n"
                                       "</div>\n"
                                   "</div>\n",
                                   // clang-format on
                                   created_formatted, modified_formatted);
-                pos += offset;
-        } else {
-                offset = snprintf(pos, buf_size - offset,
-                                  // clang-format off
-                                  "<div id=\"post-date\">\n"
-                                      "<div id=\"date-created\">\n"
-                                          "<small>Created on %s</small>\n"
-                                      "</div>\n"
-                                  "</div>\n",
-                                  // clang-format on
-                                  created_formatted);
-                pos += offset;
         }
 
-        return buf;
+        return buf_printf(out,
+                          // clang-format off
+                          "<div id=\"post-date\">\n"
+                              "<div id=\"date-created\">\n"
+                                  "<small>Created on %s</small>\n"
+                              "</div>\n"
+                          "</div>\n",
+                          // clang-format on
+                          created_formatted);
+}
+
+// stylesheets linked or inlined into every page head
+// files a component needs, included when its marker occurs anywhere in a page
+typedef struct {
+        const char *marker;
+        const char *style_sheet;
+        const char *script;
+} html_component;
+
+static const html_component html_component_arr[] = {
+    {"<site-menu", _SITE_MENU_STYLE_SHEET_PATH, _SITE_MENU_SCRIPT_PATH},
+    {"<site-footnote", _SITE_FOOTNOTE_STYLE_SHEET_PATH, _SITE_FOOTNOTE_SCRIPT_PATH},
+    {"<site-search", _SITE_SEARCH_STYLE_SHEET_PATH, _SITE_SEARCH_SCRIPT_PATH},
+    {"<site-posts", NULL, _SITE_POSTS_SCRIPT_PATH},
+    // pre-rendered footnotes are plain markup
+    {"id=\"footnotes\"", _SITE_FOOTNOTE_STYLE_SHEET_PATH, NULL},
+};
+#define _SITE_COMPONENT_COUNT (sizeof(html_component_arr) / sizeof(html_component_arr[0]))
+
+static bool __html_uses(const page_template *template, const char *content, const char *marker) {
+        return strstr(template->source, marker) != NULL || strstr(site_menu, marker) != NULL ||
+               strstr(content, marker) != NULL;
+}
+
+// stylesheets or scripts of a page in a stable order, the base stylesheet is always included.
+// they are linked from the root so that pages in subdirectories can share them
+static int __html_page_files(const page_template *template, const char *content, bool scripts,
+                             const char *files[_SITE_COMPONENT_COUNT + 1]) {
+        int len = 0;
+        if (!scripts) files[len++] = _SITE_STYLE_SHEET_PATH;
+
+        for (size_t i = 0; i < _SITE_COMPONENT_COUNT; i++) {
+                const html_component *component = &html_component_arr[i];
+                const char *file = scripts ? component->script : component->style_sheet;
+                if (file == NULL || !__html_uses(template, content, component->marker)) continue;
+
+                bool seen = false;
+                for (int j = 0; j < len; j++) {
+                        if (strcmp(files[j], file) == 0) seen = true;
+                }
+                if (!seen) files[len++] = file;
+        }
+
+        return len;
+}
+
+static int __html_create_scripts(text_buf *scripts, const page_template *template,
+                                 const char *content) {
+        const char *files[_SITE_COMPONENT_COUNT + 1];
+        int len = __html_page_files(template, content, true, files);
+
+        for (int i = 0; i < len; i++) {
+                if (buf_printf(scripts, "    <script src=\"/%s\" defer></script>\n",
+                               asset_path(files[i])) != 0) {
+                        return -1;
+                }
+        }
+
+        return 0;
+}
+
+// prefetch the posts next to a page in the listing
+static int __html_create_neighbour_hints(text_buf *hints, const page_draft *draft) {
+        if (_SITE_EXT_PREFETCH_POSTS == 0) return 0;
+
+        for (int i = 0; i < 2; i++) {
+                const page_header *neighbour = i ? draft->older : draft->newer;
+                if (neighbour &&
+                    buf_printf(hints, "    <link rel=\"prefetch\" href=\"%s\">\n",
+                               neighbour->meta.path) != 0) {
+                        return -1;
+                }
+        }
+
+        return 0;
+}
+
+// prefetch the newest posts right away and prerender them once a link to one is hovered
+static int __html_create_speculation_rules(text_buf *hints, page_header **posts, int len) {
+        text_buf urls = {0};
+        int res = 0;
+
+        if (len > _SITE_EXT_PREFETCH_POSTS) len = _SITE_EXT_PREFETCH_POSTS;
+        if (len == 0) return 0;
+
+        res = buf_puts(&urls, "[");
+        for (int i = 0; i < len && res == 0; i++) {
+                if (i > 0) res = buf_puts(&urls, ",");
+                if (res == 0) res = buf_json_string(&urls, posts[i]->meta.path);
+        }
+        if (res == 0) res = buf_puts(&urls, "]");
+
+        if (res == 0) {
+                res = buf_printf(hints,
+                                 "    <script type=\"speculationrules\">{"
+                                 "\"prefetch\":[{\"source\":\"list\",\"urls\":%s,"
+                                 "\"eagerness\":\"eager\"}],"
+                                 "\"prerender\":[{\"source\":\"list\",\"urls\":%s,"
+                                 "\"eagerness\":\"moderate\"}]}</script>\n",
+                                 urls.data, urls.data);
+        }
+        buf_free(&urls);
+
+        return res;
+}
+
+// emit the stylesheets for a page according to _SITE_EXT_INLINE_CSS
+static int __html_create_styles(text_buf *styles, const page_template *template,
+                                const char *content) {
+        critical_features features = {0};
+        int res = 0;
+
+        // the shell, the menu and the content make up the page
+        if (_SITE_EXT_INLINE_CSS == 2) {
+                if (critical_collect(&features, template->source) != 0) goto error;
+                if (critical_collect(&features, site_menu) != 0) goto error;
+                if (critical_collect(&features, content) != 0) goto error;
+        }
+
+        const char *files[_SITE_COMPONENT_COUNT + 1];
+        int len = __html_page_files(template, content, false, files);
+
+        for (int i = 0; i < len; i++) {
+                asset *sheet = asset_find(files[i]);
+                const char *path = asset_path(files[i]);
+
+                // fall back to a plain link for sheets we can't inline
+                if (_SITE_EXT_INLINE_CSS == 0 || sheet == NULL || sheet->content == NULL) {
+                        res = buf_printf(styles,
+                                         "    <link rel=\"stylesheet\" href=\"/%s\" "
+                                         "type=\"text/css\">\n",
+                                         path);
+                } else if (_SITE_EXT_INLINE_CSS == 1) {
+                        res = buf_printf(styles, "    <style>%s</style>\n", sheet->content);
+                } else {
+                        const char *critical = critical_css(sheet, &features);
+                        if (critical == NULL) goto error;
+
+                        // inline what the page needs and load the rest without blocking
+                        res = buf_printf(
+                            styles,
+                            // clang-format off
+                            "    <style>%s</style>\n"
+                            "    <link rel=\"preload\" href=\"/%s\" as=\"style\" onload=\"this.onload=null;this.rel='stylesheet'\">\n"
+                            "    <noscript><link rel=\"stylesheet\" href=\"/%s\" type=\"text/css\"></noscript>\n",
+                            // clang-format on
+                            critical, path, path);
+                }
+                if (res != 0) goto error;
+        }
+
+        goto cleanup;
+
+error:
+        res = -1;
+
+cleanup:
+        critical_features_free(&features);
+
+        return res;
+}
+
+static struct iovec __html_slot(const char *str, size_t len) {
+        return (struct iovec){.iov_base = (void *)str, .iov_len = str ? len : 0};
 }
 
 // create plain html file
-int html_create_page(page_header *header, char *plain_content, char *output_path) {
-        // html destination
-        FILE *dest_file = fopen(output_path, "w");
-        if (dest_file == NULL) {
-                ERRORF(SITE_ERROR_FILE_CREATE, output_path);
-                free(header);
-                return -1;
+static void __html_page_key(const page_draft *draft, char key[_SITE_HASH_HEX_SIZE]) {
+        const page_header *header = draft->header;
+        const char *output_name = draft->output_name;
+        const char *plain_content = draft->plain_content;
+        hash_ctx ctx;
+        hash_init(&ctx);
+
+        hash_update(&ctx, site_state, sizeof(site_state));
+        hash_update(&ctx, output_name, strlen(output_name) + 1);
+        hash_update(&ctx, header->title, strlen(header->title) + 1);
+        hash_update(&ctx, header->subtitle, strlen(header->subtitle) + 1);
+        hash_update(&ctx, header->meta.path, strlen(header->meta.path) + 1);
+        hash_update(&ctx, &header->meta.created, sizeof(header->meta.created));
+        hash_update(&ctx, &header->meta.modified, sizeof(header->meta.modified));
+        hash_update(&ctx, plain_content, strlen(plain_content));
+
+        // neighbours are prefetched
+        for (int i = 0; i < 2; i++) {
+                const page_header *neighbour = i ? draft->older : draft->newer;
+                const char *path = neighbour ? neighbour->meta.path : "";
+                hash_update(&ctx, path, strlen(path) + 1);
         }
 
-        int fprintf_ret = 0;
-
-        fprintf_ret = fprintf(
-            dest_file,
-            // clang-format off
-            "<!DOCTYPE html>"
-            "<html lang=\"en\">\n"
-            "<head>\n"
-            "    <meta charset=\"utf-8\">\n"
-            "    <meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">\n"
-            "    <meta name=\"apple-mobile-web-app-capable\" content=\"yes\">\n"
-            "    <meta name=\"apple-mobile-web-app-status-bar-style\" content=\"default\">\n"
-            "    <meta name=\"theme-color\" content=\"var(--color-bg)\" media=\"(prefers-color-scheme: light)\">\n"
-            "    <meta name=\"theme-color\" content=\"var(--color-bg)\" media=\"(prefers-color-scheme: dark)\">\n"
-            "	 <link href=\"/feed.atom\" type=\"application/atom+xml\" rel=\"alternate\">\n"
-            "    <link rel=\"stylesheet\" href=\"%s\" type=\"text/css\">\n"
-            "    <link rel=\"stylesheet\" href=\"%s\" type=\"text/css\">\n" _SITE_HTML_FONT "\n"
-            "    <title>%s</title>\n"
-	    "	 <style>@import url('https://fonts.googleapis.com/css2?family=Rock+3D&display=swap');</style>\n"
-            "    %s\n"
-            "</head>\n"
-            "<body>\n"
-	    "    <div id=\"background\"></div>\n"
-	    "        <div id=\"post\" class=\"content\">\n"
-	    "            %s\n"
-            "            <main>\n"
-	    "                <article id=\"post-main\">\n",
-            // clang-format on
-            _SITE_STYLE_SHEET_PATH, _SITE_MENU_STYLE_SHEET_PATH, header->title, _SITE_SCRIPT,
-            site_menu);
-
-        // write content
-        char *html_content = NULL;
-        if ((html_content = __html_create_content(header, plain_content)) == NULL) {
-                fclose(dest_file);
-                return -1;
+        unsigned char digest[_SITE_HASH_SIZE];
+        hash_final(&ctx, digest);
+        hash_to_hex(digest, key);
+}
+
+// link a page rendered by an earlier build into place, returning its content for the feed
+static char *__html_cached_page(const char *key, const char *output_name,
+                                const output_meta *meta) {
+        char *fragment = NULL;
+        size_t fragment_len = 0;
+        char page_path[_SITE_CACHE_PATH_MAX];
+
+        if (cache_get("fragment", key, &fragment, &fragment_len) != 0) return NULL;
+
+        if (cache_file("page", key, page_path, sizeof(page_path)) != 0 ||
+            output_link(output_name, meta, page_path) != 0) {
+                free(fragment);
+                return NULL;
         }
 
+        return fragment;
+}
+
+int html_push_content(page_header *header, char *html_content) {
         page_content *page_content = NULL;
         if ((page_content = malloc(sizeof(*page_content))) == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
                 free(html_content);
-                fclose(dest_file);
                 return -1;
         }
         page_content->content = html_content;
         strcpy(page_content->meta.path, header->meta.path);
 
+        if (content_arr.len == content_arr.capacity) {
+                int capacity = content_arr.capacity ? content_arr.capacity * 2 : 64;
+                void *grown = realloc(content_arr.elems, capacity * sizeof(*content_arr.elems));
+                if (grown == NULL) {
+                        ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                        free(page_content->content);
+                        free(page_content);
+                        return -1;
+                }
+                content_arr.elems = grown;
+                content_arr.capacity = capacity;
+        }
+
         content_arr.elems[content_arr.len] = page_content;
         content_arr.len++;
-        fprintf_ret = fprintf(dest_file, "%s", html_content);
-
-        // close html
-        // clang-format off
-        fprintf_ret = fprintf(dest_file, "            </article>\n"
-                                         "        </main>\n"
-                                         "    </div>\n"
-                                         "</body>\n"
-                                         "</html>\n");
-        // clang-format on
-
-        if (fprintf_ret < 0) {
-                ERRORF(SITE_ERROR_FILE_WRITE, dest_file);
-                fclose(dest_file);
-                return -1;
+
+        return 0;
+}
+
+int html_draft_page(page_draft *draft) {
+        int res = 0;
+        text_buf sprite = {0};
+        text_buf body = {0};
+        text_buf footnotes = {0};
+
+        // point asset references to their fingerprinted names or inline them, relative ones
+        // are resolved from the dir of the page
+        char base[_SITE_PATH_MAX] = "";
+        const char *slash = strrchr(draft->output_name, '/');
+        if (slash) {
+                snprintf(base, sizeof(base), "%.*s", (int)(slash - draft->output_name),
+                         draft->output_name);
         }
 
-        fclose(dest_file);
+        // images are sized by the assets they reference, so this comes first
+        char *sized_content = NULL;
+        const char *plain_content = draft->plain_content;
+        if (_SITE_EXT_IMAGE_HINTS) {
+                if ((sized_content = image_rewrite_tags(plain_content, base)) == NULL) goto error;
+                plain_content = sized_content;
+        }
 
-        return 0;
+        char *rewritten_content = asset_rewrite_refs(plain_content, base, &sprite, false);
+        free(sized_content);
+        if (rewritten_content == NULL) goto error;
+        res = buf_puts(&sprite, rewritten_content);
+        free(rewritten_content);
+        if (res != 0) goto error;
+
+        // number footnotes and collect them at the end of the post
+        char *page_body = sprite.data;
+        if (_SITE_EXT_PRERENDER) {
+                if (prerender_footnotes(sprite.data, &body, &footnotes) != 0) goto error;
+                page_body = body.data;
+        }
+
+        if ((draft->body = __html_create_body(draft->header, page_body, footnotes.data)) ==
+            NULL) {
+                goto error;
+        }
+
+        goto cleanup;
+
+error:
+        res = -1;
+
+cleanup:
+        buf_free(&sprite);
+        buf_free(&body);
+        buf_free(&footnotes);
+
+        return res;
 }
 
-// create html index file
-int html_create_index(char *page_content, char *output_path, page_header_arr *header_arr,
-                      const char *index_excempt_arr[], int index_excempt_arr_n) {
-        // html destination
-        FILE *dest_file = fopen(output_path, "w");
-        if (dest_file == NULL) {
-                ERRORF(SITE_ERROR_FILE_CREATE, output_path);
-                return -1;
+int html_create_page(page_draft *draft) {
+        int res = 0;
+        page_header *header = draft->header;
+        char *output_name = draft->output_name;
+        char *html_content = NULL;
+        text_buf content = {0};
+        text_buf styles = {0};
+        text_buf scripts = {0};
+
+        output_meta meta = {
+            .modified = header->meta.modified ? header->meta.modified : header->meta.created,
+            .tier = OUTPUT_CACHE_REVALIDATE,
+        };
+
+        char key[_SITE_HASH_HEX_SIZE] = "";
+        if (_SITE_EXT_PAGE_CACHE) {
+                __html_page_key(draft, key);
+                if ((html_content = __html_cached_page(key, output_name, &meta)) != NULL) {
+                        if (html_push_content(header, html_content) != 0) goto error;
+                        goto cleanup;
+                }
         }
 
-        int fprintf_ret = 0;
-
-        fprintf_ret = fprintf(
-            dest_file,
-            // clang-format off
-            "<!DOCTYPE html>\n"
-            "<html lang=\"en\">\n"
-            "    <head>\n"
-            "    <meta charset=\"utf-8\">\n"
-            "    <meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">\n"
-            "    <meta name=\"apple-mobile-web-app-capable\" content=\"yes\">\n"
-            "    <meta name=\"apple-mobile-web-app-status-bar-style\" content=\"default\">\n"
-            "    <meta name=\"theme-color\" content=\"var(--color-bg)\" media=\"(prefers-color-scheme: light)\">\n"
-            "    <meta name=\"theme-color\" content=\"var(--color-bg)\" media=\"(prefers-color-scheme: dark)\">\n"
-            "    <link href=\"/feed.atom\" type=\"application/atom+xml\" rel=\"alternate\">\n"
-            "    <link rel=\"stylesheet\" href=\"%s\" type=\"text/css\">\n"
-            "    <link rel=\"stylesheet\" href=\"%s\" type=\"text/css\">\n" _SITE_HTML_FONT "\n"
-            "    <title>%s</title>\n"
-	    "	 <style>@import url('https://fonts.googleapis.com/css2?family=Rock+3D&display=swap');</style>\n"
-            "	 %s\n"
-            "</head>\n"
-            "<body>\n"
-	    "    <div id=\"background\"></div>\n"
-	    "        <div id=\"index\" class=\"content\">\n"
-	    "            %s\n"
-            "            <main>\n",
-            // clang-format on
-            _SITE_STYLE_SHEET_PATH, _SITE_MENU_STYLE_SHEET_PATH, _SITE_TITLE, _SITE_SCRIPT,
-            site_menu);
+        // the dates close the drafted content
+        if (buf_puts(&content, draft->body) != 0) goto error;
+        if (__html_add_dates(&content, header) != 0) goto error;
+        html_content = buf_detach(&content);
 
-        // content
-        char *dest_line = strtok((char *)page_content, "\n");
-        while (dest_line) {
-                if (!*dest_line) continue;
-                fprintf_ret = fprintf(dest_file, "%s\n", dest_line);
-                dest_line = strtok(NULL, "\n");
+        if (html_push_content(header, html_content) != 0) goto error;
+
+        // the content is rendered first so the head can adapt to it
+        if (__html_create_styles(&styles, &site_page_template, html_content) != 0) goto error;
+        if (__html_create_scripts(&scripts, &site_page_template, html_content) != 0) goto error;
+        if (__html_create_neighbour_hints(&scripts, draft) != 0) goto error;
+
+        struct iovec slots[TEMPLATE_SLOT_COUNT] = {
+            [TEMPLATE_SLOT_STYLES] = __html_slot(styles.data, styles.len),
+            [TEMPLATE_SLOT_FONTS] = __html_slot(__html_fonts(), strlen(__html_fonts())),
+            [TEMPLATE_SLOT_TITLE] = __html_slot(header->title, strlen(header->title)),
+            [TEMPLATE_SLOT_SCRIPTS] = __html_slot(scripts.data, scripts.len),
+            [TEMPLATE_SLOT_MENU] = __html_slot(site_menu, strlen(site_menu)),
+            [TEMPLATE_SLOT_CONTENT] = __html_slot(html_content, strlen(html_content)),
+        };
+
+        struct iovec iov[_SITE_TEMPLATE_SEGMENTS_MAX];
+        int iov_len = template_render(&site_page_template, slots, iov);
+
+        if (output_writev_html(output_name, &meta, iov, iov_len) != 0) goto error;
+
+        // the fragment goes first so that every cached page has one, the page itself is taken
+        // from its output as that may have been minified
+        if (_SITE_EXT_PAGE_CACHE &&
+            cache_put("fragment", key, html_content, strlen(html_content)) == 0) {
+                char page_path[_SITE_PATH_MAX * 2];
+                output_path(output_name, page_path, sizeof(page_path));
+                cache_link("page", key, page_path);
         }
 
+        goto cleanup;
+
+error:
+        res = -1;
+
+cleanup:
+        buf_free(&content);
+        buf_free(&styles);
+        buf_free(&scripts);
+
+        return res;
+}
+
+// year a post is listed under, drafts don't have one yet
+static void __html_post_year(const page_header *header, char year[256]) {
+        if (header->meta.created) {
+                ghist_format_ts("%Y", year, header->meta.created);
+        } else {
+                snprintf(year, 256, "%s", "DRAFT");
+        }
+}
+
+// archive page of the year a post is listed under
+static void __html_archive_name(const char *year, char name[_SITE_PATH_MAX]) {
+        snprintf(name, _SITE_PATH_MAX, "%s/%s.html", _SITE_ARCHIVE_DIR,
+                 strcmp(year, "DRAFT") == 0 ? "drafts" : year);
+}
+
+// pages listed on the index and its archives, newest first
+static int __html_listed_posts(page_header_arr *header_arr, const char *index_excempt_arr[],
+                               int index_excempt_arr_n, page_header ***posts) {
         // sort by creation time
         qsort(header_arr->elems, header_arr->len, sizeof(page_header *), __qsort_cb);
 
-        // add a list of posts to the index
-        fprintf_ret = fprintf(dest_file, "<section id=\"post-list\">\n"
-                                         "    <ul>\n");
+        if ((*posts = malloc((header_arr->len + 1) * sizeof(page_header *))) == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                return -1;
+        }
 
+        int len = 0;
         for (int i = 0; i < header_arr->len; i++) {
-                bool skip = false;
-                for (int j = 0; j < index_excempt_arr_n; j++) {
-                        int path_len = (int)strlen(header_arr->elems[i]->meta.path);
-                        if (path_len > 1 && strncmp(header_arr->elems[i]->meta.path + 1,
-                                                    index_excempt_arr[j], path_len - 2) == 0)
-                                skip = true;
+                if (!__html_is_excempt(header_arr->elems[i], index_excempt_arr,
+                                       index_excempt_arr_n)) {
+                        (*posts)[len++] = header_arr->elems[i];
                 }
-                if (skip) continue;
-                size_t created_formatted_size = 256;
-                char created_formatted[created_formatted_size];
-                if (header_arr->elems[i]->meta.created) {
-                        ghist_format_ts("%Y", created_formatted,
-                                        header_arr->elems[i]->meta.created);
-                } else {
-                        snprintf(created_formatted, sizeof(created_formatted), "%s", "DRAFT");
+        }
+
+        return len;
+}
+
+static int __html_post_list(text_buf *content, page_header **posts, int len) {
+        int res = buf_puts(content, "<section id=\"post-list\">\n"
+                                    "    <ul>\n");
+
+        for (int i = 0; i < len && res == 0; i++) {
+                char created_formatted[256];
+                __html_post_year(posts[i], created_formatted);
+
+                res = buf_printf(content,
+                                 // clang-format off
+				 "<li>\n"
+                    		     "<span class=\"date\">%s</span>\n"
+                    		     "<a href=\"%s\">\n"
+					 "<span class=\"title\">%s</span>\n"
+                    		     "</a>\n"
+                    		 "</li>\n",
+                                 // clang-format on
+                                 created_formatted, posts[i]->meta.path, posts[i]->title);
+        }
+
+        if (res == 0) res = buf_puts(content, "    </ul>\n"
+                                              "</section>\n");
+        return res;
+}
+
+// render a listing into the index template, with optional hints in its head
+static int __html_write_listing(const char *output_name, const char *title, text_buf *content,
+                                const char *hints, time_t modified) {
+        int res = 0;
+        text_buf styles = {0};
+        text_buf scripts = {0};
+
+        if (__html_create_styles(&styles, &site_index_template, content->data) != 0) goto error;
+        if (__html_create_scripts(&scripts, &site_index_template, content->data) != 0) goto error;
+        if (hints && buf_puts(&scripts, hints) != 0) goto error;
+
+        struct iovec slots[TEMPLATE_SLOT_COUNT] = {
+            [TEMPLATE_SLOT_STYLES] = __html_slot(styles.data, styles.len),
+            [TEMPLATE_SLOT_FONTS] = __html_slot(__html_fonts(), strlen(__html_fonts())),
+            [TEMPLATE_SLOT_TITLE] = __html_slot(title, strlen(title)),
+            [TEMPLATE_SLOT_SCRIPTS] = __html_slot(scripts.data, scripts.len),
+            [TEMPLATE_SLOT_MENU] = __html_slot(site_menu, strlen(site_menu)),
+            [TEMPLATE_SLOT_CONTENT] = __html_slot(content->data, content->len),
+        };
+
+        struct iovec iov[_SITE_TEMPLATE_SEGMENTS_MAX];
+        int iov_len = template_render(&site_index_template, slots, iov);
+        output_meta meta = {.modified = modified, .tier = OUTPUT_CACHE_REVALIDATE};
+        if (output_writev_html(output_name, &meta, iov, iov_len) != 0) goto error;
+
+        goto cleanup;
+
+error:
+        res = -1;
+
+cleanup:
+        buf_free(&styles);
+        buf_free(&scripts);
+
+        return res;
+}
+
+// one page per year, each only depends on its own posts so other years are left untouched
+static int __html_create_archives(page_header **posts, int len) {
+        int res = 0;
+
+        for (int first = 0, last = 0; first < len && res == 0; first = last) {
+                char year[256];
+                char next[256];
+                __html_post_year(posts[first], year);
+                for (last = first + 1; last < len; last++) {
+                        __html_post_year(posts[last], next);
+                        if (strcmp(year, next) != 0) break;
                 }
 
-                fprintf_ret = fprintf(dest_file,
-                                      // clang-format off
-				      "<li>\n"
-                    		          "<span class=\"date\">%s</span>\n"
-                    		          "<a href=\"%s\">\n"
-					      "<span class=\"title\">%s</span>\n"
-                    		          "</a>\n"
-                    		      "</li>\n",
-                                      // clang-format on
-                                      created_formatted, header_arr->elems[i]->meta.path,
-                                      header_arr->elems[i]->title);
-        }
-
-        fprintf_ret = fprintf(dest_file, "    </ul>\n"
-                                         "</section>\n");
-
-        // close <main>
-        // clang-format off
-        fprintf_ret = fprintf(dest_file, "        </main>\n"
-					 "    </div>\n"
-                                         "</body>\n"
-                                         "</html>\n");
-        // clang-format on
-
-        if (fprintf_ret < 0) {
-                ERRORF(SITE_ERROR_FILE_WRITE, dest_file);
-                fclose(dest_file);
-                return -1;
+                bool drafts = strcmp(year, "DRAFT") == 0;
+                char title[_SITE_CONFIG_VALUE_MAX + 256];
+                snprintf(title, sizeof(title), "%s: %s", site.title, drafts ? "Drafts" : year);
+
+                text_buf content = {0};
+                res = buf_printf(&content, "<h1>%s</h1>\n", drafts ? "Drafts" : year);
+                if (res == 0) res = __html_post_list(&content, posts + first, last - first);
+
+                char name[_SITE_PATH_MAX];
+                __html_archive_name(year, name);
+                page_header_arr year_arr = {.elems = posts + first, .len = last - first};
+                if (res == 0) {
+                        res = __html_write_listing(name, title, &content, NULL,
+                                                   html_last_modified(&year_arr));
+                }
+                buf_free(&content);
         }
 
-        fclose(dest_file);
+        return res;
+}
 
-        return 0;
+// [path, title, year] of every post, for loading older entries into the index on demand
+static int __html_create_post_data(page_header **posts, int len) {
+        text_buf data = {0};
+
+        int res = buf_puts(&data, "[");
+        for (int i = 0; i < len && res == 0; i++) {
+                char year[256];
+                __html_post_year(posts[i], year);
+                if (buf_puts(&data, i ? ",[" : "[") != 0 ||
+                    buf_json_string(&data, posts[i]->meta.path) != 0 ||
+                    buf_puts(&data, ",") != 0 || buf_json_string(&data, posts[i]->title) != 0 ||
+                    buf_puts(&data, ",") != 0 || buf_json_string(&data, year) != 0 ||
+                    buf_puts(&data, "]") != 0) {
+                        res = -1;
+                }
+        }
+        if (res == 0) res = buf_puts(&data, "]\n");
+
+        page_header_arr post_arr = {.elems = posts, .len = len};
+        output_meta meta = {.modified = html_last_modified(&post_arr),
+                            .tier = OUTPUT_CACHE_REVALIDATE};
+        if (res == 0) res = output_write(_SITE_POST_DATA_PATH, &meta, data.data, data.len);
+        buf_free(&data);
+
+        return res;
+}
+
+// create html index file, its archives and the post data
+int html_create_index(char *page_content, char *output_name, page_header_arr *header_arr,
+                      const char *index_excempt_arr[], int index_excempt_arr_n) {
+        int res = 0;
+        text_buf content = {0};
+        text_buf hints = {0};
+        page_header **posts = NULL;
+
+        // point asset references to their fingerprinted names or inline them
+        char *rewritten_content = NULL;
+        if ((rewritten_content = asset_rewrite_refs(page_content, "", &content, false)) == NULL) {
+                goto error;
+        }
+
+        // content
+        res = __html_copy_lines(&content, rewritten_content, strlen(rewritten_content));
+        free(rewritten_content);
+        if (res != 0) goto error;
+
+        int len = __html_listed_posts(header_arr, index_excempt_arr, index_excempt_arr_n, &posts);
+        if (len < 0) goto error;
+
+        // add the newest posts to the index, older ones are left to the archives
+        int shown = len;
+        if (_SITE_EXT_INDEX_POSTS > 0 && len > _SITE_EXT_INDEX_POSTS) shown = _SITE_EXT_INDEX_POSTS;
+        if (__html_post_list(&content, posts, shown) != 0) goto error;
+
+        if (shown < len) {
+                char year[256];
+                char name[_SITE_PATH_MAX];
+                __html_post_year(posts[shown], year);
+                __html_archive_name(year, name);
+                if (buf_printf(&content,
+                               "<site-posts data-src=\"/%s\" data-offset=\"%d\">"
+                               "<a href=\"/%s\">Older posts</a></site-posts>\n"
+                               "<nav id=\"archive-list\">\n",
+                               _SITE_POST_DATA_PATH, shown, name) != 0) {
+                        goto error;
+                }
+
+                char previous[256] = "";
+                for (int i = 0; i < len; i++) {
+                        __html_post_year(posts[i], year);
+                        if (strcmp(year, previous) == 0) continue;
+                        snprintf(previous, sizeof(previous), "%s", year);
+
+                        __html_archive_name(year, name);
+                        if (buf_printf(&content, "    <a href=\"/%s\">%s</a>\n", name,
+                                       strcmp(year, "DRAFT") == 0 ? "Drafts" : year) != 0) {
+                                goto error;
+                        }
+                }
+                if (buf_puts(&content, "</nav>\n") != 0) goto error;
+        }
+
+        if (__html_create_speculation_rules(&hints, posts, shown) != 0) goto error;
+        if (__html_write_listing(output_name, site.title, &content, hints.data,
+                                 html_last_modified(header_arr)) != 0) {
+                goto error;
+        }
+
+        if (__html_create_archives(posts, len) != 0) goto error;
+        if (__html_create_post_data(posts, len) != 0) goto error;
+
+        goto cleanup;
+
+error:
+        res = -1;
+
+cleanup:
+        buf_free(&content);
+        buf_free(&hints);
+        free(posts);
+
+        return res;
 }
 
 // escape html entities
-char *html_escape_content(char *html_content) {
+char *html_escape_content(const char *html_content) {
         int content_size = 0;
-        char *html_content_copy = html_content;
+        const char *html_content_copy = html_content;
         while (*html_content_copy++) {
                 content_size++;
         }
@@ -1,23 +1,62 @@
 #ifndef HTML_H
 #define HTML_H
 
-#include "page.h"
+#include <time.h>
 
-#define _SITE_TITLE "Max's Homepage"
+#include "page.h"
+#include "site.h"
 
-#define _SITE_SOURCE_DIR            "content"
-#define _SITE_BLOCK_DIR_PATH        _SITE_SOURCE_DIR "/blocks"
 #define _SITE_STYLE_SHEET_PATH      "style.css"
-#define _SITE_MENU_STYLE_SHEET_PATH "site-menu.css"
 
-// clang-format off
-#define _SITE_HTML_FONT                                                                            \
-	"<link rel=\"preconnect\" href=\"https://fonts.googleapis.com\">\n" \
-	"<link rel=\"preconnect\" href=\"https://fonts.gstatic.com\" crossorigin>\n" \
-	"<link href=\"https://fonts.googleapis.com/css2?family=Inconsolata:wdth,wght@95.3,200..900&family=Roboto+Flex:opsz,wght@8..144,100..1000&display=swap\" rel=\"stylesheet\">\n"
-// clang-format on
+// components are split into their own stylesheets and scripts, see html_component_arr
+#define _SITE_MENU_STYLE_SHEET_PATH     "site-menu.css"
+#define _SITE_MENU_SCRIPT_PATH          "site-menu.js"
+#define _SITE_FOOTNOTE_STYLE_SHEET_PATH "site-footnote.css"
+#define _SITE_FOOTNOTE_SCRIPT_PATH      "site-footnote.js"
+#define _SITE_SEARCH_STYLE_SHEET_PATH   "site-search.css"
+#define _SITE_SEARCH_SCRIPT_PATH        "site-search.js"
+#define _SITE_POSTS_SCRIPT_PATH         "site-posts.js"
+
+// the index lists this many of the newest posts, 0 lists all of them
+#ifndef _SITE_EXT_INDEX_POSTS
+#define _SITE_EXT_INDEX_POSTS 20
+#endif
+
+// the index prefetches this many of the newest posts and prerenders them once a link is about
+// to be followed, posts prefetch their neighbours. 0 leaves out all hints
+#ifndef _SITE_EXT_PREFETCH_POSTS
+#define _SITE_EXT_PREFETCH_POSTS 4
+#endif
+
+// every year gets a page listing its posts below this dir of the output
+#define _SITE_ARCHIVE_DIR "archive"
+
+// path, title and year of every post, the index loads older posts from it
+#define _SITE_POST_DATA_PATH "posts.json"
+
+// stylesheet delivery: 0 links them, 1 inlines them, 2 inlines only the rules a page may use
+// and loads the complete sheets asynchronously
+#ifndef _SITE_EXT_INLINE_CSS
+#define _SITE_EXT_INLINE_CSS 0
+#endif
+
+// expand custom elements at build time, leaving only event handlers to the client
+#ifndef _SITE_EXT_PRERENDER
+#define _SITE_EXT_PRERENDER 1
+#endif
+
+// reuse pages rendered by earlier builds from the cache directory, which may be shared
+#ifndef _SITE_EXT_PAGE_CACHE
+#define _SITE_EXT_PAGE_CACHE 0
+#endif
+
+// bump whenever page output changes in ways the cache key doesn't cover
+#define _SITE_PAGE_CACHE_VERSION "1"
 
-#define _SITE_SCRIPT "<script src=\"script.js\" defer></script>"
+// read templates and blocks from the binary instead of the block directory, see `make embed`
+#ifndef _SITE_EXT_EMBED
+#define _SITE_EXT_EMBED 0
+#endif
 
 typedef struct {
         char *content;
@@ -27,8 +66,9 @@ typedef struct {
 } page_content;
 
 typedef struct {
-        page_content *elems[_SITE_PAGES_MAX];
+        page_content **elems;
         int len;
+        int capacity;
 } page_content_arr;
 
 typedef struct {
@@ -36,19 +76,51 @@ typedef struct {
         char *content;
 } page_block;
 
+// a page rendered up to its dates, which are left to be filled in once history is resolved
+typedef struct {
+        page_header *header;
+        const char *source_path;
+        char *plain_content;
+        char *body;
+        char output_name[_SITE_PATH_MAX];
+        const page_header *newer; // neighbours in the listing, NULL at its ends
+        const page_header *older;
+} page_draft;
+
+typedef struct {
+        page_draft *elems;
+        int len;
+        int capacity;
+} page_draft_arr;
+
 extern page_content_arr content_arr;
 
 // global template content (loaded at startup)
-extern char *site_header;
-extern char *site_footer;
+extern char *site_menu;
 
 // initialize templates
 int html_init_templates(void);
 void html_cleanup_templates(void);
 
-// create html files
-int html_create_page(page_header *, char *, char *);
+// hash what besides the page itself ends up in it, once assets and fonts are known
+void html_init_state(void);
+
+// link each post to its neighbours in the listing, in the pass sorting it. others are the
+// pages of an earlier build, which a partial build has no drafts of
+int html_link_drafts(page_draft_arr *, const page_header_arr *, const char *[], int);
+
+// create html files, drafts need neither history nor the times in their header
+int html_draft_page(page_draft *);
+int html_create_page(page_draft *);
+
+// keep the rendered content of a page for the feed, taking ownership of it
+int html_push_content(page_header *, char *);
+
+// most recent change of any page
+time_t html_last_modified(page_header_arr *);
+
+// create the index along with the archives and post data its list is split into
 int html_create_index(char *, char *, page_header_arr *, const char *[], int);
-char *html_escape_content(char *);
+char *html_escape_content(const char *);
 
 #endif // HTML_H
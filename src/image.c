@@ -0,0 +1,655 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <zlib.h>
+
+#include "asset.h"
+#include "buf.h"
+#include "image.h"
+
+static uint32_t __image_be16(const unsigned char *p) { return (uint32_t)p[0] << 8 | p[1]; }
+static uint32_t __image_le16(const unsigned char *p) { return (uint32_t)p[1] << 8 | p[0]; }
+
+static uint32_t __image_be32(const unsigned char *p) {
+        return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static uint32_t __image_le24(const unsigned char *p) {
+        return (uint32_t)p[2] << 16 | (uint32_t)p[1] << 8 | p[0];
+}
+
+static bool __image_png(const unsigned char *data, size_t len, image_size *size) {
+        // the IHDR chunk always comes first
+        if (len < 24 || memcmp(data + 12, "IHDR", 4) != 0) return false;
+        size->width = (int)__image_be32(data + 16);
+        size->height = (int)__image_be32(data + 20);
+        return true;
+}
+
+static bool __image_gif(const unsigned char *data, size_t len, image_size *size) {
+        if (len < 10) return false;
+        size->width = (int)__image_le16(data + 6);
+        size->height = (int)__image_le16(data + 8);
+        return true;
+}
+
+static bool __image_webp(const unsigned char *data, size_t len, image_size *size) {
+        if (len < 30) return false;
+
+        const unsigned char *chunk = data + 12;
+        const unsigned char *payload = data + 20;
+        if (memcmp(chunk, "VP8 ", 4) == 0) {
+                // lossy, the key frame starts with a start code followed by the size
+                if (payload[3] != 0x9d || payload[4] != 0x01 || payload[5] != 0x2a) return false;
+                size->width = (int)(__image_le16(payload + 6) & 0x3fff);
+                size->height = (int)(__image_le16(payload + 8) & 0x3fff);
+        } else if (memcmp(chunk, "VP8L", 4) == 0) {
+                // lossless, 14 bits each following the signature
+                if (payload[0] != 0x2f) return false;
+                size->width = (int)(1 + (((uint32_t)payload[2] & 0x3f) << 8 | payload[1]));
+                size->height = (int)(1 + (((uint32_t)payload[4] & 0x0f) << 10 |
+                                          (uint32_t)payload[3] << 2 | (payload[2] & 0xc0) >> 6));
+        } else if (memcmp(chunk, "VP8X", 4) == 0) {
+                // extended, the canvas size follows the flags
+                size->width = (int)(1 + __image_le24(payload + 4));
+                size->height = (int)(1 + __image_le24(payload + 7));
+        } else {
+                return false;
+        }
+
+        return true;
+}
+
+// orientations 5 to 8 turn the image by 90 degrees, browsers apply them to the intrinsic size
+static bool __image_exif_turned(const unsigned char *data, size_t len) {
+        if (len < 14 || memcmp(data, "Exif\0\0", 6) != 0) return false;
+
+        const unsigned char *tiff = data + 6;
+        size_t tiff_len = len - 6;
+        bool little = tiff[0] == 'I';
+#define __IMAGE_TIFF16(p) (little ? __image_le16(p) : __image_be16(p))
+#define __IMAGE_TIFF32(p)                                                                          \
+        (little ? __image_le16(p) | __image_le16((p) + 2) << 16                                    \
+                : __image_be32(p))
+
+        size_t ifd = __IMAGE_TIFF32(tiff + 4);
+        if (ifd + 2 > tiff_len) return false;
+
+        size_t count = __IMAGE_TIFF16(tiff + ifd);
+        for (size_t i = 0; i < count; i++) {
+                size_t entry = ifd + 2 + i * 12;
+                if (entry + 12 > tiff_len) break;
+                if (__IMAGE_TIFF16(tiff + entry) != 0x0112) continue;
+
+                uint32_t orientation = __IMAGE_TIFF16(tiff + entry + 8);
+                return orientation >= 5 && orientation <= 8;
+        }
+#undef __IMAGE_TIFF16
+#undef __IMAGE_TIFF32
+
+        return false;
+}
+
+static bool __image_jpeg(const unsigned char *data, size_t len, image_size *size) {
+        bool turned = false;
+        size_t pos = 2;
+
+        while (pos + 4 <= len) {
+                if (data[pos] != 0xff) return false;
+
+                // fill bytes and markers without a segment
+                unsigned char marker = data[pos + 1];
+                if (marker == 0xff) {
+                        pos++;
+                        continue;
+                }
+                if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd9)) {
+                        pos += 2;
+                        continue;
+                }
+
+                size_t segment = __image_be16(data + pos + 2);
+                if (segment < 2) return false;
+
+                if (marker == 0xe1 && pos + 2 + segment <= len) {
+                        turned = __image_exif_turned(data + pos + 4, segment - 2);
+                }
+
+                // start of frame, the remaining markers of its range are tables
+                if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 &&
+                    marker != 0xcc) {
+                        if (pos + 9 > len) return false;
+                        int height = (int)__image_be16(data + pos + 5);
+                        int width = (int)__image_be16(data + pos + 7);
+                        size->width = turned ? height : width;
+                        size->height = turned ? width : height;
+                        return true;
+                }
+
+                pos += 2 + segment;
+        }
+
+        return false;
+}
+
+typedef struct {
+        const char *name;
+        size_t name_len;
+        const char *value;
+        size_t value_len;
+} image_attr;
+
+// step through the attributes of a tag, starting after its name
+static bool __image_next_attr(const char **pos, const char *end, image_attr *attr) {
+        const char *p = *pos;
+        while (p < end && (isspace((unsigned char)*p) || *p == '/')) {
+                p++;
+        }
+        if (p >= end) return false;
+
+        attr->name = p;
+        do {
+                p++;
+        } while (p < end && !isspace((unsigned char)*p) && *p != '=' && *p != '/');
+        attr->name_len = (size_t)(p - attr->name);
+        attr->value = p;
+        attr->value_len = 0;
+
+        const char *value = p;
+        while (value < end && isspace((unsigned char)*value)) {
+                value++;
+        }
+        if (value < end && *value == '=') {
+                value++;
+                while (value < end && isspace((unsigned char)*value)) {
+                        value++;
+                }
+
+                if (value < end && (*value == '"' || *value == '\'')) {
+                        const char *close = memchr(value + 1, *value, (size_t)(end - value - 1));
+                        if (close == NULL) close = end;
+                        attr->value = value + 1;
+                        attr->value_len = (size_t)(close - value - 1);
+                        p = close < end ? close + 1 : end;
+                } else {
+                        attr->value = value;
+                        while (value < end && !isspace((unsigned char)*value)) {
+                                value++;
+                        }
+                        attr->value_len = (size_t)(value - attr->value);
+                        p = value;
+                }
+        }
+
+        *pos = p;
+        return true;
+}
+
+static bool __image_find_attr(const char *tag, const char *end, const char *name,
+                              image_attr *attr) {
+        const char *pos = tag;
+        while (pos < end && !isspace((unsigned char)*pos) && *pos != '/') {
+                pos++;
+        }
+
+        size_t name_len = strlen(name);
+        while (__image_next_attr(&pos, end, attr)) {
+                if (attr->name_len == name_len && strncasecmp(attr->name, name, name_len) == 0) {
+                        return true;
+                }
+        }
+
+        return false;
+}
+
+// the closing '>' of a tag, skipping over quoted values
+static const char *__image_tag_end(const char *tag, const char *limit) {
+        char quote = '\0';
+        for (const char *pos = tag; pos < limit; pos++) {
+                if (quote) {
+                        if (*pos == quote) quote = '\0';
+                } else if (*pos == '"' || *pos == '\'') {
+                        quote = *pos;
+                } else if (*pos == '>') {
+                        return pos;
+                }
+        }
+        return NULL;
+}
+
+// absolute lengths in CSS pixels, 0 for relative ones such as percentages
+static double __image_svg_length(const image_attr *attr) {
+        char value[64];
+        if (attr->value_len >= sizeof(value)) return 0;
+        snprintf(value, sizeof(value), "%.*s", (int)attr->value_len, attr->value);
+
+        char *unit = NULL;
+        double length = strtod(value, &unit);
+        return (*unit == '\0' || strcmp(unit, "px") == 0) && length > 0 ? length : 0;
+}
+
+static bool __image_svg(const char *data, size_t len, image_size *size) {
+        const char *end = data + len;
+        const char *root = NULL;
+        for (const char *pos = data; pos + 4 < end; pos++) {
+                if (strncmp(pos, "<svg", 4) == 0 && (isspace((unsigned char)pos[4]) ||
+                                                     pos[4] == '>' || pos[4] == '/')) {
+                        root = pos + 1;
+                        break;
+                }
+        }
+        const char *root_end = root ? __image_tag_end(root, end) : NULL;
+        if (root_end == NULL) return false;
+
+        image_attr attr;
+        double width = __image_find_attr(root, root_end, "width", &attr)
+                           ? __image_svg_length(&attr)
+                           : 0;
+        double height = __image_find_attr(root, root_end, "height", &attr)
+                            ? __image_svg_length(&attr)
+                            : 0;
+
+        // missing lengths follow from the aspect ratio of the view box
+        double box[4] = {0};
+        if (__image_find_attr(root, root_end, "viewBox", &attr)) {
+                char value[128];
+                snprintf(value, sizeof(value), "%.*s", (int)attr.value_len, attr.value);
+
+                char *pos = value;
+                for (int i = 0; i < 4; i++) {
+                        while (*pos == ',' || isspace((unsigned char)*pos)) {
+                                pos++;
+                        }
+                        box[i] = strtod(pos, &pos);
+                }
+        }
+
+        if (width <= 0 && height <= 0) {
+                width = box[2];
+                height = box[3];
+        } else if (height <= 0 && box[2] > 0) {
+                height = width * box[3] / box[2];
+        } else if (width <= 0 && box[3] > 0) {
+                width = height * box[2] / box[3];
+        }
+
+        size->width = (int)(width + 0.5);
+        size->height = (int)(height + 0.5);
+        return true;
+}
+
+bool image_measure(const char *name, const char *data, size_t len, image_size *size) {
+        const unsigned char *bytes = (const unsigned char *)data;
+        bool measured = false;
+
+        *size = (image_size){0};
+        if (len >= 8 && memcmp(bytes, "\x89PNG\r\n\x1a\n", 8) == 0) {
+                measured = __image_png(bytes, len, size);
+        } else if (len >= 6 && (memcmp(bytes, "GIF87a", 6) == 0 ||
+                                memcmp(bytes, "GIF89a", 6) == 0)) {
+                measured = __image_gif(bytes, len, size);
+        } else if (len >= 12 && memcmp(bytes, "RIFF", 4) == 0 &&
+                   memcmp(bytes + 8, "WEBP", 4) == 0) {
+                measured = __image_webp(bytes, len, size);
+        } else if (len >= 2 && bytes[0] == 0xff && bytes[1] == 0xd8) {
+                measured = __image_jpeg(bytes, len, size);
+        } else {
+                const char *ext = strrchr(name, '.');
+                if (ext && strcasecmp(ext, ".svg") == 0) measured = __image_svg(data, len, size);
+        }
+
+        if (!measured || size->width <= 0 || size->height <= 0) {
+                *size = (image_size){0};
+                return false;
+        }
+
+        return true;
+}
+
+// chunks changing how pixels render, all other ancillary chunks are dropped
+static bool __image_png_kept(const unsigned char *type) {
+        static const char *kept[] = {"tRNS", "gAMA", "cHRM", "sRGB", "iCCP",
+                                     "cICP", "sBIT", "acTL", "fcTL", "fdAT"};
+
+        // critical chunks start with an uppercase letter
+        if (!(type[0] & 0x20)) return true;
+        for (size_t i = 0; i < sizeof(kept) / sizeof(kept[0]); i++) {
+                if (memcmp(type, kept[i], 4) == 0) return true;
+        }
+        return false;
+}
+
+static int __image_png_chunk(text_buf *out, const unsigned char *type, const unsigned char *data,
+                             size_t len) {
+        unsigned char head[8] = {
+            (unsigned char)(len >> 24), (unsigned char)(len >> 16),
+            (unsigned char)(len >> 8),  (unsigned char)len,
+            type[0],                    type[1],
+            type[2],                    type[3],
+        };
+        uLong crc = crc32(crc32(0, type, 4), data, (uInt)len);
+        unsigned char tail[4] = {(unsigned char)(crc >> 24), (unsigned char)(crc >> 16),
+                                 (unsigned char)(crc >> 8), (unsigned char)crc};
+
+        if (buf_append(out, (const char *)head, sizeof(head)) != 0) return -1;
+        if (buf_append(out, (const char *)data, len) != 0) return -1;
+        return buf_append(out, (const char *)tail, sizeof(tail));
+}
+
+static int __image_inflate(const unsigned char *data, size_t len, text_buf *out) {
+        z_stream stream = {0};
+        if (inflateInit(&stream) != Z_OK) return -1;
+
+        stream.next_in = (Bytef *)data;
+        stream.avail_in = (uInt)len;
+
+        int res = Z_OK;
+        unsigned char chunk[16384];
+        while (res == Z_OK && out->len <= _SITE_IMAGE_PNG_RAW_MAX) {
+                stream.next_out = chunk;
+                stream.avail_out = sizeof(chunk);
+                res = inflate(&stream, Z_NO_FLUSH);
+                if (res != Z_OK && res != Z_STREAM_END) break;
+                if (buf_append(out, (const char *)chunk, sizeof(chunk) - stream.avail_out) != 0) {
+                        res = Z_MEM_ERROR;
+                }
+        }
+        inflateEnd(&stream);
+
+        return res == Z_STREAM_END ? 0 : -1;
+}
+
+// deflate at the highest effort, NULL if it fails
+static unsigned char *__image_deflate(const unsigned char *data, size_t len, int strategy,
+                                      size_t *deflated_len) {
+        z_stream stream = {0};
+        if (deflateInit2(&stream, 9, Z_DEFLATED, 15, 9, strategy) != Z_OK) return NULL;
+
+        uLong bound = deflateBound(&stream, (uLong)len);
+        unsigned char *deflated = malloc(bound);
+        if (deflated == NULL) {
+                deflateEnd(&stream);
+                return NULL;
+        }
+
+        stream.next_in = (Bytef *)data;
+        stream.avail_in = (uInt)len;
+        stream.next_out = deflated;
+        stream.avail_out = (uInt)bound;
+        if (deflate(&stream, Z_FINISH) != Z_STREAM_END) {
+                free(deflated);
+                deflated = NULL;
+        }
+        *deflated_len = stream.total_out;
+        deflateEnd(&stream);
+
+        return deflated;
+}
+
+static unsigned char __image_paeth(unsigned char left, unsigned char up, unsigned char up_left) {
+        int p = left + up - up_left;
+        int pa = abs(p - left);
+        int pb = abs(p - up);
+        int pc = abs(p - up_left);
+        if (pa <= pb && pa <= pc) return left;
+        return pb <= pc ? up : up_left;
+}
+
+// the value each filter type predicts a byte from
+static unsigned char __image_predict(int type, const unsigned char *line, const unsigned char *prev,
+                                     size_t i, size_t bpp) {
+        unsigned char left = i >= bpp ? line[i - bpp] : 0;
+        unsigned char up = prev ? prev[i] : 0;
+        unsigned char up_left = prev && i >= bpp ? prev[i - bpp] : 0;
+
+        switch (type) {
+        case 1:
+                return left;
+        case 2:
+                return up;
+        case 3:
+                return (unsigned char)((left + up) / 2);
+        case 4:
+                return __image_paeth(left, up, up_left);
+        default:
+                return 0;
+        }
+}
+
+// undo the filters of all scanlines in place, each is preceded by its filter type
+static int __image_unfilter(unsigned char *raw, size_t height, size_t stride, size_t bpp) {
+        for (size_t y = 0; y < height; y++) {
+                unsigned char *line = raw + y * (stride + 1);
+                const unsigned char *prev = y ? line - stride : NULL;
+                if (line[0] > 4) return -1;
+
+                for (size_t i = 0; i < stride; i++) {
+                        line[1 + i] += __image_predict(line[0], line + 1, prev, i, bpp);
+                }
+        }
+        return 0;
+}
+
+// filter with a single type, or with the one leaving the smallest sum per line for type -1
+static void __image_filter(const unsigned char *pixels, size_t height, size_t stride, size_t bpp,
+                           int type, unsigned char *filtered) {
+        for (size_t y = 0; y < height; y++) {
+                const unsigned char *line = pixels + y * (stride + 1) + 1;
+                const unsigned char *prev = y ? line - (stride + 1) : NULL;
+                unsigned char *out = filtered + y * (stride + 1);
+
+                int chosen = type;
+                unsigned long smallest = (unsigned long)-1;
+                for (int candidate = 0; type < 0 && candidate <= 4; candidate++) {
+                        unsigned long sum = 0;
+                        for (size_t i = 0; i < stride; i++) {
+                                unsigned char value =
+                                    line[i] - __image_predict(candidate, line, prev, i, bpp);
+                                sum += value < 128 ? value : 256u - value;
+                        }
+                        if (sum < smallest) {
+                                smallest = sum;
+                                chosen = candidate;
+                        }
+                }
+
+                out[0] = (unsigned char)chosen;
+                for (size_t i = 0; i < stride; i++) {
+                        out[1 + i] = line[i] - __image_predict(chosen, line, prev, i, bpp);
+                }
+        }
+}
+
+// the smallest stream of the filtered scanlines, replacing the current best
+static void __image_try(const unsigned char *filtered, size_t len, unsigned char **best,
+                        size_t *best_len) {
+        static const int strategies[] = {Z_DEFAULT_STRATEGY, Z_FILTERED};
+
+        for (size_t i = 0; i < sizeof(strategies) / sizeof(strategies[0]); i++) {
+                size_t deflated_len = 0;
+                unsigned char *deflated = __image_deflate(filtered, len, strategies[i],
+                                                          &deflated_len);
+                if (deflated && deflated_len < *best_len) {
+                        free(*best);
+                        *best = deflated;
+                        *best_len = deflated_len;
+                } else {
+                        free(deflated);
+                }
+        }
+}
+
+int image_optimize_png(const char *in, size_t len, text_buf *out) {
+        const unsigned char *data = (const unsigned char *)in;
+        text_buf idat = {0};
+        text_buf raw = {0};
+        unsigned char *pixels = NULL;
+        unsigned char *filtered = NULL;
+        unsigned char *best = NULL;
+        size_t best_len = 0;
+        int res = 0;
+
+        // anything but a well-formed PNG is kept as it is
+        if (len < 33 || memcmp(data, "\x89PNG\r\n\x1a\n", 8) != 0 ||
+            memcmp(data + 12, "IHDR", 4) != 0) {
+                goto verbatim;
+        }
+
+        for (size_t pos = 8; pos < len;) {
+                if (pos + 12 > len) goto verbatim;
+                size_t chunk_len = __image_be32(data + pos);
+                if (chunk_len > len - pos - 12) goto verbatim;
+                if (memcmp(data + pos + 4, "IDAT", 4) == 0 &&
+                    buf_append(&idat, (const char *)data + pos + 8, chunk_len) != 0) {
+                        goto error;
+                }
+                pos += chunk_len + 12;
+        }
+        if (idat.len == 0) goto verbatim;
+
+        size_t width = __image_be32(data + 16);
+        size_t height = __image_be32(data + 20);
+        unsigned depth = data[24];
+        unsigned color = data[25];
+        bool interlaced = data[28] != 0;
+        unsigned channels = color == 0 || color == 3 ? 1 : color == 2 ? 3 : color == 4 ? 2 : 4;
+
+        best = malloc(idat.len);
+        if (best == NULL) goto error;
+        memcpy(best, idat.data, idat.len);
+        best_len = idat.len;
+
+        // recompress the scanlines as they are filtered, then try filtering them anew. the
+        // passes of interlaced images are only recompressed
+        if (__image_inflate((const unsigned char *)idat.data, idat.len, &raw) == 0) {
+                __image_try((const unsigned char *)raw.data, raw.len, &best, &best_len);
+
+                size_t stride = (width * channels * depth + 7) / 8;
+                size_t bpp = channels * depth / 8 ? channels * depth / 8 : 1;
+                if (!interlaced && width && height && raw.len == height * (stride + 1) &&
+                    (pixels = malloc(raw.len)) != NULL && (filtered = malloc(raw.len)) != NULL) {
+                        memcpy(pixels, raw.data, raw.len);
+                        if (__image_unfilter(pixels, height, stride, bpp) == 0) {
+                                // no filter suits palettes and low bit depths, a choice
+                                // per line suits photos
+                                static const int types[] = {0, -1};
+                                for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+                                        __image_filter(pixels, height, stride, bpp, types[i],
+                                                       filtered);
+                                        __image_try(filtered, raw.len, &best, &best_len);
+                                }
+                        }
+                }
+        }
+
+        if (buf_append(out, (const char *)data, 8) != 0) goto error;
+        bool written = false;
+        for (size_t pos = 8; pos < len;) {
+                size_t chunk_len = __image_be32(data + pos);
+                const unsigned char *type = data + pos + 4;
+                pos += chunk_len + 12;
+
+                if (memcmp(type, "IDAT", 4) == 0) {
+                        if (!written && __image_png_chunk(out, type, best, best_len) != 0) {
+                                goto error;
+                        }
+                        written = true;
+                        continue;
+                }
+                if (!__image_png_kept(type)) continue;
+                if (buf_append(out, (const char *)type - 4, chunk_len + 12) != 0) goto error;
+        }
+
+        goto cleanup;
+
+verbatim:
+        out->len = 0;
+        res = buf_append(out, in, len);
+        goto cleanup;
+
+error:
+        res = -1;
+
+cleanup:
+        buf_free(&idat);
+        buf_free(&raw);
+        free(pixels);
+        free(filtered);
+        free(best);
+
+        return res;
+}
+
+// add what a single <img> tag is missing right before its end
+static int __image_rewrite_tag(text_buf *out, const char *tag, const char *end,
+                               const char *base, bool first) {
+        image_attr attr;
+        bool sized = __image_find_attr(tag, end, "width", &attr) ||
+                     __image_find_attr(tag, end, "height", &attr);
+
+        image_size size = {0};
+        if (!sized && __image_find_attr(tag, end, "src", &attr)) {
+                size_t path_len = 0;
+                while (path_len < attr.value_len && attr.value[path_len] != '#' &&
+                       attr.value[path_len] != '?') {
+                        path_len++;
+                }
+
+                asset *entry = asset_resolve(base, attr.value, path_len);
+                if (entry && asset_image_size(entry, &size)) {
+                        int res = buf_printf(out, " width=\"%d\" height=\"%d\"", size.width,
+                                             size.height);
+                        if (res != 0) return -1;
+                }
+        }
+
+        // the first image is likely in view and the largest paint, it loads right away
+        if (first) return 0;
+        if (!__image_find_attr(tag, end, "loading", &attr)) {
+                if (buf_puts(out, " loading=\"lazy\"") != 0) return -1;
+        }
+        if (!__image_find_attr(tag, end, "decoding", &attr)) {
+                if (buf_puts(out, " decoding=\"async\"") != 0) return -1;
+        }
+
+        return 0;
+}
+
+char *image_rewrite_tags(const char *html, const char *base) {
+        text_buf out = {0};
+        const char *copied = html;
+        const char *limit = html + strlen(html);
+        bool first = true;
+
+        for (const char *pos = html; *pos; pos++) {
+                if (*pos != '<' || strncasecmp(pos + 1, "img", 3) != 0) continue;
+                if (!isspace((unsigned char)pos[4]) && pos[4] != '/' && pos[4] != '>') continue;
+
+                const char *end = __image_tag_end(pos + 1, limit);
+                if (end == NULL) break;
+
+                // attributes go before a self-closing slash
+                const char *insert = end;
+                if (insert > pos && insert[-1] == '/') insert--;
+
+                if (buf_append(&out, copied, (size_t)(insert - copied)) != 0) goto error;
+                if (__image_rewrite_tag(&out, pos + 1, insert, base, first) != 0) goto error;
+                first = false;
+
+                copied = insert;
+                pos = end;
+        }
+
+        if (buf_puts(&out, copied) != 0) goto error;
+
+        return buf_detach(&out);
+
+error:
+        buf_free(&out);
+        return NULL;
+}
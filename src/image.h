@@ -0,0 +1,35 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "buf.h"
+
+// give images their intrinsic size and load all but the first one lazily
+#ifndef _SITE_EXT_IMAGE_HINTS
+#define _SITE_EXT_IMAGE_HINTS 1
+#endif
+
+// bytes read from large images in search of their size
+#define _SITE_IMAGE_HEAD_MAX (512 * 1024)
+
+// PNGs decoding to more than this are only stripped of their ancillary chunks
+#define _SITE_IMAGE_PNG_RAW_MAX (64 * 1024 * 1024)
+
+typedef struct {
+        int width;
+        int height;
+} image_size;
+
+// read the size from the header of a PNG, JPEG, GIF, WebP or SVG image
+bool image_measure(const char *, const char *, size_t, image_size *);
+
+// drop ancillary chunks and deflate the image data again, trying several filters
+int image_optimize_png(const char *, size_t, text_buf *);
+
+// add width, height, loading and decoding attributes to the <img> tags referencing assets,
+// relative references are resolved against the dir of the page within the source dir
+char *image_rewrite_tags(const char *, const char *);
+
+#endif // IMAGE_H
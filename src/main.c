@@ -1,21 +1,26 @@
 #include <errno.h>
-#include <fts.h>
 #include <ftw.h>
+#include <stdbool.h>
 #include <string.h>
 
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "asset.h"
+#include "cache.h"
 #include "error.h"
 #include "feed.h"
+#include "font.h"
 #include "ghist.h"
+#include "headers.h"
 #include "html.h"
+#include "output.h"
 #include "page.h"
-
-#ifndef _SITE_EXT_TARGET_DIR
-#define _SITE_EXT_TARGET_DIR "docs"
-#endif
-
-#ifndef _SITE_EXT_GIT_DIR
-#define _SITE_EXT_GIT_DIR ".git"
-#endif
+#include "publish.h"
+#include "record.h"
+#include "scan.h"
+#include "search.h"
+#include "site.h"
 
 #define _SITE_INDEX_PATH "index.htm"
 // UNUSED #define _SITE_ABOUT_PATH "about.htm"
@@ -26,8 +31,9 @@ const char *index_excempt_arr[] = {_SITE_EXCEMPT_LIST};
 #define _SITE_EXCEMPT_LIST_COUNT (sizeof(index_excempt_arr) / sizeof(index_excempt_arr[0]))
 
 page_content_arr content_arr = {
-    .elems = {0},
+    .elems = NULL,
     .len = 0,
+    .capacity = 0,
 };
 
 tracked_file_arr tracked_arr = {
@@ -37,117 +43,170 @@ tracked_file_arr tracked_arr = {
 };
 
 // utils
-static int __copy_file(char *, char *);
-static FTS *__init_fts(char *);
 static int __create_dir(char *);
+static bool __is_source_file(const source_file *);
+static bool __is_page_file(const source_file *);
 
 // main routines
-static page_header *__process_page_file(FTSENT *);
+static int __process_assets(source_file_arr *);
+static int __process_fonts(source_file_arr *);
+static void __date_assets(void);
+static int __process_page_file(const source_file *, page_draft *);
+static int __draft_pages(source_file *, int, page_draft_arr *);
+static int __process_pages(page_draft_arr *, page_header_arr *, bool);
+static void __free_headers(page_header_arr *);
 static int __process_index_file(char *, page_header_arr *);
 
-static int __copy_file(char *from, char *to) {
-        FILE *from_file = NULL;
-        FILE *to_file = NULL;
+// command line
+typedef struct {
+        source_file *only;
+        int only_len;
+        bool commit_graph;
+        const char *sites_path;
+        char **site_names;
+        int site_names_len;
+} build_args;
+
+static int __parse_args(int, char *[], build_args *);
+static int __build(source_file *, int);
+static int __build_sites(site_config_arr *, char *[], int);
+
+static int __create_dir(char *dir_name) {
+        mode_t mode = S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
 
-        if ((from_file = fopen(from, "r")) == NULL) {
-                ERRORF(SITE_ERROR_FILE_OPEN_READ, from);
+        if (mkdir(dir_name, mode) != 0 && errno != EEXIST) {
+                ERRORF(SITE_ERROR_DIRECTORY_CREATE, dir_name);
                 return -1;
         }
 
-        if ((to_file = fopen(to, "w")) == NULL) {
-                ERRORF(SITE_ERROR_FILE_OPEN_WRITE, to);
-                fclose(from_file);
+        return 0;
+}
+
+static bool __is_source_file(const source_file *source) {
+        // hidden files are never scanned, but files need an extension
+        const char *base = strrchr(source->name, '/');
+        return strrchr(base ? base : source->name, '.') != NULL;
+}
+
+static bool __is_page_file(const source_file *source) {
+        return __is_source_file(source) && strcmp(strrchr(source->name, '.') + 1, "htm") == 0;
+}
+
+// fingerprint all non-html files before any page references them
+static int __process_assets(source_file_arr *sources) {
+        source_file **assets = NULL;
+        int len = 0;
+
+        if ((assets = malloc((sources->len + 1) * sizeof(source_file *))) == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
                 return -1;
         }
 
-        char *line = NULL;
-        size_t bufsize = 0;
-        ssize_t len = 0;
-        int res = 0;
+        // stylesheets last, once what they refer to is fingerprinted
+        for (int pass = 0; pass < 2; pass++) {
+                for (int i = 0; i < sources->len; i++) {
+                        source_file *source = &sources->elems[i];
+                        if (!__is_source_file(source) || __is_page_file(source) ||
+                            font_is_source(source)) {
+                                continue;
+                        }
 
-        while ((len = getline(&line, &bufsize, from_file)) > 0) {
-                if (fwrite(line, 1, (size_t)len, to_file) != (size_t)len) {
-                        ERRORF(SITE_ERROR_FILE_WRITE, from);
-                        res = -1;
-                        break;
+                        bool stylesheet = strcmp(strrchr(source->name, '.'), ".css") == 0;
+                        if (stylesheet == (pass == 1)) assets[len++] = source;
                 }
         }
 
-        if (len < 0 && !feof(from_file) && ferror(from_file)) {
-                ERRORF(SITE_ERROR_UNEXPECTED_EOF, from);
-                res = -1;
-        }
-
-        free(line);
-        fclose(from_file);
-        fclose(to_file);
+        int res = asset_process(assets, len);
+        free(assets);
 
         return res;
 }
 
-static int __create_dir(char *dir_name) {
-        mode_t mode = S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
+// subset vendored fonts to what every page and the menu use
+static int __process_fonts(source_file_arr *sources) {
+        source_file **fonts = NULL;
+        source_file **pages = NULL;
+        int fonts_len = 0;
+        int pages_len = 0;
+        int res = -1;
 
-        if (mkdir(dir_name, mode) != 0 && errno != EEXIST) {
-                ERRORF(SITE_ERROR_DIRECTORY_CREATE, dir_name);
-                return -1;
+        if ((fonts = malloc((sources->len + 1) * sizeof(source_file *))) == NULL ||
+            (pages = malloc((sources->len + 1) * sizeof(source_file *))) == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                goto cleanup;
         }
 
-        return 0;
+        for (int i = 0; i < sources->len; i++) {
+                source_file *source = &sources->elems[i];
+                if (__is_page_file(source)) pages[pages_len++] = source;
+                else if (font_is_source(source)) fonts[fonts_len++] = source;
+        }
+
+        res = font_process(fonts, fonts_len, pages, pages_len);
+
+cleanup:
+        free(fonts);
+        free(pages);
+
+        return res;
 }
 
-static FTS *__init_fts(char *source) {
-        FTS *ftsp = NULL;
-        char *paths[] = {(char *)source, NULL};
-        int _fts_options = FTS_COMFOLLOW | FTS_LOGICAL | FTS_NOCHDIR;
+// assets are written before history is known, their times are filled in once it is
+static void __date_assets(void) {
+        for (int i = 0; i < manifest.len; i++) {
+                asset *entry = &manifest.elems[i];
+                if (entry->output < 0) continue;
 
-        if ((ftsp = fts_open(paths, _fts_options, NULL)) == NULL) {
-                ERROR(SITE_ERROR_FTS_INIT);
-                return NULL;
-        }
+                char source_path[_SITE_CONFIG_VALUE_MAX + _SITE_PATH_MAX];
+                snprintf(source_path, sizeof(source_path), "%s/%s", site.source_dir, entry->name);
 
-        if (fts_children(ftsp, 0) == NULL) {
-                printf("No pages to convert. Aborting\n");
-                return NULL;
-        }
+                tracked_file *tracked = NULL;
+                if ((tracked = ghist_find_by_path(source_path)) == NULL) continue;
 
-        return ftsp;
+                output_meta *meta = &output_entries.elems[entry->output].meta;
+                meta->modified = tracked->mod_time ? tracked->mod_time : tracked->creat_time;
+        }
 }
 
-static page_header *__process_page_file(FTSENT *ftsentp) {
-        page_header *res = NULL;
-        char *source_path = ftsentp->fts_path;
+// parse and render a page as far as possible without its history
+static int __process_page_file(const source_file *source, page_draft *draft) {
+        int res = 0;
+        char *source_path = source->path;
         FILE *source_file = NULL;
-        tracked_file *tracked = NULL;
         page_header *header = NULL;
         char *page_content = NULL;
 
-        if ((source_file = fopen(ftsentp->fts_path, "r")) == NULL) {
+        if ((source_file = fopen(source_path, "r")) == NULL) {
                 ERRORF(SITE_ERROR_FILE_READ, source_path);
                 goto error;
         }
 
-        // convert extension to proper .html
-        char page_name[256] = "\0";
-        snprintf(page_name, sizeof(page_name), "%s", ftsentp->fts_name);
-        strlcat(page_name, "l", sizeof(page_name));
+        // the scan doesn't stat regular files
+        struct stat source_file_stat;
+        if (fstat(fileno(source_file), &source_file_stat) != 0) {
+                ERRORF(SITE_ERROR_FILE_STAT, source_path);
+                goto error;
+        }
 
-        // output path
-        char page_path[_SITE_PATH_MAX];
-        snprintf(page_path, sizeof(page_path), "%s/%s", _SITE_EXT_TARGET_DIR, page_name);
+        // paths identify pages in links, the index and the record, they can't be cut short
+        if (strlen(source->name) + 2 >= _SITE_PATH_MAX) {
+                errno = 0;
+                ERRORF(SITE_ERROR_PATH_LENGTH, source->name, _SITE_PATH_MAX - 3);
+                goto error;
+        }
+
+        // convert extension to proper .html, keeping the dir the page lives in
+        char page_name[_SITE_PATH_MAX] = "\0";
+        snprintf(page_name, sizeof(page_name), "%s", source->name);
+        strlcat(page_name, "l", sizeof(page_name));
+        snprintf(draft->output_name, sizeof(draft->output_name), "%s", page_name);
+        draft->source_path = source_path;
 
         if ((header = calloc(1, sizeof(page_header))) == NULL) {
                 ERROR(SITE_ERROR_MEMORY_ALLOCATION);
                 goto error;
         }
-        char page_href[100] = "/";
-        strcat(page_href, page_name);
-        strncpy(header->meta.path, page_href, _SITE_PATH_MAX - 1);
-
-        if ((tracked = ghist_find_by_path(source_path))) {
-                header->meta.created = tracked->creat_time;
-                header->meta.modified = tracked->mod_time;
-        }
+        snprintf(header->meta.path, _SITE_PATH_MAX, "/%s", page_name);
 
         // read content
         int header_len = -1;
@@ -155,7 +214,7 @@ static page_header *__process_page_file(FTSENT *ftsentp) {
                 ERRORF(SITE_ERROR_MISSING_HEADERS, source_path);
                 goto error;
         };
-        size_t content_size = ftsentp->fts_statp->st_size - header_len;
+        size_t content_size = source_file_stat.st_size - header_len;
         page_content = malloc(content_size + 1);
         if (page_content == NULL) {
                 ERROR(SITE_ERROR_MEMORY_ALLOCATION);
@@ -173,23 +232,129 @@ static page_header *__process_page_file(FTSENT *ftsentp) {
                 goto error;
         }
         page_content[bytes_read] = '\0';
+        draft->header = header;
+        draft->plain_content = page_content;
 
-        // create valid html file
-        if (html_create_page(header, page_content, page_path) != 0) {
+        // the dates are all that's left once this is done
+        if (html_draft_page(draft) != 0) {
                 goto error;
         };
 
-        res = header;
         header = NULL;
+        page_content = NULL;
         goto cleanup;
 
 error:
-        res = NULL;
+        res = -1;
 
 cleanup:
         if (source_file) fclose(source_file);
         if (page_content) free(page_content);
-        if (header) free(header);
+        if (header) {
+                free(header->title);
+                free(header->subtitle);
+                free(header);
+        }
+
+        return res;
+}
+
+static int __draft_pages(source_file *pages, int len, page_draft_arr *draft_arr) {
+        int res = 0;
+
+        for (int i = 0; i < len; i++) {
+                // non-html files have already been handled by the asset pipeline
+                if (!__is_page_file(&pages[i])) continue;
+
+                // ignore index for now
+                if (strcmp(pages[i].name, _SITE_INDEX_PATH) == 0) {
+                        continue;
+                }
+
+                if (draft_arr->len == draft_arr->capacity) {
+                        int capacity = draft_arr->capacity ? draft_arr->capacity * 2 : 64;
+                        void *grown = realloc(draft_arr->elems, capacity * sizeof(page_draft));
+                        if (grown == NULL) {
+                                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                                return -1;
+                        }
+                        draft_arr->elems = grown;
+                        draft_arr->capacity = capacity;
+                }
+
+                page_draft *draft = &draft_arr->elems[draft_arr->len];
+                memset(draft, 0, sizeof(page_draft));
+                if (__process_page_file(&pages[i], draft) != 0) {
+                        free(draft->body);
+                        res = -1;
+                        continue;
+                }
+                draft_arr->len++;
+        }
+
+        return res;
+}
+
+// date and write the drafted pages, handing their headers over to the index
+static void __free_headers(page_header_arr *header_arr) {
+        for (int i = 0; i < header_arr->len; i++) {
+                free((char *)header_arr->elems[i]->title);
+                free((char *)header_arr->elems[i]->subtitle);
+                free(header_arr->elems[i]);
+        }
+        free(header_arr->elems);
+        *header_arr = (page_header_arr){0};
+}
+
+// a partial build takes the neighbours of its pages from the last build
+static int __process_pages(page_draft_arr *draft_arr, page_header_arr *header_arr,
+                           bool partial) {
+        int res = 0;
+        page_header_arr others = {0};
+
+        if (draft_arr->len > header_arr->capacity) {
+                void *grown = realloc(header_arr->elems, draft_arr->len * sizeof(page_header *));
+                if (grown == NULL) {
+                        ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                        return -1;
+                }
+                header_arr->elems = grown;
+                header_arr->capacity = draft_arr->len;
+        }
+
+        for (int i = 0; i < draft_arr->len; i++) {
+                page_draft *draft = &draft_arr->elems[i];
+
+                tracked_file *tracked = NULL;
+                if ((tracked = ghist_find_by_path((char *)draft->source_path))) {
+                        draft->header->meta.created = tracked->creat_time;
+                        draft->header->meta.modified = tracked->mod_time;
+                }
+        }
+
+        if (partial && record_headers(&others) != 0) __free_headers(&others);
+        if (html_link_drafts(draft_arr, &others, index_excempt_arr, _SITE_EXCEMPT_LIST_COUNT) !=
+            0) {
+                res = -1;
+        }
+
+        for (int i = 0; i < draft_arr->len; i++) {
+                page_draft *draft = &draft_arr->elems[i];
+                page_header *header = draft->header;
+
+                int created = html_create_page(draft);
+                draft->header = NULL;
+                if (created != 0) {
+                        free(header->title);
+                        free(header->subtitle);
+                        free(header);
+                        res = -1;
+                        continue;
+                }
+
+                header_arr->elems[header_arr->len++] = header;
+        }
+        __free_headers(&others);
 
         return res;
 }
@@ -210,11 +375,9 @@ static int __process_index_file(char *index_file_path, page_header_arr *header_a
                 goto error;
         }
 
-        // output path
-        char page_path[_SITE_PATH_MAX];
+        // output name
         char *filename = strrchr(index_file_path, '/');
         filename ? filename++ : (filename = index_file_path);
-        snprintf(page_path, sizeof(page_path), "%s/%s", _SITE_EXT_TARGET_DIR, filename);
 
         size_t content_size = source_file_stat.st_size;
         if ((page_content = malloc(content_size + 1)) == NULL) {
@@ -234,7 +397,7 @@ static int __process_index_file(char *index_file_path, page_header_arr *header_a
                 goto error;
         }
         page_content[bytes_read] = '\0';
-        res = html_create_index(page_content, page_path, header_arr, index_excempt_arr,
+        res = html_create_index(page_content, filename, header_arr, index_excempt_arr,
                                 _SITE_EXCEMPT_LIST_COUNT);
         goto cleanup;
 
@@ -248,100 +411,323 @@ cleanup:
         return res;
 }
 
-int main(void) {
+// usage: main.out [--only content/<page>.htm ... | --commit-graph | --sites <config> [name ...]]
+static int __parse_args(int argc, char *argv[], build_args *args) {
+        if (argc == 1) return 0;
+
+        if (argc == 2 && strcmp(argv[1], "--commit-graph") == 0) {
+                args->commit_graph = true;
+                return 0;
+        }
+
+        if (argc >= 3 && strcmp(argv[1], "--sites") == 0) {
+                args->sites_path = argv[2];
+                args->site_names = argv + 3;
+                args->site_names_len = argc - 3;
+                return 0;
+        }
+
+        if (strcmp(argv[1], "--only") != 0 || argc == 2) {
+                fprintf(stderr,
+                        "usage: %s [--only %s/<page>.htm ... | --commit-graph | --sites <config> "
+                        "[name ...]]\n",
+                        argv[0], site.source_dir);
+                return -1;
+        }
+
+        if ((args->only = calloc(argc - 2, sizeof(source_file))) == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                return -1;
+        }
+
+        size_t dir_len = strlen(site.source_dir);
+        for (int i = 2; i < argc; i++) {
+                char *path = argv[i];
+                if (strncmp(path, "./", 2) == 0) path += 2;
+
+                // history and output names are relative to the repository
+                if (strncmp(path, site.source_dir, dir_len) != 0 || path[dir_len] != '/' ||
+                    !__is_page_file(&(source_file){.name = path})) {
+                        fprintf(stderr, "Not a page in %s/: %s\n", site.source_dir, argv[i]);
+                        free(args->only);
+                        args->only = NULL;
+                        return -1;
+                }
+
+                args->only[args->only_len++] =
+                    (source_file){.path = path, .name = path + dir_len + 1};
+        }
+
+        return 0;
+}
+
+static bool __site_selected(const site_config *config, char *names[], int names_len) {
+        for (int i = 0; i < names_len; i++) {
+                if (strcmp(config->name, names[i]) == 0) return true;
+        }
+        return names_len == 0;
+}
+
+// a batch driver: all state is global, so every site is built from a cold start by a child
+// process of its own, at most one per CPU. what sites share is the cache their assets are linked
+// through
+static int __build_sites(site_config_arr *sites, char *names[], int names_len) {
+        int failed = 0;
+        int built = 0;
+        int running = 0;
+        pid_t *pids = NULL;
+
+        for (int i = 0; i < names_len; i++) {
+                bool known = false;
+                for (int j = 0; j < sites->len; j++) {
+                        if (strcmp(sites->elems[j].name, names[i]) == 0) known = true;
+                }
+                if (!known) {
+                        fprintf(stderr, "No site named %s\n", names[i]);
+                        return -1;
+                }
+        }
+
+        if ((pids = calloc(sites->len, sizeof(pid_t))) == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                return -1;
+        }
+
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        int jobs = cpus < 1 ? 1 : cpus > _SITE_JOBS_MAX ? _SITE_JOBS_MAX : (int)cpus;
+
+        for (int i = 0; i < sites->len || running > 0;) {
+                // start sites until all jobs are busy
+                if (i < sites->len && running < jobs) {
+                        if (!__site_selected(&sites->elems[i], names, names_len)) {
+                                i++;
+                                continue;
+                        }
+
+                        fflush(stdout);
+                        fflush(stderr);
+                        if ((pids[i] = fork()) == 0) {
+                                site = sites->elems[i];
+                                if (chdir(site.root) != 0) {
+                                        ERRORF(SITE_ERROR_FILE_OPEN_READ, site.root);
+                                        exit(1);
+                                }
+                                exit(__build(NULL, 0) == 0 ? 0 : 1);
+                        }
+                        if (pids[i] < 0) {
+                                ERRORF(SITE_ERROR_SITE_BUILD, sites->elems[i].name);
+                                failed++;
+                        } else {
+                                running++;
+                        }
+                        built++;
+                        i++;
+                        continue;
+                }
+
+                int status = 0;
+                pid_t pid = wait(&status);
+                if (pid < 0) break;
+                running--;
+
+                if (WIFEXITED(status) && WEXITSTATUS(status) == 0) continue;
+                for (int j = 0; j < sites->len; j++) {
+                        if (pids[j] != pid) continue;
+                        errno = 0;
+                        ERRORF(SITE_ERROR_SITE_BUILD, sites->elems[j].name);
+                }
+                failed++;
+        }
+
+        printf("Built %d of %d sites\n", built - failed, built);
+
+        free(pids);
+
+        return failed == 0 ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
         int res = 0;
-        FTS *ftsp = NULL;
-        FTSENT *ftsentp = NULL;
+        build_args args = {0};
+
+        site_defaults(&site);
+        if (__parse_args(argc, argv, &args) != 0) return -1;
+
+        // maintenance, nothing is built
+        if (args.commit_graph) return ghist_write_commit_graph();
+
+        if (args.sites_path) {
+                site_config_arr sites = {0};
+                if (site_load(args.sites_path, &sites) == 0) {
+                        res = __build_sites(&sites, args.site_names, args.site_names_len);
+                } else {
+                        res = -1;
+                }
+                site_free(&sites);
+                return res;
+        }
+
+        return __build(args.only, args.only_len);
+}
+
+// build the current site, or only some of its pages
+static int __build(source_file *only, int only_len) {
+        int res = 0;
+        source_file_arr sources = {0};
+        const char **only_paths = NULL;
+        page_draft_arr draft_arr = {0};
 
         page_header_arr header_arr = {
-            .elems = {0},
+            .elems = NULL,
             .len = 0,
+            .capacity = 0,
         };
 
-        if (__create_dir(_SITE_EXT_TARGET_DIR) != 0) {
+        // a partial build patches the target in place, it has nothing to publish
+        bool publish = _SITE_EXT_PUBLISH && only == NULL;
+
+        if (publish) {
+                const char *staging_dir = NULL;
+                const char *previous_dir = NULL;
+                if (publish_begin(site.target_dir, &staging_dir, &previous_dir) != 0) {
+                        res = -1;
+                        return res;
+                }
+                output_init(staging_dir, previous_dir);
+        } else {
+                if (__create_dir(site.target_dir) != 0) {
+                        res = -1;
+                        return res;
+                }
+                output_init(site.target_dir, NULL);
+        }
+
+        // assets and pages are dated by their history, a partial build only needs that of its
+        // pages. it is walked while the sources are scanned, parsed and drafted
+        if (only && (only_paths = calloc(only_len, sizeof(char *))) == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
                 res = -1;
-                return res;
+                goto cleanup;
         }
+        for (int i = 0; i < only_len; i++) {
+                only_paths[i] = only[i].path;
+        }
+        ghist_start(only_paths, only_len);
 
-        if (html_init_templates() != 0) {
+        // a single scan of the whole tree serves assets and pages, blocks are templates
+        char block_dir[_SITE_CONFIG_VALUE_MAX + sizeof(_SITE_BLOCK_DIR)];
+        snprintf(block_dir, sizeof(block_dir), "%s/%s", site.source_dir, _SITE_BLOCK_DIR);
+        if (scan_sources(site.source_dir, block_dir, &sources) != 0) {
                 res = -1;
-                return res;
+                goto cleanup;
+        }
+        if (sources.len == 0) {
+                printf("No pages to convert. Aborting\n");
+                res = -1;
+                goto cleanup;
         }
 
-        if (ghist_times()) {
+        if (__process_assets(&sources) != 0) {
                 res = -1;
                 goto cleanup;
         }
 
-        if ((ftsp = __init_fts(_SITE_SOURCE_DIR)) == NULL) {
+        if (html_init_templates() != 0) {
                 res = -1;
                 goto cleanup;
         }
 
-        while ((ftsentp = fts_read(ftsp)) != NULL) {
-                // only process files at the top level
-                if (ftsentp->fts_level > 1) continue;
+        if (__process_fonts(&sources) != 0) {
+                res = -1;
+                goto cleanup;
+        }
+        html_init_state();
 
-                // we only care for plain non-hidden __files__
-                if (ftsentp->fts_info != FTS_F) continue;
-                if (ftsentp->fts_name[0] == '.') continue;
+        if (__draft_pages(only ? only : sources.elems, only ? only_len : sources.len,
+                          &draft_arr) != 0) {
+                res = -1;
+        }
 
-                char *dot = strrchr(ftsentp->fts_name, '.');
-                if (dot == NULL) continue;
-                char *ext = dot + 1;
+        if (ghist_wait() != 0) {
+                res = -1;
+                goto cleanup;
+        }
+        __date_assets();
 
-                // non-html files
-                if (strcmp(ext, "htm") != 0) {
-                        char to_path[_SITE_PATH_MAX];
-                        to_path[0] = '\0';
+        if (__process_pages(&draft_arr, &header_arr, only != NULL) != 0) res = -1;
 
-                        strlcat(to_path, _SITE_EXT_TARGET_DIR, sizeof(to_path));
-                        size_t path_len = strlen(to_path);
+        if (only) {
+                // the index and the feed list every page, the others are taken from the last build
+                int loaded = res == 0 ? record_load(&header_arr) : 0;
+                if (loaded == 1) printf("No previous build to patch. Run a full build first\n");
+                if (loaded != 0) {
+                        res = -1;
+                        goto cleanup;
+                }
+        }
 
-                        // possibly add path separator
-                        if (path_len > 0 && to_path[path_len - 1] != '/' &&
-                            path_len + 1 < sizeof(to_path)) {
-                                to_path[path_len] = '/';
-                                to_path[path_len + 1] = '\0';
-                        }
+        char index_path[_SITE_CONFIG_VALUE_MAX + sizeof(_SITE_INDEX_PATH)];
+        snprintf(index_path, sizeof(index_path), "%s/%s", site.source_dir, _SITE_INDEX_PATH);
+        if (__process_index_file(index_path, &header_arr) != 0) {
+                res = -1;
+        }
 
-                        strlcat(to_path, ftsentp->fts_name, sizeof(to_path));
+        if (create_feed("feed.atom", &header_arr) != 0) {
+                res = -1;
+        }
 
-                        __copy_file(ftsentp->fts_path, to_path);
-                        continue;
-                }
+        if (_SITE_EXT_SEARCH && search_write(&header_arr) != 0) {
+                res = -1;
+        }
 
-                // ignore index for now
-                if (strcmp(ftsentp->fts_name, _SITE_INDEX_PATH) == 0) {
-                        continue;
-                }
+        // the sidecar covers every output, a partial build takes those it didn't write and the
+        // times of the assets it didn't date from the last build
+        if (only) {
+                int loaded = res == 0 ? record_load_outputs() : 0;
+                if (loaded == 1) printf("No previous build to patch. Run a full build first\n");
+                if (loaded != 0) res = -1;
+        }
 
-                page_header *header = NULL;
-                if ((header = __process_page_file(ftsentp)) == NULL) {
-                        res = -1;
-                } else {
-                        header_arr.elems[header_arr.len] = header;
-                        header_arr.len++;
-                }
+        if (output_stamp() != 0) {
+                res = -1;
         }
 
-        if (__process_index_file(_SITE_SOURCE_DIR "/" _SITE_INDEX_PATH, &header_arr) != 0) {
+        // pages and assets gone since the last build, the target isn't emptied beforehand
+        if (only == NULL && res == 0 && record_prune_outputs() != 0) {
                 res = -1;
         }
 
-        if (create_feed(_SITE_EXT_TARGET_DIR "feed.atom", &header_arr) == 0) {
+        if (res == 0 && record_save_outputs() != 0) {
+                res = -1;
+        }
+
+        if (res == 0 && headers_write() != 0) {
+                res = -1;
+        }
+
+        if (res == 0 && record_save(&header_arr) != 0) {
                 res = -1;
         }
 
 cleanup:
         // cleanup
-        if (ftsp) fts_close(ftsp);
-        // headers
-        for (int i = 0; i < header_arr.len; i++) {
-                free((char *)header_arr.elems[i]->title);
-                free((char *)header_arr.elems[i]->subtitle);
-                free(header_arr.elems[i]);
+        ghist_wait();
+        free(only_paths);
+        scan_free(&sources);
+        // drafts, their headers are owned by the header array once written
+        for (int i = 0; i < draft_arr.len; i++) {
+                page_header *header = draft_arr.elems[i].header;
+                if (header) {
+                        free(header->title);
+                        free(header->subtitle);
+                        free(header);
+                }
+                free(draft_arr.elems[i].plain_content);
+                free(draft_arr.elems[i].body);
         }
+        free(draft_arr.elems);
+        // headers
+        __free_headers(&header_arr);
         // tracked files (renamed files are to be cleaned
         for (int i = 0; i < tracked_arr.len; i++) {
                 free(tracked_arr.files[i].file_path);
@@ -349,6 +735,21 @@ cleanup:
         free(tracked_arr.files);
 
         html_cleanup_templates();
+        font_cleanup();
+        asset_cleanup();
+
+        ghist_report();
+        output_report();
+        output_cleanup();
+        cache_evict();
+
+        free(only);
+
+        // a failed build never goes live
+        if (publish) {
+                if (res == 0 && publish_commit() != 0) res = -1;
+                if (res != 0) publish_abort();
+        }
 
         return res;
 }
@@ -0,0 +1,1022 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "minify.h"
+
+#define _SITE_MINIFY_DEPTH_MAX 64
+
+// css
+
+typedef struct {
+        bool decl_block[_SITE_MINIFY_DEPTH_MAX];
+        int depth;
+        int paren_depth;
+        bool in_value;
+        bool custom_prop;
+        bool pending_space;
+        size_t prelude_start;
+} css_state;
+
+static bool __css_is_ident(char c) {
+        return isalnum((unsigned char)c) || c == '-' || c == '_' || c == '\\' ||
+               (unsigned char)c >= 0x80;
+}
+
+static char __last(const text_buf *out) { return out->len ? out->data[out->len - 1] : '\0'; }
+
+static bool __css_in_decl(const css_state *st) {
+        return st->depth > 0 && st->decl_block[st->depth - 1];
+}
+
+static int __css_flush_space(css_state *st, text_buf *out, char next) {
+        if (!st->pending_space) return 0;
+        st->pending_space = false;
+
+        // a colon only separates a property from its value in declarations, elsewhere it may
+        // start a pseudo-class
+        char last = __last(out);
+        if (last == '\0' || strchr("{};,>(", last) || strchr("{};,>!)", next)) return 0;
+        if (last == ':' && __css_in_decl(st)) return 0;
+
+        return buf_append(out, " ", 1);
+}
+
+// at-rules whose blocks contain rules rather than declarations
+static bool __css_is_group_rule(const char *prelude, size_t len) {
+        static const char *group_rules[] = {"@media",     "@supports", "@layer",
+                                            "@container", "@document", "@scope"};
+
+        for (size_t i = 0; i < sizeof(group_rules) / sizeof(group_rules[0]); i++) {
+                size_t n = strlen(group_rules[i]);
+                if (len >= n && strncmp(prelude, group_rules[i], n) == 0) return true;
+        }
+        return false;
+}
+
+static bool __css_is_length_unit(const char *unit, size_t len) {
+        static const char *units[] = {"px", "em", "rem", "ex", "ch", "vw", "vh", "vmin", "vmax",
+                                      "cm", "mm", "in", "pt", "pc", "q"};
+
+        for (size_t i = 0; i < sizeof(units) / sizeof(units[0]); i++) {
+                if (strlen(units[i]) == len && strncasecmp(unit, units[i], len) == 0) return true;
+        }
+        return false;
+}
+
+// 0.50em -> .5em, 0px -> 0 (outside of functions and custom properties)
+static size_t __css_number(const css_state *st, const char *in, size_t len, text_buf *out) {
+        size_t i = 0;
+        bool negative = false;
+
+        if (in[i] == '+' || in[i] == '-') negative = in[i++] == '-';
+
+        size_t int_start = i;
+        while (i < len && isdigit((unsigned char)in[i])) {
+                i++;
+        }
+        size_t int_end = i;
+
+        size_t frac_start = i, frac_end = i;
+        if (i + 1 < len && in[i] == '.' && isdigit((unsigned char)in[i + 1])) {
+                frac_start = ++i;
+                while (i < len && isdigit((unsigned char)in[i])) {
+                        i++;
+                }
+                frac_end = i;
+        }
+
+        size_t unit_start = i;
+        while (i < len && (__css_is_ident(in[i]) || in[i] == '%')) {
+                i++;
+        }
+
+        // strip leading zeros of the integer and trailing zeros of the fraction
+        while (int_start < int_end && in[int_start] == '0') {
+                int_start++;
+        }
+        while (frac_end > frac_start && in[frac_end - 1] == '0') {
+                frac_end--;
+        }
+
+        bool zero = int_start == int_end && frac_start == frac_end;
+        if (zero && st->paren_depth == 0 && !st->custom_prop &&
+            __css_is_length_unit(in + unit_start, i - unit_start)) {
+                buf_append(out, "0", 1);
+                return i;
+        }
+
+        if (negative && !zero) buf_append(out, "-", 1);
+        if (zero) {
+                buf_append(out, "0", 1);
+        } else {
+                buf_append(out, in + int_start, int_end - int_start);
+                if (frac_end > frac_start) {
+                        buf_append(out, ".", 1);
+                        buf_append(out, in + frac_start, frac_end - frac_start);
+                }
+        }
+        buf_append(out, in + unit_start, i - unit_start);
+
+        return i;
+}
+
+// #AABBCC -> #abc
+static size_t __css_color(const char *in, size_t len, text_buf *out) {
+        size_t i = 1;
+        bool hex = true;
+
+        while (i < len && __css_is_ident(in[i])) {
+                if (!isxdigit((unsigned char)in[i])) hex = false;
+                i++;
+        }
+
+        size_t n = i - 1;
+        if (!hex || (n != 3 && n != 4 && n != 6 && n != 8)) {
+                buf_append(out, in, i);
+                return i;
+        }
+
+        char color[9];
+        for (size_t j = 0; j < n; j++) {
+                color[j] = (char)tolower((unsigned char)in[1 + j]);
+        }
+
+        bool shorten = n == 6 || n == 8;
+        for (size_t j = 0; shorten && j < n; j += 2) {
+                if (color[j] != color[j + 1]) shorten = false;
+        }
+        if (shorten) {
+                for (size_t j = 0; j < n / 2; j++) {
+                        color[j] = color[j * 2];
+                }
+                n /= 2;
+        }
+
+        buf_append(out, "#", 1);
+        buf_append(out, color, n);
+
+        return i;
+}
+
+static size_t __copy_quoted(const char *in, size_t len, text_buf *out) {
+        char quote = in[0];
+        size_t i = 1;
+
+        while (i < len && in[i] != quote) {
+                if (in[i] == '\\' && i + 1 < len) i++;
+                i++;
+        }
+        if (i < len) i++;
+
+        buf_append(out, in, i);
+
+        return i;
+}
+
+int minify_css(const char *in, size_t len, text_buf *out) {
+        css_state st = {0};
+        size_t i = 0;
+
+        while (i < len) {
+                char c = in[i];
+
+                // comments and whitespace
+                if (c == '/' && i + 1 < len && in[i + 1] == '*') {
+                        const char *end = strstr(in + i + 2, "*/");
+                        i = end ? (size_t)(end - in) + 2 : len;
+                        st.pending_space = true;
+                        continue;
+                }
+                if (isspace((unsigned char)c)) {
+                        st.pending_space = true;
+                        i++;
+                        continue;
+                }
+
+                // the value turns into a declaration, drop space in front of the colon
+                if (c == ':' && __css_in_decl(&st) && !st.in_value && st.paren_depth == 0) {
+                        st.pending_space = false;
+                        st.in_value = true;
+                        st.custom_prop = strncmp(out->data + st.prelude_start, "--", 2) == 0;
+                        buf_append(out, ":", 1);
+                        i++;
+                        continue;
+                }
+
+                if (strchr("{};", c)) st.pending_space = false;
+                if (__css_flush_space(&st, out, c) != 0) return -1;
+
+                // literals
+                if (c == '"' || c == '\'') {
+                        i += __copy_quoted(in + i, len - i, out);
+                        continue;
+                }
+                if (strncasecmp(in + i, "url(", 4) == 0 && !__css_is_ident(__last(out))) {
+                        const char *end = memchr(in + i, ')', len - i);
+                        size_t n = end ? (size_t)(end - (in + i)) + 1 : len - i;
+                        buf_append(out, in + i, n);
+                        i += n;
+                        continue;
+                }
+
+                // value transformations
+                if (st.in_value && c == '#') {
+                        i += __css_color(in + i, len - i, out);
+                        continue;
+                }
+                if (st.in_value && !__css_is_ident(__last(out)) && __last(out) != '#') {
+                        size_t j = i;
+                        if (in[j] == '+' || in[j] == '-') j++;
+                        if (j < len && (isdigit((unsigned char)in[j]) ||
+                                        (in[j] == '.' && j + 1 < len &&
+                                         isdigit((unsigned char)in[j + 1])))) {
+                                i += __css_number(&st, in + i, len - i, out);
+                                continue;
+                        }
+                }
+
+                switch (c) {
+                case '{': {
+                        const char *prelude = out->data ? out->data + st.prelude_start : "";
+                        bool decl = __css_in_decl(&st) ||
+                                    !__css_is_group_rule(prelude, out->len - st.prelude_start);
+                        if (st.depth < _SITE_MINIFY_DEPTH_MAX) st.decl_block[st.depth] = decl;
+                        st.depth++;
+                        st.in_value = false;
+                        buf_append(out, "{", 1);
+                        st.prelude_start = out->len;
+                        break;
+                }
+                case '}':
+                        // the last declaration needs no terminator
+                        if (__last(out) == ';') out->len--;
+                        if (st.depth > 0) st.depth--;
+                        st.in_value = false;
+                        buf_append(out, "}", 1);
+                        st.prelude_start = out->len;
+                        break;
+                case ';':
+                        if (__last(out) != ';' && __last(out) != '{') buf_append(out, ";", 1);
+                        st.in_value = false;
+                        st.prelude_start = out->len;
+                        break;
+                case '(':
+                        st.paren_depth++;
+                        buf_append(out, "(", 1);
+                        break;
+                case ')':
+                        if (st.paren_depth > 0) st.paren_depth--;
+                        buf_append(out, ")", 1);
+                        break;
+                default:
+                        buf_append(out, &c, 1);
+                }
+                i++;
+        }
+
+        return out->data || len == 0 ? 0 : -1;
+}
+
+// js
+
+typedef struct {
+        int template_braces[_SITE_MINIFY_DEPTH_MAX];
+        int template_depth;
+        int pending_space; // 1 for plain whitespace, 2 if it contained a newline
+        bool after_literal;
+        char word[16]; // trailing identifier, used to tell regular expressions from divisions
+} js_state;
+
+static bool __js_is_ident(char c) {
+        return isalnum((unsigned char)c) || c == '_' || c == '$' || (unsigned char)c >= 0x80;
+}
+
+static int __js_flush_space(js_state *st, text_buf *out, char next) {
+        int pending = st->pending_space;
+        st->pending_space = 0;
+        if (!pending) return 0;
+
+        char last = __last(out);
+        if (last == '\0') return 0;
+
+        // keep line breaks where automatic semicolon insertion could apply
+        if (pending == 2 && !strchr("{[(,;", last)) return buf_append(out, "\n", 1);
+
+        bool keep = (__js_is_ident(last) && __js_is_ident(next)) ||
+                    ((last == '+' || last == '-') && next == last) ||
+                    (last == '/' && (next == '/' || next == '*')) ||
+                    (isdigit((unsigned char)last) && next == '.');
+
+        return keep ? buf_append(out, " ", 1) : 0;
+}
+
+static bool __js_regex_allowed(const js_state *st, const text_buf *out) {
+        static const char *keywords[] = {"return", "typeof", "instanceof", "in",    "of",
+                                         "new",    "delete", "void",       "throw", "case",
+                                         "do",     "else",   "yield",      "await"};
+
+        if (st->after_literal) return false;
+
+        char last = __last(out);
+        if (last == ')' || last == ']') return false;
+        if (!__js_is_ident(last)) return true;
+
+        for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+                if (strcmp(st->word, keywords[i]) == 0) return true;
+        }
+        return false;
+}
+
+static size_t __js_regex(const char *in, size_t len, text_buf *out) {
+        size_t i = 1;
+        bool in_class = false;
+
+        while (i < len && in[i] != '\n') {
+                if (in[i] == '\\' && i + 1 < len) {
+                        i += 2;
+                        continue;
+                }
+                if (in[i] == '[') in_class = true;
+                else if (in[i] == ']') in_class = false;
+                else if (in[i] == '/' && !in_class) break;
+                i++;
+        }
+        if (i < len && in[i] == '/') i++;
+
+        // flags
+        while (i < len && __js_is_ident(in[i])) {
+                i++;
+        }
+
+        buf_append(out, in, i);
+
+        return i;
+}
+
+// copy template characters up to the closing backtick or the next substitution
+static size_t __js_template(js_state *st, const char *in, size_t len, text_buf *out) {
+        size_t i = 0;
+
+        while (i < len) {
+                if (in[i] == '\\' && i + 1 < len) {
+                        i += 2;
+                        continue;
+                }
+                if (in[i] == '`') {
+                        i++;
+                        st->after_literal = true;
+                        break;
+                }
+                if (in[i] == '$' && i + 1 < len && in[i + 1] == '{') {
+                        i += 2;
+                        if (st->template_depth < _SITE_MINIFY_DEPTH_MAX) {
+                                st->template_braces[st->template_depth] = 0;
+                        }
+                        st->template_depth++;
+                        st->after_literal = false;
+                        break;
+                }
+                i++;
+        }
+
+        buf_append(out, in, i);
+
+        return i;
+}
+
+int minify_js(const char *in, size_t len, text_buf *out) {
+        js_state st = {0};
+        size_t i = 0;
+
+        while (i < len) {
+                char c = in[i];
+
+                // comments and whitespace
+                if (c == '/' && i + 1 < len && in[i + 1] == '/') {
+                        while (i < len && in[i] != '\n') {
+                                i++;
+                        }
+                        continue;
+                }
+                if (c == '/' && i + 1 < len && in[i + 1] == '*') {
+                        const char *end = strstr(in + i + 2, "*/");
+                        size_t end_pos = end ? (size_t)(end - in) + 2 : len;
+                        bool newline = memchr(in + i, '\n', end_pos - i) != NULL;
+                        int pending = newline ? 2 : 1;
+                        if (st.pending_space < pending) st.pending_space = pending;
+                        i = end_pos;
+                        continue;
+                }
+                if (isspace((unsigned char)c)) {
+                        if (c == '\n') st.pending_space = 2;
+                        else if (!st.pending_space) st.pending_space = 1;
+                        i++;
+                        continue;
+                }
+
+                if (__js_flush_space(&st, out, c) != 0) return -1;
+
+                // literals
+                if (c == '"' || c == '\'') {
+                        i += __copy_quoted(in + i, len - i, out);
+                        st.after_literal = true;
+                        continue;
+                }
+                if (c == '`') {
+                        buf_append(out, "`", 1);
+                        i++;
+                        i += __js_template(&st, in + i, len - i, out);
+                        continue;
+                }
+                if (c == '/' && __js_regex_allowed(&st, out)) {
+                        i += __js_regex(in + i, len - i, out);
+                        st.after_literal = true;
+                        continue;
+                }
+
+                // track braces of template substitutions
+                int top = st.template_depth - 1;
+                if (top >= 0 && top < _SITE_MINIFY_DEPTH_MAX) {
+                        if (c == '{') {
+                                st.template_braces[top]++;
+                        } else if (c == '}' && st.template_braces[top]-- == 0) {
+                                st.template_depth--;
+                                buf_append(out, "}", 1);
+                                i++;
+                                i += __js_template(&st, in + i, len - i, out);
+                                continue;
+                        }
+                }
+
+                // remember the trailing word to recognize keywords
+                if (__js_is_ident(c)) {
+                        size_t n = __js_is_ident(__last(out)) && !st.after_literal
+                                       ? strlen(st.word)
+                                       : 0;
+                        if (n + 1 < sizeof(st.word)) {
+                                st.word[n] = c;
+                                st.word[n + 1] = '\0';
+                        }
+                } else {
+                        st.word[0] = '\0';
+                }
+
+                st.after_literal = false;
+                buf_append(out, &c, 1);
+                i++;
+        }
+
+        // keep a final newline
+        if (out->len && __last(out) != '\n') buf_append(out, "\n", 1);
+
+        return out->data || len == 0 ? 0 : -1;
+}
+
+// html
+
+// elements around which whitespace doesn't render
+static bool __html_is_block(const char *name, size_t len) {
+        static const char *blocks[] = {
+            "address", "article", "aside",  "base",     "blockquote", "body",   "br",
+            "dd",      "details", "div",    "dl",       "dt",         "figcaption",
+            "figure",  "footer",  "form",   "h1",       "h2",         "h3",     "h4",
+            "h5",      "h6",      "head",   "header",   "hr",         "html",   "li",
+            "link",    "main",    "menu",   "meta",     "nav",        "noscript",
+            "ol",      "p",       "pre",    "section",  "summary",    "table",  "tbody",
+            "td",      "tfoot",   "th",     "thead",    "title",      "tr",     "ul",
+        };
+
+        if (len > 0 && (name[0] == '!' || name[0] == '?')) return true;
+        for (size_t i = 0; i < sizeof(blocks) / sizeof(blocks[0]); i++) {
+                if (strlen(blocks[i]) == len && strncasecmp(name, blocks[i], len) == 0) return true;
+        }
+        return false;
+}
+
+// elements whose content is copied verbatim
+static bool __html_is_raw(const char *name, size_t len) {
+        static const char *raws[] = {"pre", "textarea", "script", "style"};
+
+        for (size_t i = 0; i < sizeof(raws) / sizeof(raws[0]); i++) {
+                if (strlen(raws[i]) == len && strncasecmp(name, raws[i], len) == 0) return true;
+        }
+        return false;
+}
+
+// values made up of these characters are parsed the same without quotes
+static bool __html_unquotable(const char *value, size_t len) {
+        if (len == 0) return false;
+        for (size_t i = 0; i < len; i++) {
+                if (isspace((unsigned char)value[i]) || strchr("\"'=<>`", value[i])) return false;
+        }
+        return true;
+}
+
+// rewrite a complete tag with single spaces between attributes and without needless quotes
+static int __html_tag(const char *tag, size_t len, text_buf *out) {
+        // an unquoted value would swallow the slash of a self-closing tag
+        bool self_closing = len >= 2 && tag[len - 2] == '/';
+        size_t i = 1;
+
+        if (tag[i] == '/') i++;
+        while (i < len - 1 && !isspace((unsigned char)tag[i]) && tag[i] != '/' && tag[i] != '>') {
+                i++;
+        }
+        if (buf_append(out, tag, i) != 0) return -1;
+
+        while (i < len - 1) {
+                bool space = false;
+                while (i < len - 1 && isspace((unsigned char)tag[i])) {
+                        space = true;
+                        i++;
+                }
+                if (i == len - 1) break;
+                if (tag[i] == '/') {
+                        if (buf_append(out, "/", 1) != 0) return -1;
+                        i++;
+                        continue;
+                }
+
+                // attribute name
+                size_t start = i;
+                while (i < len - 1 && !isspace((unsigned char)tag[i]) && tag[i] != '=' &&
+                       tag[i] != '>' && tag[i] != '/') {
+                        i++;
+                }
+                if (space && buf_append(out, " ", 1) != 0) return -1;
+                if (buf_append(out, tag + start, i - start) != 0) return -1;
+
+                size_t after_name = i;
+                while (i < len - 1 && isspace((unsigned char)tag[i])) {
+                        i++;
+                }
+                if (tag[i] != '=') {
+                        i = after_name;
+                        continue;
+                }
+                i++;
+                while (i < len - 1 && isspace((unsigned char)tag[i])) {
+                        i++;
+                }
+
+                // attribute value
+                char quote = tag[i] == '"' || tag[i] == '\'' ? tag[i] : '\0';
+                if (quote) i++;
+                start = i;
+                while (i < len - 1 &&
+                       (quote ? tag[i] != quote : !isspace((unsigned char)tag[i]))) {
+                        i++;
+                }
+                size_t value_len = i - start;
+                if (quote && i < len - 1) i++;
+
+                if (quote && (self_closing || !__html_unquotable(tag + start, value_len))) {
+                        if (buf_append(out, "=", 1) != 0 || buf_append(out, &quote, 1) != 0 ||
+                            buf_append(out, tag + start, value_len) != 0 ||
+                            buf_append(out, &quote, 1) != 0) {
+                                return -1;
+                        }
+                } else if (buf_append(out, "=", 1) != 0 ||
+                           buf_append(out, tag + start, value_len) != 0) {
+                        return -1;
+                }
+        }
+
+        return buf_append(out, ">", 1);
+}
+
+static int __html_end_tag(minify_html_state *st, text_buf *out) {
+        const char *tag = st->tag.data;
+        size_t len = st->tag.len;
+
+        bool closing = tag[1] == '/';
+        const char *name = tag + (closing ? 2 : 1);
+        size_t name_len = 0;
+        while (name + name_len < tag + len - 1 && !isspace((unsigned char)name[name_len]) &&
+               name[name_len] != '/' && name[name_len] != '>') {
+                name_len++;
+        }
+
+        // whitespace next to a block is dropped, anywhere else it is a single space
+        bool block = __html_is_block(name, name_len);
+        if (st->pending_space && !st->after_block && !block && buf_append(out, " ", 1) != 0) {
+                return -1;
+        }
+        st->pending_space = false;
+        st->after_block = block;
+
+        if (__html_tag(tag, len, out) != 0) return -1;
+
+        st->mode = MINIFY_HTML_TEXT;
+        if (!closing && tag[len - 2] != '/' && __html_is_raw(name, name_len)) {
+                snprintf(st->raw_end, sizeof(st->raw_end), "</%.*s", (int)name_len, name);
+                for (char *p = st->raw_end; *p; p++) {
+                        *p = (char)tolower((unsigned char)*p);
+                }
+                st->raw_matched = 0;
+                st->raw_block = block;
+                st->mode = MINIFY_HTML_RAW;
+        }
+
+        return 0;
+}
+
+int minify_html(minify_html_state *st, const char *in, size_t len, text_buf *out) {
+        // leading whitespace of a document never renders
+        if (!st->started) {
+                st->after_block = true;
+                st->started = true;
+        }
+
+        for (size_t i = 0; i < len; i++) {
+                char c = in[i];
+
+                switch (st->mode) {
+                case MINIFY_HTML_TEXT:
+                        if (isspace((unsigned char)c)) {
+                                st->pending_space = true;
+                                break;
+                        }
+                        if (c == '<') {
+                                st->tag.len = 0;
+                                st->quote = '\0';
+                                if (buf_append(&st->tag, &c, 1) != 0) return -1;
+                                st->mode = MINIFY_HTML_TAG;
+                                break;
+                        }
+                        if (st->pending_space && !st->after_block &&
+                            buf_append(out, " ", 1) != 0) {
+                                return -1;
+                        }
+                        st->pending_space = false;
+                        st->after_block = false;
+                        if (buf_append(out, &c, 1) != 0) return -1;
+                        break;
+
+                case MINIFY_HTML_TAG:
+                        if (buf_append(&st->tag, &c, 1) != 0) return -1;
+
+                        // a lone less-than sign is text
+                        if (st->tag.len == 2 && !isalpha((unsigned char)c) && c != '/' &&
+                            c != '!' && c != '?') {
+                                if (st->pending_space && !st->after_block &&
+                                    buf_append(out, " ", 1) != 0) {
+                                        return -1;
+                                }
+                                st->pending_space = false;
+                                st->after_block = false;
+                                if (buf_append(out, st->tag.data, st->tag.len) != 0) return -1;
+                                st->mode = MINIFY_HTML_TEXT;
+                                break;
+                        }
+                        if (st->tag.len == 4 && strncmp(st->tag.data, "<!--", 4) == 0) {
+                                st->dashes = 0;
+                                st->mode = MINIFY_HTML_COMMENT;
+                                break;
+                        }
+
+                        if (st->quote) {
+                                if (c == st->quote) st->quote = '\0';
+                        } else if ((c == '"' || c == '\'') &&
+                                   st->tag.data[st->tag.len - 2] == '=') {
+                                st->quote = c;
+                        } else if (c == '>' && __html_end_tag(st, out) != 0) {
+                                return -1;
+                        }
+                        break;
+
+                case MINIFY_HTML_COMMENT:
+                        if (c == '>' && st->dashes >= 2) {
+                                st->mode = MINIFY_HTML_TEXT;
+                        }
+                        st->dashes = c == '-' ? st->dashes + 1 : 0;
+                        break;
+
+                case MINIFY_HTML_RAW:
+                        if (buf_append(out, &c, 1) != 0) return -1;
+
+                        if (tolower((unsigned char)c) == st->raw_end[st->raw_matched]) {
+                                st->raw_matched++;
+                        } else {
+                                st->raw_matched = c == '<' ? 1 : 0;
+                        }
+                        if (st->raw_end[st->raw_matched] == '\0') st->mode = MINIFY_HTML_RAW_END;
+                        break;
+
+                case MINIFY_HTML_RAW_END:
+                        if (buf_append(out, &c, 1) != 0) return -1;
+                        if (c == '>') {
+                                st->after_block = st->raw_block;
+                                st->mode = MINIFY_HTML_TEXT;
+                        }
+                        break;
+                }
+        }
+
+        return 0;
+}
+
+int minify_html_end(minify_html_state *st, text_buf *out) {
+        int res = 0;
+
+        // keep an unterminated tag as it was
+        if (st->mode == MINIFY_HTML_TAG) res = buf_append(out, st->tag.data, st->tag.len);
+
+        buf_free(&st->tag);
+        *st = (minify_html_state){0};
+
+        return res;
+}
+
+// svg
+
+// editors keep their state in namespaces of their own, nothing in them renders
+static bool __svg_is_editor(const char *name, size_t len) {
+        static const char *namespaces[] = {"sodipodi", "inkscape", "sketch", "rdf", "dc", "cc"};
+
+        if (len == 8 && strncmp(name, "metadata", 8) == 0) return true;
+        for (size_t i = 0; i < sizeof(namespaces) / sizeof(namespaces[0]); i++) {
+                size_t ns_len = strlen(namespaces[i]);
+                if (len > ns_len && strncmp(name, namespaces[i], ns_len) == 0 &&
+                    name[ns_len] == ':') {
+                        return true;
+                }
+                if (len == ns_len + 6 && strncmp(name, "xmlns:", 6) == 0 &&
+                    strncmp(name + 6, namespaces[i], ns_len) == 0) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+// elements whose whitespace renders
+static bool __svg_is_text(const char *name, size_t len) {
+        static const char *texts[] = {"text", "tspan", "textPath", "title", "desc", "style"};
+
+        for (size_t i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) {
+                if (strlen(texts[i]) == len && strncmp(name, texts[i], len) == 0) return true;
+        }
+        return false;
+}
+
+// a number at _SITE_EXT_SVG_PRECISION decimals without needless zeros
+static const char *__svg_number(double value, char number[64]) {
+        snprintf(number, 64, "%.*f", _SITE_EXT_SVG_PRECISION, value);
+
+        char *end = number + strlen(number);
+        if (strchr(number, '.')) {
+                while (end[-1] == '0') {
+                        *--end = '\0';
+                }
+                if (end[-1] == '.') *--end = '\0';
+        }
+
+        char *start = number;
+        if (strcmp(start, "-0") == 0) start++;
+        if (start[0] == '0' && start[1] == '.') {
+                start++;
+        } else if (start[0] == '-' && start[1] == '0' && start[2] == '.') {
+                start[1] = '-';
+                start++;
+        }
+
+        return start;
+}
+
+// round the numbers of path data or a point list, the value is kept if it doesn't parse
+static int __svg_numbers(const char *value, size_t len, bool path, text_buf *out) {
+        text_buf copy = {0};
+        text_buf numbers = {0};
+        int res = -1;
+
+        if (buf_append(&copy, value, len) != 0) goto cleanup;
+
+        const char *pos = copy.data;
+        char command = '\0';
+        int param = 0;
+        while (*pos) {
+                if (isspace((unsigned char)*pos) || *pos == ',') {
+                        pos++;
+                        continue;
+                }
+
+                if (path && isalpha((unsigned char)*pos)) {
+                        command = *pos;
+                        param = 0;
+                        if (buf_append(&numbers, pos++, 1) != 0) goto cleanup;
+                        continue;
+                }
+
+                // arc flags are single digits which may be written without separators
+                char number[64];
+                const char *formatted = NULL;
+                bool flag = (command == 'a' || command == 'A') && (param % 7 == 3 || param % 7 == 4);
+                if (flag) {
+                        if (*pos != '0' && *pos != '1') goto verbatim;
+                        formatted = *pos == '0' ? "0" : "1";
+                        pos++;
+                } else {
+                        char *end = NULL;
+                        double parsed = strtod(pos, &end);
+                        if (end == pos) goto verbatim;
+                        formatted = __svg_number(parsed, number);
+                        pos = end;
+                }
+
+                // numbers following each other need a separator unless the sign is one
+                char last = __last(&numbers);
+                if ((isdigit((unsigned char)last) || last == '.') && formatted[0] != '-') {
+                        if (buf_append(&numbers, " ", 1) != 0) goto cleanup;
+                }
+                if (buf_puts(&numbers, formatted) != 0) goto cleanup;
+                param++;
+        }
+
+        res = buf_append(out, numbers.data ? numbers.data : "", numbers.len);
+        goto cleanup;
+
+verbatim:
+        res = buf_append(out, value, len);
+
+cleanup:
+        buf_free(&copy);
+        buf_free(&numbers);
+
+        return res;
+}
+
+// rewrite a complete tag with single spaces between attributes, leaving out editor state
+static int __svg_tag(const char *tag, size_t len, size_t name_len, text_buf *out) {
+        bool self_closing = tag[len - 2] == '/';
+        size_t end = self_closing ? len - 2 : len - 1;
+        size_t i = 1 + name_len;
+
+        if (buf_append(out, tag, i) != 0) return -1;
+
+        while (i < end) {
+                while (i < end && (isspace((unsigned char)tag[i]) || tag[i] == '/')) {
+                        i++;
+                }
+                if (i == end) break;
+
+                size_t start = i;
+                while (i < end && !isspace((unsigned char)tag[i]) && tag[i] != '=') {
+                        i++;
+                }
+                const char *name = tag + start;
+                size_t attr_len = i - start;
+
+                while (i < end && isspace((unsigned char)tag[i])) {
+                        i++;
+                }
+                const char *value = NULL;
+                size_t value_len = 0;
+                char quote = '"';
+                if (i < end && tag[i] == '=') {
+                        i++;
+                        while (i < end && isspace((unsigned char)tag[i])) {
+                                i++;
+                        }
+                        if (i < end && (tag[i] == '"' || tag[i] == '\'')) quote = tag[i++];
+                        value = tag + i;
+                        while (i < end && (tag[i] != quote)) {
+                                i++;
+                        }
+                        value_len = (size_t)(tag + i - value);
+                        if (i < end) i++;
+                }
+
+                if (__svg_is_editor(name, attr_len)) continue;
+
+                if (buf_append(out, " ", 1) != 0 || buf_append(out, name, attr_len) != 0) {
+                        return -1;
+                }
+                if (value == NULL) continue;
+
+                if (buf_append(out, "=", 1) != 0 || buf_append(out, &quote, 1) != 0) return -1;
+
+                bool path = attr_len == 1 && name[0] == 'd';
+                bool points = attr_len == 6 && strncmp(name, "points", 6) == 0;
+                if (_SITE_EXT_SVG_PRECISION >= 0 && (path || points)) {
+                        if (__svg_numbers(value, value_len, path, out) != 0) return -1;
+                } else if (buf_append(out, value, value_len) != 0) {
+                        return -1;
+                }
+
+                if (buf_append(out, &quote, 1) != 0) return -1;
+        }
+
+        return buf_puts(out, self_closing ? "/>" : ">");
+}
+
+// the end of a construct starting at i, len if it is unterminated
+static size_t __svg_find(const char *in, size_t len, size_t i, const char *end) {
+        size_t end_len = strlen(end);
+        for (; i + end_len <= len; i++) {
+                if (strncmp(in + i, end, end_len) == 0) return i + end_len;
+        }
+        return len;
+}
+
+int minify_svg(const char *in, size_t len, text_buf *out) {
+        int skipped = 0;
+        int text = 0;
+        size_t i = 0;
+
+        while (i < len) {
+                size_t start = i;
+
+                if (in[i] != '<') {
+                        while (i < len && in[i] != '<') {
+                                i++;
+                        }
+
+                        // whitespace between elements doesn't render outside of text
+                        bool blank = true;
+                        for (size_t j = start; j < i; j++) {
+                                if (!isspace((unsigned char)in[j])) blank = false;
+                        }
+                        if (skipped || (blank && !text)) continue;
+                        if (buf_append(out, in + start, i - start) != 0) return -1;
+                        continue;
+                }
+
+                // comments and the XML declaration are dropped, CDATA is kept as it is
+                if (strncmp(in + i, "<!--", 4) == 0) {
+                        i = __svg_find(in, len, i + 4, "-->");
+                        continue;
+                }
+                if (strncmp(in + i, "<?", 2) == 0) {
+                        i = __svg_find(in, len, i + 2, "?>");
+                        continue;
+                }
+                if (strncmp(in + i, "<![CDATA[", 9) == 0) {
+                        i = __svg_find(in, len, i + 9, "]]>");
+                        if (!skipped && buf_append(out, in + start, i - start) != 0) return -1;
+                        continue;
+                }
+
+                // doctypes only matter when they declare entities
+                if (strncmp(in + i, "<!", 2) == 0) {
+                        size_t bracket = __svg_find(in, len, i, "[");
+                        size_t close = __svg_find(in, len, i, ">");
+                        if (bracket < close) close = __svg_find(in, len, bracket, "]>");
+                        i = close;
+                        if (bracket < close && buf_append(out, in + start, i - start) != 0) {
+                                return -1;
+                        }
+                        continue;
+                }
+
+                char quote = '\0';
+                for (i++; i < len; i++) {
+                        if (quote) {
+                                if (in[i] == quote) quote = '\0';
+                        } else if (in[i] == '"' || in[i] == '\'') {
+                                quote = in[i];
+                        } else if (in[i] == '>') {
+                                break;
+                        }
+                }
+
+                // keep an unterminated tag as it was
+                if (i == len) return buf_append(out, in + start, len - start);
+                i++;
+
+                const char *tag = in + start;
+                size_t tag_len = i - start;
+                bool closing = tag[1] == '/';
+                const char *name = tag + (closing ? 2 : 1);
+                size_t name_len = 0;
+                while (name + name_len < tag + tag_len - 1 &&
+                       !isspace((unsigned char)name[name_len]) && name[name_len] != '/' &&
+                       name[name_len] != '>') {
+                        name_len++;
+                }
+
+                if (closing) {
+                        if (skipped) {
+                                skipped--;
+                                continue;
+                        }
+                        if (text && __svg_is_text(name, name_len)) text--;
+                        if (buf_append(out, tag, tag_len) != 0) return -1;
+                        continue;
+                }
+
+                bool self_closing = tag[tag_len - 2] == '/';
+                if (skipped || __svg_is_editor(name, name_len)) {
+                        if (!self_closing) skipped++;
+                        continue;
+                }
+                if (!self_closing && __svg_is_text(name, name_len)) text++;
+
+                if (__svg_tag(tag, tag_len, name_len, out) != 0) return -1;
+        }
+
+        return out->data || len == 0 ? 0 : -1;
+}
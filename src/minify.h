@@ -0,0 +1,53 @@
+#ifndef MINIFY_H
+#define MINIFY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "buf.h"
+
+// bump whenever the output of a minifier changes to invalidate cached results
+#define _SITE_MINIFY_VERSION "2"
+
+// strip comments and whitespace, shorten colors and zeros
+int minify_css(const char *, size_t, text_buf *);
+
+// strip comments and whitespace, leaving all literals untouched
+int minify_js(const char *, size_t, text_buf *);
+
+// decimals path data and point lists are rounded to, -1 keeps them as they are
+#ifndef _SITE_EXT_SVG_PRECISION
+#define _SITE_EXT_SVG_PRECISION 3
+#endif
+
+// strip comments, editor metadata and whitespace between elements, round path data
+int minify_svg(const char *, size_t, text_buf *);
+
+typedef enum {
+        MINIFY_HTML_TEXT,
+        MINIFY_HTML_TAG,
+        MINIFY_HTML_COMMENT,
+        MINIFY_HTML_RAW,     // inside pre, textarea, script or style
+        MINIFY_HTML_RAW_END, // in the tag closing a raw element
+} minify_html_mode;
+
+// carried between the chunks of a document, only a single tag is ever held back
+typedef struct {
+        minify_html_mode mode;
+        text_buf tag;
+        char quote;
+        char raw_end[12]; // "</" and the name of the raw element
+        size_t raw_matched;
+        int dashes;
+        bool raw_block;
+        bool after_block;
+        bool pending_space;
+        bool started;
+} minify_html_state;
+
+// collapse whitespace between tags, drop comments and needless attribute quotes, leaving raw
+// elements untouched. documents may be passed in consecutive chunks of any size
+int minify_html(minify_html_state *, const char *, size_t, text_buf *);
+int minify_html_end(minify_html_state *, text_buf *);
+
+#endif // MINIFY_H
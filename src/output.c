@@ -0,0 +1,452 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "error.h"
+#include "hash.h"
+#include "minify.h"
+#include "output.h"
+#include "page.h"
+
+#define _SITE_OUTPUT_CHUNK_SIZE (16 * 1024)
+#define _SITE_OUTPUT_PATH_MAX   (_SITE_PATH_MAX * 2)
+
+output_entry_arr output_entries = {0};
+output_stats output_count = {0};
+
+// directory written to and, when publishing, the generation it replaces
+static const char *output_dir = NULL;
+static const char *output_previous_dir = NULL;
+
+void output_init(const char *dir, const char *previous_dir) {
+        output_dir = dir;
+        output_previous_dir = previous_dir;
+}
+
+static void __output_path(char *path, size_t size, const char *dir, const char *name) {
+        size_t dir_len = strlen(dir);
+        snprintf(path, size, "%s%s%s", dir, (dir_len > 0 && dir[dir_len - 1] != '/') ? "/" : "",
+                 name);
+}
+
+// create the dirs leading up to a nested output, remembering the last one as siblings tend to be
+// written in a row
+static int __output_create_dirs(const char *path, const char *name) {
+        static char created[_SITE_OUTPUT_PATH_MAX];
+        mode_t mode = S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
+
+        const char *slash = strrchr(name, '/');
+        if (slash == NULL) return 0;
+
+        char dir[_SITE_OUTPUT_PATH_MAX];
+        size_t dir_len = strlen(path) - strlen(slash);
+        snprintf(dir, sizeof(dir), "%.*s", (int)dir_len, path);
+        if (strcmp(dir, created) == 0) return 0;
+
+        // only the part below the output dir can be missing
+        for (char *p = dir + (dir_len - (size_t)(slash - name)); *p; p++) {
+                if (*p != '/') continue;
+
+                *p = '\0';
+                if (mkdir(dir, mode) != 0 && errno != EEXIST) {
+                        ERRORF(SITE_ERROR_DIRECTORY_CREATE, dir);
+                        return -1;
+                }
+                *p = '/';
+        }
+        if (mkdir(dir, mode) != 0 && errno != EEXIST) {
+                ERRORF(SITE_ERROR_DIRECTORY_CREATE, dir);
+                return -1;
+        }
+
+        snprintf(created, sizeof(created), "%s", dir);
+        return 0;
+}
+
+static int __output_hash_file(const char *path, unsigned char hash[_SITE_HASH_SIZE]) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return -1;
+
+        hash_ctx ctx;
+        char chunk[_SITE_OUTPUT_CHUNK_SIZE];
+        ssize_t n = 0;
+        hash_init(&ctx);
+        while ((n = read(fd, chunk, sizeof(chunk))) != 0) {
+                if (n < 0) {
+                        if (errno == EINTR) continue;
+                        close(fd);
+                        return -1;
+                }
+                hash_update(&ctx, chunk, (size_t)n);
+        }
+        close(fd);
+
+        hash_final(&ctx, hash);
+        return 0;
+}
+
+// compare by size first and only hash the existing file if that matches
+static bool __output_unchanged(const char *path, size_t len,
+                               const unsigned char hash[_SITE_HASH_SIZE]) {
+        struct stat st;
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode) || (size_t)st.st_size != len) {
+                return false;
+        }
+
+        unsigned char existing[_SITE_HASH_SIZE];
+        if (__output_hash_file(path, existing) != 0) return false;
+
+        return memcmp(hash, existing, _SITE_HASH_SIZE) == 0;
+}
+
+static bool __output_same_file(const char *path, const char *other_path,
+                               const unsigned char other_hash[_SITE_HASH_SIZE]) {
+        struct stat st;
+        struct stat other_st;
+
+        if (stat(path, &st) != 0 || stat(other_path, &other_st) != 0) return false;
+        if (st.st_dev == other_st.st_dev && st.st_ino == other_st.st_ino) return true;
+
+        return __output_unchanged(path, (size_t)other_st.st_size, other_hash);
+}
+
+static output_entry *__output_push(void) {
+        if (output_entries.len == output_entries.capacity) {
+                int capacity = output_entries.capacity ? output_entries.capacity * 2 : 64;
+                output_entry *grown =
+                    realloc(output_entries.elems, capacity * sizeof(output_entry));
+                if (grown == NULL) {
+                        ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                        return NULL;
+                }
+                output_entries.elems = grown;
+                output_entries.capacity = capacity;
+        }
+
+        return &output_entries.elems[output_entries.len++];
+}
+
+static int __output_record(const char *name, const output_meta *meta,
+                           const unsigned char hash[_SITE_HASH_SIZE]) {
+        output_entry *entry = NULL;
+        if ((entry = __output_push()) == NULL) return -1;
+
+        snprintf(entry->name, sizeof(entry->name), "%s", name);
+        hash_to_hex(hash, entry->hash);
+        entry->meta = *meta;
+
+        return 0;
+}
+
+int output_keep(const output_entry *kept) {
+        for (int i = 0; i < output_entries.len; i++) {
+                output_entry *entry = &output_entries.elems[i];
+                if (strcmp(entry->name, kept->name) != 0) continue;
+
+                // partial builds only walk the history of their pages
+                if (entry->meta.modified == 0 && strcmp(entry->hash, kept->hash) == 0) {
+                        entry->meta.modified = kept->meta.modified;
+                }
+                return 0;
+        }
+
+        char path[_SITE_OUTPUT_PATH_MAX];
+        struct stat st;
+        __output_path(path, sizeof(path), output_dir, kept->name);
+        if (stat(path, &st) != 0) return 0;
+
+        output_entry *entry = NULL;
+        if ((entry = __output_push()) == NULL) return -1;
+        *entry = *kept;
+
+        return 0;
+}
+
+int output_write(const char *name, const output_meta *meta, const char *data, size_t len) {
+        struct iovec iov = {.iov_base = (void *)data, .iov_len = len};
+        return output_writev(name, meta, &iov, 1);
+}
+
+static int __output_write_all(int fd, struct iovec *iov, int iov_len) {
+        // a single call unless the kernel decides to write less
+        while (iov_len > 0) {
+                ssize_t written = writev(fd, iov, iov_len);
+                if (written < 0) {
+                        if (errno == EINTR) continue;
+                        return -1;
+                }
+
+                size_t left = (size_t)written;
+                while (iov_len > 0 && left >= iov->iov_len) {
+                        left -= iov->iov_len;
+                        iov++;
+                        iov_len--;
+                }
+                if (iov_len > 0) {
+                        iov->iov_base = (char *)iov->iov_base + left;
+                        iov->iov_len -= left;
+                }
+        }
+
+        return 0;
+}
+
+// hand on what the minifier produced so far, to be hashed or written
+static int __output_drain(text_buf *out, hash_ctx *ctx, size_t *len, int fd) {
+        if (ctx) hash_update(ctx, out->data ? out->data : "", out->len);
+        if (len) *len += out->len;
+
+        struct iovec drained = {.iov_base = out->data, .iov_len = out->len};
+        if (fd >= 0 && out->len > 0 && __output_write_all(fd, &drained, 1) != 0) return -1;
+
+        out->len = 0;
+        return 0;
+}
+
+// stream the output through the minifier a chunk at a time, either to hash it or to write it
+static int __output_minify(const struct iovec *iov, int iov_len, hash_ctx *ctx, size_t *len,
+                           int fd) {
+        minify_html_state st = {0};
+        text_buf out = {0};
+        int res = 0;
+
+        for (int i = 0; i < iov_len && res == 0; i++) {
+                const char *data = iov[i].iov_base;
+                for (size_t offset = 0; offset < iov[i].iov_len && res == 0;) {
+                        size_t chunk = iov[i].iov_len - offset;
+                        if (chunk > _SITE_OUTPUT_CHUNK_SIZE) chunk = _SITE_OUTPUT_CHUNK_SIZE;
+
+                        res = minify_html(&st, data + offset, chunk, &out);
+                        if (res == 0) res = __output_drain(&out, ctx, len, fd);
+                        offset += chunk;
+                }
+        }
+
+        // also releases the state after an error
+        if (minify_html_end(&st, &out) != 0) res = -1;
+        if (res == 0) res = __output_drain(&out, ctx, len, fd);
+        buf_free(&out);
+
+        return res;
+}
+
+static int __output_writev(const char *name, const output_meta *meta, struct iovec *iov,
+                           int iov_len, bool minify) {
+        char path[_SITE_OUTPUT_PATH_MAX];
+        __output_path(path, sizeof(path), output_dir, name);
+
+        hash_ctx ctx;
+        unsigned char hash[_SITE_HASH_SIZE];
+        size_t len = 0;
+        hash_init(&ctx);
+        if (minify) {
+                if (__output_minify(iov, iov_len, &ctx, &len, -1) != 0) return -1;
+        } else {
+                for (int i = 0; i < iov_len; i++) {
+                        hash_update(&ctx, iov[i].iov_base, iov[i].iov_len);
+                        len += iov[i].iov_len;
+                }
+        }
+        hash_final(&ctx, hash);
+
+        if (__output_record(name, meta, hash) != 0) return -1;
+        if (__output_create_dirs(path, name) != 0) return -1;
+
+        if (output_previous_dir == NULL) {
+                if (__output_unchanged(path, len, hash)) {
+                        output_count.skipped++;
+                        return 0;
+                }
+        } else {
+                // share the inode with the previous generation, falling back to a copy
+                char previous_path[_SITE_OUTPUT_PATH_MAX];
+                __output_path(previous_path, sizeof(previous_path), output_previous_dir, name);
+
+                if (__output_unchanged(previous_path, len, hash) &&
+                    link(previous_path, path) == 0) {
+                        output_count.skipped++;
+                        return 0;
+                }
+        }
+
+        // replace the file instead of truncating it, its inode may be shared with the previous
+        // generation or the cache
+        char tmp_path[_SITE_OUTPUT_PATH_MAX + 32];
+        snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path, (long)getpid());
+
+        int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+                ERRORF(SITE_ERROR_FILE_CREATE, tmp_path);
+                return -1;
+        }
+
+        // the minifier runs a second time rather than holding on to the whole page
+        int res = minify ? __output_minify(iov, iov_len, NULL, NULL, fd)
+                         : __output_write_all(fd, iov, iov_len);
+        if (res != 0) {
+                ERRORF(SITE_ERROR_FILE_WRITE, tmp_path);
+                close(fd);
+                unlink(tmp_path);
+                return -1;
+        }
+
+        if (close(fd) != 0 || rename(tmp_path, path) != 0) {
+                ERRORF(SITE_ERROR_FILE_WRITE, path);
+                unlink(tmp_path);
+                return -1;
+        }
+
+        output_count.written++;
+        return 0;
+}
+
+int output_writev(const char *name, const output_meta *meta, struct iovec *iov, int iov_len) {
+        return __output_writev(name, meta, iov, iov_len, false);
+}
+
+int output_writev_html(const char *name, const output_meta *meta, struct iovec *iov,
+                       int iov_len) {
+        return __output_writev(name, meta, iov, iov_len, _SITE_EXT_MINIFY_HTML);
+}
+
+int output_link(const char *name, const output_meta *meta, const char *source_path) {
+        char path[_SITE_OUTPUT_PATH_MAX];
+        char existing_path[_SITE_OUTPUT_PATH_MAX];
+        __output_path(path, sizeof(path), output_dir, name);
+        __output_path(existing_path, sizeof(existing_path),
+                      output_previous_dir ? output_previous_dir : output_dir, name);
+
+        unsigned char hash[_SITE_HASH_SIZE];
+        if (__output_hash_file(source_path, hash) != 0) return 1;
+        if (__output_create_dirs(path, name) != 0) return -1;
+
+        // an identical file keeps its inode and mtime
+        bool unchanged = __output_same_file(existing_path, source_path, hash);
+        if (unchanged && (output_previous_dir == NULL || link(existing_path, path) == 0)) {
+                output_count.skipped++;
+                return __output_record(name, meta, hash);
+        }
+
+        char tmp_path[_SITE_OUTPUT_PATH_MAX + 32];
+        snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path, (long)getpid());
+
+        unlink(tmp_path);
+        if (link(source_path, tmp_path) != 0) return 1;
+        if (rename(tmp_path, path) != 0) {
+                unlink(tmp_path);
+                return 1;
+        }
+
+        output_count.linked++;
+        return __output_record(name, meta, hash);
+}
+
+// give a linked output an inode of its own, leaving the cache, other sites and the previous
+// generation untouched
+static int __output_unshare(const char *path) {
+        char tmp_path[_SITE_OUTPUT_PATH_MAX + 32];
+        snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path, (long)getpid());
+
+        int in = -1;
+        int out = -1;
+        if ((in = open(path, O_RDONLY)) < 0) return -1;
+        if ((out = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+                close(in);
+                return -1;
+        }
+
+        char chunk[_SITE_OUTPUT_CHUNK_SIZE];
+        ssize_t n = 0;
+        int res = 0;
+        while (res == 0 && (n = read(in, chunk, sizeof(chunk))) != 0) {
+                if (n < 0) {
+                        if (errno != EINTR) res = -1;
+                        continue;
+                }
+                struct iovec iov = {.iov_base = chunk, .iov_len = (size_t)n};
+                res = __output_write_all(out, &iov, 1);
+        }
+        close(in);
+
+        if (close(out) != 0 || res != 0 || rename(tmp_path, path) != 0) {
+                unlink(tmp_path);
+                return -1;
+        }
+
+        return 0;
+}
+
+int output_stamp(void) {
+        int res = 0;
+
+        for (int i = 0; i < output_entries.len; i++) {
+                const output_entry *entry = &output_entries.elems[i];
+                if (entry->meta.modified == 0) continue;
+
+                char path[_SITE_OUTPUT_PATH_MAX];
+                __output_path(path, sizeof(path), output_dir, entry->name);
+
+                // the same content may have another time elsewhere, e.g. in another site or branch
+                struct stat st;
+                if (stat(path, &st) != 0) {
+                        ERRORF(SITE_ERROR_FILE_STAT, path);
+                        res = -1;
+                        continue;
+                }
+                if (st.st_mtime == entry->meta.modified) continue;
+                if (st.st_nlink > 1 && __output_unshare(path) != 0) {
+                        ERRORF(SITE_ERROR_FILE_WRITE, path);
+                        res = -1;
+                        continue;
+                }
+
+                struct timespec times[2] = {{.tv_sec = 0, .tv_nsec = UTIME_OMIT},
+                                            {.tv_sec = entry->meta.modified, .tv_nsec = 0}};
+                if (utimensat(AT_FDCWD, path, times, 0) != 0) {
+                        ERRORF(SITE_ERROR_FILE_WRITE, path);
+                        res = -1;
+                }
+        }
+
+        return res;
+}
+
+int output_remove(const char *name) {
+        char path[_SITE_OUTPUT_PATH_MAX];
+        __output_path(path, sizeof(path), output_dir, name);
+        if (unlink(path) != 0 && errno != ENOENT) {
+                ERRORF(SITE_ERROR_FILE_WRITE, path);
+                return -1;
+        }
+
+        // dirs left empty go as well, up to the output dir
+        size_t dir_len = strlen(path) - strlen(name);
+        for (char *slash = strrchr(path, '/'); slash && (size_t)(slash - path) > dir_len;
+             slash = strrchr(path, '/')) {
+                *slash = '\0';
+                if (rmdir(path) != 0) break;
+        }
+
+        return 0;
+}
+
+void output_path(const char *name, char *path, size_t size) {
+        __output_path(path, size, output_dir, name);
+}
+
+void output_report(void) {
+        printf("Wrote %d files, linked %d from the cache, kept %d unchanged\n",
+               output_count.written, output_count.linked, output_count.skipped);
+}
+
+void output_cleanup(void) {
+        free(output_entries.elems);
+        output_entries = (output_entry_arr){0};
+}
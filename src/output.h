@@ -0,0 +1,81 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+#include <time.h>
+
+#include <sys/uio.h>
+
+#include "hash.h"
+#include "page.h"
+
+// pass pages through the html minifier on their way to disk
+#ifndef _SITE_EXT_MINIFY_HTML
+#define _SITE_EXT_MINIFY_HTML 1
+#endif
+
+// how long clients may use an output without revalidating it
+typedef enum {
+        OUTPUT_CACHE_REVALIDATE, // pages and feeds
+        OUTPUT_CACHE_SHORT,      // assets keeping their name
+        OUTPUT_CACHE_IMMUTABLE,  // fingerprinted assets
+} output_cache_tier;
+
+// what the server should know about an output besides its content
+typedef struct {
+        time_t modified; // 0 if unknown
+        output_cache_tier tier;
+} output_meta;
+
+typedef struct {
+        char name[_SITE_PATH_MAX];
+        char hash[_SITE_HASH_HEX_SIZE];
+        output_meta meta;
+} output_entry;
+
+typedef struct {
+        output_entry *elems;
+        int len;
+        int capacity;
+} output_entry_arr;
+
+typedef struct {
+        int written;
+        int linked;
+        int skipped;
+} output_stats;
+
+// every output of the current build
+extern output_entry_arr output_entries;
+extern output_stats output_count;
+
+// set the output directory and, when publishing, the previous generation to link from
+void output_init(const char *, const char *);
+
+// write rendered output unless the file already holds the same bytes, keeping its mtime. names
+// are relative to the output directory
+int output_write(const char *, const output_meta *, const char *, size_t);
+int output_writev(const char *, const output_meta *, struct iovec *, int);
+int output_writev_html(const char *, const output_meta *, struct iovec *, int);
+
+// hard link a file rendered earlier into place, 1 if it has to be written instead
+int output_link(const char *, const output_meta *, const char *);
+
+// list an output an earlier build left in place, unless it is gone. if this build wrote it as well
+// without knowing its time, the recorded one is taken over for the same content
+int output_keep(const output_entry *);
+
+// set the mtime of every output to its modified time, for the server to derive validators from.
+// outputs linked elsewhere are copied first
+int output_stamp(void);
+
+// remove an output of an earlier build along with the dirs it leaves empty
+int output_remove(const char *);
+
+// path of an output, which is shared and must not be modified in place
+void output_path(const char *, char *, size_t);
+
+void output_report(void);
+void output_cleanup(void);
+
+#endif // OUTPUT_H
@@ -4,8 +4,8 @@
 #include <stdint.h>
 #include <stdio.h>
 
-#define _SITE_PAGES_MAX 50
-#define _SITE_PATH_MAX  100
+// longest path of a page or asset below the source dir, nested dirs included
+#define _SITE_PATH_MAX 256
 
 typedef struct {
         char *title;
@@ -18,8 +18,9 @@ typedef struct {
 } page_header;
 
 typedef struct {
-        page_header *elems[_SITE_PAGES_MAX];
+        page_header **elems;
         int len;
+        int capacity;
 } page_header_arr;
 
 // work with page headers
@@ -0,0 +1,268 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "buf.h"
+#include "prerender.h"
+
+#define _SITE_FOOTNOTE_TAGNAME "site-footnote"
+#define _SITE_MENU_TAGNAME     "site-menu"
+
+// SiteMenu drops anything nested deeper
+#define _SITE_MENU_LEVEL_MAX 3
+
+static const char *prerender_void_tags[] = {
+    "area", "base", "br",   "col",    "embed", "hr",  "img",
+    "input", "link", "meta", "source", "track", "wbr",
+};
+#define _SITE_VOID_TAGS_COUNT (sizeof(prerender_void_tags) / sizeof(prerender_void_tags[0]))
+
+// whether the tag at p (just after '<' or "</") is the given one and not merely prefixed by it
+static bool __prerender_is_tag(const char *p, const char *tag) {
+        size_t len = strlen(tag);
+        if (strncmp(p, tag, len) != 0) return false;
+        return p[len] == '>' || p[len] == '/' || isspace((unsigned char)p[len]);
+}
+
+// start of the closing tag matching an element whose content starts at p
+static const char *__prerender_find_close(const char *p, const char *tag) {
+        int depth = 1;
+        while ((p = strchr(p, '<')) != NULL) {
+                if (p[1] == '/' && __prerender_is_tag(p + 2, tag)) {
+                        if (--depth == 0) return p;
+                } else if (__prerender_is_tag(p + 1, tag)) {
+                        depth++;
+                }
+                p++;
+        }
+
+        return NULL;
+}
+
+// value of an attribute inside an opening tag
+static bool __prerender_attr(const char *tag, size_t tag_len, const char *name, const char **value,
+                             size_t *value_len) {
+        size_t name_len = strlen(name);
+        for (size_t i = 1; i + name_len + 2 < tag_len; i++) {
+                if (!isspace((unsigned char)tag[i - 1])) continue;
+                if (strncmp(tag + i, name, name_len) != 0 || tag[i + name_len] != '=') continue;
+
+                char quote = tag[i + name_len + 1];
+                if (quote != '"' && quote != '\'') continue;
+
+                const char *start = tag + i + name_len + 2;
+                const char *end = memchr(start, quote, tag_len - (size_t)(start - tag));
+                if (end == NULL) return false;
+
+                *value = start;
+                *value_len = (size_t)(end - start);
+                return true;
+        }
+
+        return false;
+}
+
+int prerender_footnotes(const char *html, text_buf *out, text_buf *notes) {
+        const char *close_tag = "</" _SITE_FOOTNOTE_TAGNAME ">";
+        const char *p = html;
+        const char *start = NULL;
+        int number = 0;
+
+        while ((start = strstr(p, "<" _SITE_FOOTNOTE_TAGNAME)) != NULL) {
+                const char *tag_end = NULL;
+                const char *end = NULL;
+
+                if (!__prerender_is_tag(start + 1, _SITE_FOOTNOTE_TAGNAME) ||
+                    (tag_end = strchr(start, '>')) == NULL ||
+                    (end = strstr(tag_end, close_tag)) == NULL) {
+                        // not a footnote after all, copy it verbatim
+                        if (buf_append(out, p, (size_t)(start - p) + 1) != 0) return -1;
+                        p = start + 1;
+                        continue;
+                }
+
+                if (buf_append(out, p, (size_t)(start - p)) != 0) return -1;
+                p = end + strlen(close_tag);
+
+                // empty footnotes are dropped just like SiteFootnote does
+                const char *content = tag_end + 1;
+                while (content < end && isspace((unsigned char)*content)) {
+                        content++;
+                }
+                while (end > content && isspace((unsigned char)end[-1])) {
+                        end--;
+                }
+                if (content == end) continue;
+
+                number++;
+                if (number == 1 && buf_puts(notes, "<div id=\"footnotes\">\n<ol>\n") != 0) {
+                        return -1;
+                }
+
+                if (buf_printf(out,
+                               "<sup><a class=\"footnote-ref\" href=\"#footnote-%d\" "
+                               "id=\"footnote-ref-%d\">%d</a></sup>",
+                               number, number, number) != 0) {
+                        return -1;
+                }
+                if (buf_printf(notes,
+                               "<li id=\"footnote-%d\"><p>%.*s<a class=\"footnote-back\" "
+                               "href=\"#footnote-ref-%d\">" _SITE_PRERENDER_FOOTNOTE_BACK
+                               "</a></p></li>\n",
+                               number, (int)(end - content), content, number) != 0) {
+                        return -1;
+                }
+        }
+
+        if (buf_puts(out, p) != 0) return -1;
+        if (number > 0 && buf_puts(notes, "</ol>\n</div>\n") != 0) return -1;
+
+        return 0;
+}
+
+// copy a child element, adding the class SiteMenu gives to plain items
+static int __prerender_menu_item(text_buf *out, const char *tag, size_t tag_len, const char *end) {
+        const char *class_value = NULL;
+        size_t class_len = 0;
+
+        // the opening tag, possibly self-closing
+        size_t head_len = tag_len - (tag[tag_len - 2] == '/' ? 2 : 1);
+
+        if (__prerender_attr(tag, tag_len, "class", &class_value, &class_len)) {
+                size_t before = (size_t)(class_value - tag) + class_len;
+                if (buf_append(out, tag, before) != 0) return -1;
+                if (buf_puts(out, " site-menu-item") != 0) return -1;
+                return buf_append(out, tag + before, (size_t)(end - tag) - before);
+        }
+
+        if (buf_append(out, tag, head_len) != 0) return -1;
+        if (buf_puts(out, " class=\"site-menu-item\"") != 0) return -1;
+        return buf_append(out, tag + head_len, (size_t)(end - tag) - head_len);
+}
+
+static int __prerender_menu(text_buf *out, const char *tag, const char **next, int level) {
+        const char *tag_end = NULL;
+        const char *close = NULL;
+        if ((tag_end = strchr(tag, '>')) == NULL) return -1;
+        if ((close = __prerender_find_close(tag_end + 1, _SITE_MENU_TAGNAME)) == NULL) return -1;
+
+        *next = close + strlen("</" _SITE_MENU_TAGNAME ">");
+        if (level > _SITE_MENU_LEVEL_MAX) return 0;
+
+        size_t tag_len = (size_t)(tag_end - tag) + 1;
+        const char *label = NULL;
+        size_t label_len = 0;
+        if (!__prerender_attr(tag, tag_len, "label", &label, &label_len)) return -1;
+
+        const char *id = NULL;
+        size_t id_len = 0;
+        bool is_top = __prerender_attr(tag, tag_len, "id", &id, &id_len) &&
+                      id_len == strlen("site-menu-top") &&
+                      strncmp(id, "site-menu-top", id_len) == 0;
+
+        if (buf_printf(out,
+                       "%.*s data-enabled=\"true\" data-level=\"%d\" data-rendered "
+                       "style=\"--level: %d;\"><div class=\"wrapper\"><%s>",
+                       (int)(tag_len - 1), tag, level, level, is_top ? "menu" : "ul") != 0) {
+                return -1;
+        }
+
+        // every child element becomes a list item, text in between is dropped
+        const char *p = tag_end + 1;
+        while ((p = strchr(p, '<')) != NULL && p < close) {
+                if (strncmp(p, "<!--", 4) == 0) {
+                        const char *comment_end = strstr(p, "-->");
+                        if (comment_end == NULL) return -1;
+                        p = comment_end + 3;
+                        continue;
+                }
+
+                if (__prerender_is_tag(p + 1, _SITE_MENU_TAGNAME)) {
+                        text_buf sub = {0};
+                        if (__prerender_menu(&sub, p, &p, level + 1) != 0) {
+                                buf_free(&sub);
+                                return -1;
+                        }
+                        int res = sub.len ? buf_printf(out, "<li>%s</li>", sub.data) : 0;
+                        buf_free(&sub);
+                        if (res != 0) return -1;
+                        continue;
+                }
+
+                char name[32];
+                size_t name_len = 0;
+                while (isalnum((unsigned char)p[1 + name_len]) && name_len + 1 < sizeof(name)) {
+                        name[name_len] = (char)tolower((unsigned char)p[1 + name_len]);
+                        name_len++;
+                }
+                name[name_len] = '\0';
+                if (name_len == 0) return -1;
+
+                const char *child_tag_end = strchr(p, '>');
+                if (child_tag_end == NULL) return -1;
+                size_t child_tag_len = (size_t)(child_tag_end - p) + 1;
+
+                bool is_void = child_tag_end[-1] == '/';
+                for (size_t i = 0; i < _SITE_VOID_TAGS_COUNT; i++) {
+                        if (strcmp(name, prerender_void_tags[i]) == 0) is_void = true;
+                }
+
+                const char *child_end = child_tag_end + 1;
+                if (!is_void) {
+                        const char *child_close = __prerender_find_close(child_end, name);
+                        if (child_close == NULL || child_close > close) return -1;
+                        child_end = child_close + name_len + 3;
+                }
+
+                if (buf_puts(out, "<li>") != 0) return -1;
+                if (__prerender_menu_item(out, p, child_tag_len, child_end) != 0) return -1;
+                if (buf_puts(out, "</li>") != 0) return -1;
+
+                p = child_end;
+        }
+
+        if (is_top) {
+                return buf_printf(
+                    out,
+                    "</menu></div><div class=\"site-menu-control-wrap\">"
+                    "<button id=\"site-menu-control-back-btn\" class=\"site-menu-control\" "
+                    "onclick=\"window.location='/'\">Back</button>"
+                    "<button id=\"site-menu-control-top-btn\" "
+                    "class=\"site-menu-control\">Top</button>"
+                    "<button id=\"site-menu-main-toggle\" "
+                    "class=\"site-menu-control\">%.*s</button>"
+                    "</div></" _SITE_MENU_TAGNAME ">",
+                    (int)label_len, label);
+        }
+
+        return buf_printf(out,
+                          "</ul></div><button class=\"site-menu-item\">%.*s</button>"
+                          "</" _SITE_MENU_TAGNAME ">",
+                          (int)label_len, label);
+}
+
+char *prerender_menu(const char *html) {
+        text_buf out = {0};
+        const char *p = html;
+        const char *start = NULL;
+
+        while ((start = strstr(p, "<" _SITE_MENU_TAGNAME)) != NULL) {
+                if (buf_append(&out, p, (size_t)(start - p)) != 0) goto error;
+
+                if (!__prerender_is_tag(start + 1, _SITE_MENU_TAGNAME)) {
+                        if (buf_append(&out, start, 1) != 0) goto error;
+                        p = start + 1;
+                        continue;
+                }
+
+                if (__prerender_menu(&out, start, &p, 1) != 0) goto error;
+        }
+
+        if (buf_puts(&out, p) != 0) goto error;
+
+        return buf_detach(&out);
+
+error:
+        buf_free(&out);
+        return NULL;
+}
@@ -0,0 +1,17 @@
+#ifndef PRERENDER_H
+#define PRERENDER_H
+
+#include "buf.h"
+
+// links a footnote back to its reference, also the one site-footnote.js uses. fonts are subset to
+// include it
+#define _SITE_PRERENDER_FOOTNOTE_BACK "\xe2\x86\xa9"
+
+// replace <site-footnote> elements by numbered references, collecting the footnote list
+int prerender_footnotes(const char *, text_buf *, text_buf *);
+
+// expand <site-menu> elements into the markup SiteMenu would create, NULL if the menu is
+// malformed and has to be left to the client
+char *prerender_menu(const char *);
+
+#endif // PRERENDER_H
@@ -0,0 +1,224 @@
+#include <errno.h>
+#include <fts.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "error.h"
+#include "page.h"
+#include "publish.h"
+
+#define _SITE_PUBLISH_PATH_MAX (_SITE_PATH_MAX * 2)
+#define _SITE_PUBLISH_NAME_MAX 32
+
+// builds started within the same second
+#define _SITE_PUBLISH_SAME_SECOND_MAX 1000
+
+static char publish_target[_SITE_PUBLISH_PATH_MAX];
+static char publish_gen_dir[_SITE_PUBLISH_PATH_MAX];
+static char publish_name[_SITE_PUBLISH_NAME_MAX];
+static char publish_staging[_SITE_PUBLISH_PATH_MAX];
+static char publish_previous[_SITE_PUBLISH_PATH_MAX];
+
+static int __publish_remove(const char *path) {
+        int res = 0;
+        char *paths[] = {(char *)path, NULL};
+
+        FTS *ftsp = NULL;
+        if ((ftsp = fts_open(paths, FTS_PHYSICAL | FTS_NOCHDIR, NULL)) == NULL) {
+                ERRORF(SITE_ERROR_PUBLISH_PRUNE, path);
+                return -1;
+        }
+
+        FTSENT *ftsentp = NULL;
+        while ((ftsentp = fts_read(ftsp)) != NULL) {
+                switch (ftsentp->fts_info) {
+                case FTS_D:
+                        break;
+                case FTS_DP:
+                        if (rmdir(ftsentp->fts_accpath) != 0) res = -1;
+                        break;
+                default:
+                        if (unlink(ftsentp->fts_accpath) != 0) res = -1;
+                        break;
+                }
+        }
+
+        fts_close(ftsp);
+
+        if (res != 0) {
+                ERRORF(SITE_ERROR_PUBLISH_PRUNE, path);
+        }
+
+        return res;
+}
+
+static int __publish_cmp(const void *a, const void *b) {
+        // descending order (newest first)
+        return strcmp(*(char *const *)b, *(char *const *)a);
+}
+
+// generation names are timestamps followed by a counter, so everything past the newest ones
+// can go
+static int __publish_prune(void) {
+        int res = 0;
+        DIR *dir = NULL;
+        char **names = NULL;
+        int len = 0;
+        int capacity = 0;
+
+        if ((dir = opendir(publish_gen_dir)) == NULL) {
+                ERRORF(SITE_ERROR_PUBLISH_PRUNE, publish_gen_dir);
+                return -1;
+        }
+
+        struct dirent *entry = NULL;
+        while ((entry = readdir(dir)) != NULL) {
+                if (entry->d_name[0] == '.') continue;
+
+                if (len == capacity) {
+                        capacity = capacity ? capacity * 2 : 16;
+                        char **grown = realloc(names, capacity * sizeof(char *));
+                        if (grown == NULL) {
+                                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                                res = -1;
+                                goto cleanup;
+                        }
+                        names = grown;
+                }
+
+                if ((names[len] = strdup(entry->d_name)) == NULL) {
+                        ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                        res = -1;
+                        goto cleanup;
+                }
+                len++;
+        }
+
+        qsort(names, len, sizeof(char *), __publish_cmp);
+
+        // the live generation plus the ones kept for rollback
+        for (int i = _SITE_EXT_PUBLISH_KEEP + 1; i < len; i++) {
+                if (strcmp(names[i], publish_name) == 0) continue;
+
+                char path[_SITE_PUBLISH_PATH_MAX];
+                snprintf(path, sizeof(path), "%s/%s", publish_gen_dir, names[i]);
+                if (__publish_remove(path) != 0) res = -1;
+        }
+
+cleanup:
+        for (int i = 0; i < len; i++) {
+                free(names[i]);
+        }
+        free(names);
+        closedir(dir);
+
+        return res;
+}
+
+int publish_begin(const char *target, const char **staging, const char **previous) {
+        mode_t mode = S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
+
+        // the target is replaced as a whole, so it must not end with a slash
+        snprintf(publish_target, sizeof(publish_target), "%s", target);
+        size_t target_len = strlen(publish_target);
+        while (target_len > 1 && publish_target[target_len - 1] == '/') {
+                publish_target[--target_len] = '\0';
+        }
+
+        // a directory can't be replaced by a symlink in one step, which would leave the site
+        // missing in between, so an in-place build has to be moved aside by hand once
+        struct stat st = {0};
+        if (lstat(publish_target, &st) == 0 && S_ISDIR(st.st_mode)) {
+                ERRORF(SITE_ERROR_PUBLISH_TARGET, publish_target);
+                return -1;
+        }
+
+        snprintf(publish_gen_dir, sizeof(publish_gen_dir), "%s" _SITE_PUBLISH_SUFFIX,
+                 publish_target);
+        if (mkdir(publish_gen_dir, mode) != 0 && errno != EEXIST) {
+                ERRORF(SITE_ERROR_DIRECTORY_CREATE, publish_gen_dir);
+                return -1;
+        }
+
+        // timestamps sort in creation order, the counter tells builds of the same second apart
+        time_t now = time(NULL);
+        struct tm tm;
+        char stamp[_SITE_PUBLISH_NAME_MAX];
+        if (gmtime_r(&now, &tm) == NULL) return -1;
+        strftime(stamp, sizeof(stamp), "%Y%m%dT%H%M%SZ", &tm);
+
+        int created = -1;
+        for (int i = 0; i < _SITE_PUBLISH_SAME_SECOND_MAX && created != 0; i++) {
+                snprintf(publish_name, sizeof(publish_name), "%s-%03d", stamp, i);
+                snprintf(publish_staging, sizeof(publish_staging), "%s/%s", publish_gen_dir,
+                         publish_name);
+                if ((created = mkdir(publish_staging, mode)) != 0 && errno != EEXIST) break;
+        }
+        if (created != 0) {
+                ERRORF(SITE_ERROR_DIRECTORY_CREATE, publish_staging);
+                publish_staging[0] = '\0';
+                return -1;
+        }
+
+        *staging = publish_staging;
+        *previous = NULL;
+
+        // unchanged files are linked from whatever is live right now
+        if (S_ISLNK(st.st_mode)) {
+                char link[_SITE_PUBLISH_PATH_MAX];
+                ssize_t link_len = readlink(publish_target, link, sizeof(link) - 1);
+                if (link_len < 0) return 0;
+                link[link_len] = '\0';
+
+                // relative links resolve against the directory holding the target
+                const char *slash = strrchr(publish_target, '/');
+                if (link[0] == '/' || slash == NULL) {
+                        snprintf(publish_previous, sizeof(publish_previous), "%s", link);
+                } else {
+                        snprintf(publish_previous, sizeof(publish_previous), "%.*s/%s",
+                                 (int)(slash - publish_target), publish_target, link);
+                }
+                *previous = publish_previous;
+        }
+
+        return 0;
+}
+
+int publish_commit(void) {
+        char link_path[_SITE_PUBLISH_PATH_MAX];
+        char link_value[_SITE_PUBLISH_PATH_MAX];
+
+        // relative to the target's directory so the whole tree may be moved
+        const char *base = strrchr(publish_target, '/');
+        base = base ? base + 1 : publish_target;
+        snprintf(link_value, sizeof(link_value), "%s" _SITE_PUBLISH_SUFFIX "/%s", base,
+                 publish_name);
+        snprintf(link_path, sizeof(link_path), "%s.%ld.tmp", publish_target, (long)getpid());
+
+        unlink(link_path);
+        if (symlink(link_value, link_path) != 0) {
+                ERRORF(SITE_ERROR_PUBLISH_SWAP, publish_target);
+                return -1;
+        }
+
+        // replacing a symlink by rename is atomic, the target is never missing
+        if (rename(link_path, publish_target) != 0) {
+                ERRORF(SITE_ERROR_PUBLISH_SWAP, publish_target);
+                unlink(link_path);
+                return -1;
+        }
+
+        printf("Published %s\n", publish_staging);
+
+        return __publish_prune();
+}
+
+void publish_abort(void) {
+        if (publish_staging[0] != '\0') __publish_remove(publish_staging);
+}
@@ -0,0 +1,28 @@
+#ifndef PUBLISH_H
+#define PUBLISH_H
+
+// build into a new generation next to the target and switch the target over to it once the
+// build succeeded, instead of rewriting the live directory in place
+#ifndef _SITE_EXT_PUBLISH
+#define _SITE_EXT_PUBLISH 0
+#endif
+
+// previous generations kept for rollback
+#ifndef _SITE_EXT_PUBLISH_KEEP
+#define _SITE_EXT_PUBLISH_KEEP 3
+#endif
+
+// generations live in <target>.gen/<timestamp>-<counter>, the target is a symlink to one of
+// them. a target that is still a plain directory is left alone
+#define _SITE_PUBLISH_SUFFIX ".gen"
+
+// create the staging generation, returning it and the live one (if any) to link from
+int publish_begin(const char *, const char **, const char **);
+
+// atomically point the target at the staging generation and prune old generations
+int publish_commit(void);
+
+// remove the staging generation of a failed build
+void publish_abort(void);
+
+#endif // PUBLISH_H
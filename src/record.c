@@ -0,0 +1,409 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "asset.h"
+#include "buf.h"
+#include "error.h"
+#include "hash.h"
+#include "html.h"
+#include "output.h"
+#include "record.h"
+#include "site.h"
+
+// a line of "<created>\t<modified>\t<path>\t<title>\t<subtitle>" per page, the content of each
+// page is stored under the hash of its path
+#define _SITE_RECORD_PAGES "pages"
+
+// a line of "<modified>\t<tier>\t<hash>\t<name>" per output, for partial builds to list the
+// outputs they don't write
+#define _SITE_RECORD_OUTPUTS "outputs"
+
+#define _SITE_RECORD_PATH_MAX (_SITE_CONFIG_VALUE_MAX * 2)
+
+// the record describes what is in the target, so every target has one of its own
+static void __record_path(const char *key, char *path, size_t size) {
+        size_t target_len = strlen(site.target_dir);
+        while (target_len > 1 && site.target_dir[target_len - 1] == '/') target_len--;
+
+        char target[_SITE_HASH_HEX_SIZE];
+        hash_hex(site.target_dir, target_len, target);
+        snprintf(path, size, "%s/%.16s/%s", _SITE_EXT_RECORD_DIR, target, key);
+}
+
+// 1 if there is no such entry
+static int __record_get(const char *key, char **data, size_t *len) {
+        char path[_SITE_RECORD_PATH_MAX];
+        __record_path(key, path, sizeof(path));
+
+        struct stat st;
+        if (stat(path, &st) != 0) return errno == ENOENT ? 1 : -1;
+
+        return asset_read(path, data, len);
+}
+
+static int __record_put(const char *key, const char *data, size_t len) {
+        mode_t mode = S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
+        char path[_SITE_RECORD_PATH_MAX];
+        char tmp_path[_SITE_RECORD_PATH_MAX + 32];
+        FILE *file = NULL;
+
+        __record_path(key, path, sizeof(path));
+
+        char *slash = strrchr(path, '/');
+        *slash = '\0';
+        if ((mkdir(_SITE_EXT_RECORD_DIR, mode) != 0 && errno != EEXIST) ||
+            (mkdir(path, mode) != 0 && errno != EEXIST)) {
+                ERRORF(SITE_ERROR_DIRECTORY_CREATE, path);
+                return -1;
+        }
+        *slash = '/';
+
+        // replaced at once, a build that dies halfway leaves the last record intact
+        snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path, (long)getpid());
+        if ((file = fopen(tmp_path, "w")) == NULL) {
+                ERRORF(SITE_ERROR_FILE_OPEN_WRITE, tmp_path);
+                return -1;
+        }
+        if (fwrite(data, 1, len, file) != len) {
+                ERRORF(SITE_ERROR_FILE_WRITE, tmp_path);
+                fclose(file);
+                unlink(tmp_path);
+                return -1;
+        }
+        if (fclose(file) != 0 || rename(tmp_path, path) != 0) {
+                ERRORF(SITE_ERROR_FILE_WRITE, tmp_path);
+                unlink(tmp_path);
+                return -1;
+        }
+
+        return 0;
+}
+
+static const char *__record_content(const char *path) {
+        for (int i = 0; i < content_arr.len; i++) {
+                if (strcmp(content_arr.elems[i]->meta.path, path) == 0) {
+                        return content_arr.elems[i]->content;
+                }
+        }
+        return NULL;
+}
+
+int record_save(const page_header_arr *header_arr) {
+        int res = -1;
+        text_buf pages = {0};
+
+        for (int i = 0; i < header_arr->len; i++) {
+                const page_header *header = header_arr->elems[i];
+                const char *content = __record_content(header->meta.path);
+                if (content == NULL) continue;
+
+                char key[_SITE_HASH_HEX_SIZE];
+                hash_hex(header->meta.path, strlen(header->meta.path), key);
+                if (__record_put(key, content, strlen(content)) != 0) goto cleanup;
+
+                if (buf_printf(&pages, "%" PRId64 "\t%" PRId64 "\t%s\t%s\t%s\n",
+                               header->meta.created, header->meta.modified, header->meta.path,
+                               header->title, header->subtitle) != 0) {
+                        goto cleanup;
+                }
+        }
+
+        res = __record_put(_SITE_RECORD_PAGES, pages.data ? pages.data : "", pages.len);
+
+cleanup:
+        buf_free(&pages);
+
+        return res;
+}
+
+static int __record_push(page_header_arr *header_arr, page_header *header) {
+        if (header_arr->len == header_arr->capacity) {
+                int capacity = header_arr->capacity ? header_arr->capacity * 2 : 64;
+                page_header **grown = realloc(header_arr->elems, capacity * sizeof(page_header *));
+                if (grown == NULL) {
+                        ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                        return -1;
+                }
+                header_arr->elems = grown;
+                header_arr->capacity = capacity;
+        }
+
+        header_arr->elems[header_arr->len++] = header;
+
+        return 0;
+}
+
+// parse a line, splitting it in place, NULL if it is malformed
+static page_header *__record_parse(char *line) {
+        char *fields[5] = {0};
+        int len = 0;
+
+        fields[len++] = line;
+        for (char *p = line; *p && len < 5; p++) {
+                if (*p != '\t') continue;
+                *p = '\0';
+                fields[len++] = p + 1;
+        }
+        if (len < 5 || strlen(fields[2]) >= _SITE_PATH_MAX) return NULL;
+
+        page_header *header = NULL;
+        if ((header = calloc(1, sizeof(page_header))) == NULL) return NULL;
+
+        header->meta.created = strtoll(fields[0], NULL, 10);
+        header->meta.modified = strtoll(fields[1], NULL, 10);
+        snprintf(header->meta.path, sizeof(header->meta.path), "%s", fields[2]);
+        header->title = strdup(fields[3]);
+        header->subtitle = strdup(fields[4]);
+        if (header->title == NULL || header->subtitle == NULL) {
+                free(header->title);
+                free(header->subtitle);
+                free(header);
+                return NULL;
+        }
+
+        return header;
+}
+
+int record_headers(page_header_arr *header_arr) {
+        int res = 0;
+        char *pages = NULL;
+        size_t pages_len = 0;
+
+        if ((res = __record_get(_SITE_RECORD_PAGES, &pages, &pages_len)) != 0) {
+                return res;
+        }
+
+        char *line = pages;
+        while (res == 0 && line < pages + pages_len) {
+                char *newline = memchr(line, '\n', pages_len - (size_t)(line - pages));
+                if (newline == NULL) break;
+                *newline = '\0';
+
+                page_header *header = NULL;
+                if ((header = __record_parse(line)) == NULL) {
+                        res = 1;
+                        break;
+                }
+                line = newline + 1;
+
+                if ((res = __record_push(header_arr, header)) != 0) {
+                        free(header->title);
+                        free(header->subtitle);
+                        free(header);
+                }
+        }
+        free(pages);
+
+        return res;
+}
+
+int record_load(page_header_arr *header_arr) {
+        int res = 0;
+        char *pages = NULL;
+        size_t pages_len = 0;
+
+        if ((res = __record_get(_SITE_RECORD_PAGES, &pages, &pages_len)) != 0) {
+                return res;
+        }
+
+        // pages keep the order of the last build, with those rendered now in place of the
+        // recorded ones
+        page_header **rendered = header_arr->elems;
+        int rendered_len = header_arr->len;
+        *header_arr = (page_header_arr){0};
+
+        char *line = pages;
+        while (res == 0 && line < pages + pages_len) {
+                char *newline = memchr(line, '\n', pages_len - (size_t)(line - pages));
+                if (newline == NULL) break;
+                *newline = '\0';
+
+                // a damaged record is as good as none
+                page_header *header = NULL;
+                if ((header = __record_parse(line)) == NULL) {
+                        res = 1;
+                        break;
+                }
+                line = newline + 1;
+
+                int seen = -1;
+                for (int i = 0; i < rendered_len; i++) {
+                        if (rendered[i] && strcmp(rendered[i]->meta.path, header->meta.path) == 0) {
+                                seen = i;
+                        }
+                }
+
+                if (seen >= 0) {
+                        res = __record_push(header_arr, rendered[seen]);
+                        if (res == 0) rendered[seen] = NULL;
+                } else {
+                        // the feed needs the content of every page, so a missing one is as bad as
+                        // a missing record
+                        char key[_SITE_HASH_HEX_SIZE];
+                        char *content = NULL;
+                        size_t content_len = 0;
+                        hash_hex(header->meta.path, strlen(header->meta.path), key);
+                        res = __record_get(key, &content, &content_len);
+
+                        if (res == 0 && (res = __record_push(header_arr, header)) == 0) {
+                                header = NULL;
+                                res = html_push_content(header_arr->elems[header_arr->len - 1],
+                                                        content);
+                        } else if (res == 0) {
+                                free(content);
+                        }
+                }
+
+                if (header) {
+                        free(header->title);
+                        free(header->subtitle);
+                        free(header);
+                }
+        }
+
+        // pages new since the last build go last, all are handed back even after an error
+        for (int i = 0; i < rendered_len; i++) {
+                if (rendered[i] == NULL) continue;
+                if (__record_push(header_arr, rendered[i]) != 0) {
+                        free(rendered[i]->title);
+                        free(rendered[i]->subtitle);
+                        free(rendered[i]);
+                        res = -1;
+                }
+        }
+        free(rendered);
+        free(pages);
+
+        return res;
+}
+
+int record_save_outputs(void) {
+        int res = -1;
+        text_buf outputs = {0};
+
+        for (int i = 0; i < output_entries.len; i++) {
+                const output_entry *entry = &output_entries.elems[i];
+                if (buf_printf(&outputs, "%" PRId64 "\t%d\t%s\t%s\n", (int64_t)entry->meta.modified,
+                               (int)entry->meta.tier, entry->hash, entry->name) != 0) {
+                        goto cleanup;
+                }
+        }
+
+        res = __record_put(_SITE_RECORD_OUTPUTS, outputs.data ? outputs.data : "", outputs.len);
+
+cleanup:
+        buf_free(&outputs);
+
+        return res;
+}
+
+// parse a line in place, -1 if it is malformed
+static int __record_parse_output(char *line, output_entry *entry) {
+        char *fields[4] = {0};
+        int len = 0;
+
+        fields[len++] = line;
+        for (char *p = line; *p && len < 4; p++) {
+                if (*p != '\t') continue;
+                *p = '\0';
+                fields[len++] = p + 1;
+        }
+        if (len < 4 || strlen(fields[2]) + 1 != _SITE_HASH_HEX_SIZE ||
+            strlen(fields[3]) >= _SITE_PATH_MAX) {
+                return -1;
+        }
+
+        long tier = strtol(fields[1], NULL, 10);
+        if (tier < OUTPUT_CACHE_REVALIDATE || tier > OUTPUT_CACHE_IMMUTABLE) return -1;
+
+        entry->meta.modified = strtoll(fields[0], NULL, 10);
+        entry->meta.tier = (output_cache_tier)tier;
+        snprintf(entry->hash, sizeof(entry->hash), "%s", fields[2]);
+        snprintf(entry->name, sizeof(entry->name), "%s", fields[3]);
+
+        return 0;
+}
+
+static int __record_name_cmp(const void *a, const void *b) {
+        return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+int record_prune_outputs(void) {
+        int res = 0;
+        char *outputs = NULL;
+        size_t outputs_len = 0;
+        const char **names = NULL;
+
+        if ((res = __record_get(_SITE_RECORD_OUTPUTS, &outputs, &outputs_len)) != 0) {
+                return res == 1 ? 0 : res;
+        }
+
+        if ((names = malloc((output_entries.len + 1) * sizeof(char *))) == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                free(outputs);
+                return -1;
+        }
+        for (int i = 0; i < output_entries.len; i++) {
+                names[i] = output_entries.elems[i].name;
+        }
+        qsort(names, output_entries.len, sizeof(char *), __record_name_cmp);
+
+        char *line = outputs;
+        while (res == 0 && line < outputs + outputs_len) {
+                char *newline = memchr(line, '\n', outputs_len - (size_t)(line - outputs));
+                if (newline == NULL) break;
+                *newline = '\0';
+
+                // nothing is removed based on a damaged record
+                output_entry entry = {0};
+                if (__record_parse_output(line, &entry) != 0) break;
+                line = newline + 1;
+
+                const char *name = entry.name;
+                if (bsearch(&name, names, output_entries.len, sizeof(char *),
+                            __record_name_cmp) == NULL) {
+                        res = output_remove(entry.name);
+                }
+        }
+        free(names);
+        free(outputs);
+
+        return res;
+}
+
+int record_load_outputs(void) {
+        int res = 0;
+        char *outputs = NULL;
+        size_t outputs_len = 0;
+
+        if ((res = __record_get(_SITE_RECORD_OUTPUTS, &outputs, &outputs_len)) != 0) {
+                return res;
+        }
+
+        char *line = outputs;
+        while (res == 0 && line < outputs + outputs_len) {
+                char *newline = memchr(line, '\n', outputs_len - (size_t)(line - outputs));
+                if (newline == NULL) break;
+                *newline = '\0';
+
+                // a damaged record is as good as none
+                output_entry entry = {0};
+                if (__record_parse_output(line, &entry) != 0) {
+                        res = 1;
+                        break;
+                }
+                line = newline + 1;
+
+                res = output_keep(&entry);
+        }
+        free(outputs);
+
+        return res;
+}
@@ -0,0 +1,30 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include "page.h"
+
+// state of the last build into the target, kept out of the cache which is shared and evicted
+#ifndef _SITE_EXT_RECORD_DIR
+#define _SITE_EXT_RECORD_DIR ".record"
+#endif
+
+// remember the pages of a build and their content
+int record_save(const page_header_arr *);
+
+// add the pages of the last build which aren't part of this one, 1 if there is no record
+int record_load(page_header_arr *);
+
+// the headers of the last build alone, 1 if there is no record
+int record_headers(page_header_arr *);
+
+// remember the outputs of a build, to be called before the sidecar listing them is written
+int record_save_outputs(void);
+
+// remove what the last build wrote but this one didn't, as the target is updated in place
+int record_prune_outputs(void);
+
+// add the outputs of the last build which aren't part of this one and carry their times over to
+// those that are, 1 if there is no record
+int record_load_outputs(void);
+
+#endif // RECORD_H
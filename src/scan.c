@@ -0,0 +1,263 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "error.h"
+#include "scan.h"
+
+// a directory waiting to be read, relative to the scanned dir
+typedef struct {
+        char *path;
+        int depth;
+} scan_dir;
+
+// shared by all workers, directories found by one are picked up by whichever is idle
+typedef struct {
+        pthread_mutex_t lock;
+        pthread_cond_t ready;
+        scan_dir *dirs;
+        int len;
+        int capacity;
+        int busy;
+        int failed;
+        int root_fd;
+        const char *root;
+        const char *exclude;
+        source_file_arr *files;
+} scan_queue;
+
+static int __scan_push_dir(scan_queue *queue, char *path, int depth) {
+        if (queue->len == queue->capacity) {
+                int capacity = queue->capacity ? queue->capacity * 2 : 64;
+                scan_dir *grown = realloc(queue->dirs, capacity * sizeof(scan_dir));
+                if (grown == NULL) {
+                        ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                        return -1;
+                }
+                queue->dirs = grown;
+                queue->capacity = capacity;
+        }
+
+        queue->dirs[queue->len++] = (scan_dir){.path = path, .depth = depth};
+        pthread_cond_signal(&queue->ready);
+
+        return 0;
+}
+
+static int __scan_push_file(scan_queue *queue, char *name) {
+        source_file_arr *files = queue->files;
+        if (files->len == files->capacity) {
+                int capacity = files->capacity ? files->capacity * 2 : 64;
+                source_file *grown = realloc(files->elems, capacity * sizeof(source_file));
+                if (grown == NULL) {
+                        ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                        return -1;
+                }
+                files->elems = grown;
+                files->capacity = capacity;
+        }
+
+        // the full path for opening, the name points into it
+        size_t root_len = strlen(queue->root);
+        char *path = malloc(root_len + strlen(name) + 2);
+        if (path == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                return -1;
+        }
+        sprintf(path, "%s/%s", queue->root, name);
+
+        files->elems[files->len++] = (source_file){.path = path, .name = path + root_len + 1};
+
+        return 0;
+}
+
+static char *__scan_join(const char *dir, const char *name) {
+        size_t dir_len = strlen(dir);
+        char *path = malloc(dir_len + strlen(name) + 2);
+        if (path == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                return NULL;
+        }
+
+        if (dir_len > 0) sprintf(path, "%s/%s", dir, name);
+        else strcpy(path, name);
+
+        return path;
+}
+
+// read a single directory, only entries of unknown type and symlinks need a stat
+static int __scan_read_dir(scan_queue *queue, scan_dir *dir) {
+        int fd = dir->path[0] ? openat(queue->root_fd, dir->path, O_RDONLY | O_DIRECTORY)
+                              : dup(queue->root_fd);
+        if (fd < 0) {
+                ERRORF(SITE_ERROR_FILE_OPEN_READ, dir->path);
+                return -1;
+        }
+
+        DIR *dirp = fdopendir(fd);
+        if (dirp == NULL) {
+                ERRORF(SITE_ERROR_FILE_OPEN_READ, dir->path);
+                close(fd);
+                return -1;
+        }
+
+        int res = 0;
+        struct dirent *entry = NULL;
+        while (res == 0 && (entry = readdir(dirp)) != NULL) {
+                // hidden files and the dir itself
+                if (entry->d_name[0] == '.') continue;
+
+                bool is_dir = entry->d_type == DT_DIR;
+                bool is_file = entry->d_type == DT_REG;
+                if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+                        struct stat st;
+                        if (fstatat(fd, entry->d_name, &st, 0) != 0) continue;
+                        is_dir = S_ISDIR(st.st_mode);
+                        is_file = S_ISREG(st.st_mode);
+                }
+                if (!is_dir && !is_file) continue;
+
+                char *path = NULL;
+                if ((path = __scan_join(dir->path, entry->d_name)) == NULL) {
+                        res = -1;
+                        break;
+                }
+
+                pthread_mutex_lock(&queue->lock);
+                if (is_file) {
+                        res = __scan_push_file(queue, path);
+                        free(path);
+                } else if (strcmp(path, queue->exclude) == 0 ||
+                           dir->depth + 1 > _SITE_SCAN_DEPTH_MAX) {
+                        free(path);
+                } else if ((res = __scan_push_dir(queue, path, dir->depth + 1)) != 0) {
+                        free(path);
+                }
+                pthread_mutex_unlock(&queue->lock);
+        }
+
+        closedir(dirp);
+
+        return res;
+}
+
+static void *__scan_worker(void *arg) {
+        scan_queue *queue = arg;
+
+        pthread_mutex_lock(&queue->lock);
+        for (;;) {
+                // done once nothing is queued and nobody can queue anything anymore
+                while (queue->len == 0 && queue->busy > 0) {
+                        pthread_cond_wait(&queue->ready, &queue->lock);
+                }
+                if (queue->len == 0) break;
+
+                // drain the queue without reading any further once a worker failed
+                scan_dir dir = queue->dirs[--queue->len];
+                int failed = queue->failed;
+                queue->busy++;
+                pthread_mutex_unlock(&queue->lock);
+
+                int res = failed ? 0 : __scan_read_dir(queue, &dir);
+                free(dir.path);
+
+                pthread_mutex_lock(&queue->lock);
+                if (res != 0) queue->failed = 1;
+                if (--queue->busy == 0) pthread_cond_broadcast(&queue->ready);
+        }
+        pthread_mutex_unlock(&queue->lock);
+
+        return NULL;
+}
+
+static int __scan_cmp(const void *a, const void *b) {
+        return strcmp(((const source_file *)a)->name, ((const source_file *)b)->name);
+}
+
+int scan_sources(const char *root, const char *exclude, source_file_arr *files) {
+        int res = 0;
+        pthread_t threads[_SITE_SCAN_THREADS_MAX];
+        int threads_len = 0;
+
+        // the exclude is relative to the scanned dir as well
+        size_t root_len = strlen(root);
+        if (strncmp(exclude, root, root_len) == 0 && exclude[root_len] == '/') {
+                exclude += root_len + 1;
+        }
+
+        scan_queue queue = {
+            .root = root,
+            .exclude = exclude,
+            .files = files,
+        };
+
+        if ((queue.root_fd = open(root, O_RDONLY | O_DIRECTORY)) < 0) {
+                ERRORF(SITE_ERROR_FILE_OPEN_READ, root);
+                return -1;
+        }
+
+        // pushing signals the condition, so it has to exist before the first dir is queued
+        pthread_mutex_init(&queue.lock, NULL);
+        pthread_cond_init(&queue.ready, NULL);
+
+        char *top = NULL;
+        if ((top = calloc(1, 1)) == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                res = -1;
+                goto cleanup;
+        }
+        if (__scan_push_dir(&queue, top, 0) != 0) {
+                free(top);
+                res = -1;
+                goto cleanup;
+        }
+
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        int wanted = cpus < 1 ? 1 : cpus > _SITE_SCAN_THREADS_MAX ? _SITE_SCAN_THREADS_MAX
+                                                                   : (int)cpus;
+        for (int i = 0; i < wanted; i++) {
+                if (pthread_create(&threads[threads_len], NULL, __scan_worker, &queue) != 0) {
+                        break;
+                }
+                threads_len++;
+        }
+
+        // scan on this thread if none could be started
+        if (threads_len == 0) __scan_worker(&queue);
+        for (int i = 0; i < threads_len; i++) {
+                pthread_join(threads[i], NULL);
+        }
+
+        if (queue.failed) res = -1;
+
+cleanup:
+        // a scan that failed halfway may leave directories behind
+        for (int i = 0; i < queue.len; i++) {
+                free(queue.dirs[i].path);
+        }
+        free(queue.dirs);
+        pthread_cond_destroy(&queue.ready);
+        pthread_mutex_destroy(&queue.lock);
+        close(queue.root_fd);
+
+        // the order of a parallel scan is arbitrary
+        if (files->len > 1) qsort(files->elems, files->len, sizeof(source_file), __scan_cmp);
+
+        return res;
+}
+
+void scan_free(source_file_arr *files) {
+        for (int i = 0; i < files->len; i++) {
+                free(files->elems[i].path);
+        }
+        free(files->elems);
+        *files = (source_file_arr){0};
+}
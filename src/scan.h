@@ -0,0 +1,27 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+// directories are read by this many threads at most
+#define _SITE_SCAN_THREADS_MAX 8
+
+// guards against symlink cycles, which are followed like directories
+#define _SITE_SCAN_DEPTH_MAX 32
+
+typedef struct {
+        char *path;       // e.g. content/2024/post.htm
+        const char *name; // path relative to the scanned dir, e.g. 2024/post.htm
+} source_file;
+
+typedef struct {
+        source_file *elems;
+        int len;
+        int capacity;
+} source_file_arr;
+
+// collect all non-hidden files below a dir, skipping an excluded subdirectory, sorted by name
+int scan_sources(const char *, const char *, source_file_arr *);
+void scan_free(source_file_arr *);
+
+#endif // SCAN_H
@@ -0,0 +1,445 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include "buf.h"
+#include "error.h"
+#include "hash.h"
+#include "html.h"
+#include "output.h"
+#include "search.h"
+
+// length of the hash prefix used in file names
+#define _SITE_SEARCH_HASH_LEN 10
+
+typedef struct {
+        int doc;
+        int count;
+} search_posting;
+
+typedef struct {
+        char *term;
+        uint32_t hash;
+        search_posting *postings;
+        int len;
+        int capacity;
+} search_term;
+
+// terms by hash with linear probing, the capacity is a power of two
+typedef struct {
+        search_term *elems;
+        int len;
+        int capacity;
+} search_table;
+
+static uint32_t __search_hash(const char *term, size_t len) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < len; i++) {
+                hash ^= (unsigned char)term[i];
+                hash *= 16777619u;
+        }
+        return hash;
+}
+
+static int __search_grow(search_table *table) {
+        int capacity = table->capacity ? table->capacity * 2 : 1024;
+        search_term *elems = calloc(capacity, sizeof(search_term));
+        if (elems == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                return -1;
+        }
+
+        for (int i = 0; i < table->capacity; i++) {
+                search_term *term = &table->elems[i];
+                if (term->term == NULL) continue;
+
+                int slot = (int)(term->hash & (uint32_t)(capacity - 1));
+                while (elems[slot].term != NULL) {
+                        slot = (slot + 1) & (capacity - 1);
+                }
+                elems[slot] = *term;
+        }
+
+        free(table->elems);
+        table->elems = elems;
+        table->capacity = capacity;
+
+        return 0;
+}
+
+static int __search_add(search_table *table, const char *word, size_t len, int doc, int weight) {
+        if (len < _SITE_SEARCH_TERM_MIN) return 0;
+        if ((table->len + 1) * 10 > table->capacity * 7 && __search_grow(table) != 0) return -1;
+
+        uint32_t hash = __search_hash(word, len);
+        int slot = (int)(hash & (uint32_t)(table->capacity - 1));
+        search_term *term = NULL;
+        while ((term = &table->elems[slot])->term != NULL) {
+                if (term->hash == hash && strncmp(term->term, word, len) == 0 &&
+                    term->term[len] == '\0') {
+                        break;
+                }
+                slot = (slot + 1) & (table->capacity - 1);
+        }
+
+        if (term->term == NULL) {
+                if ((term->term = malloc(len + 1)) == NULL) {
+                        ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                        return -1;
+                }
+                memcpy(term->term, word, len);
+                term->term[len] = '\0';
+                term->hash = hash;
+                table->len++;
+        }
+
+        // documents are indexed one after another
+        if (term->len > 0 && term->postings[term->len - 1].doc == doc) {
+                term->postings[term->len - 1].count += weight;
+                return 0;
+        }
+
+        if (term->len == term->capacity) {
+                int capacity = term->capacity ? term->capacity * 2 : 4;
+                void *grown = realloc(term->postings, capacity * sizeof(search_posting));
+                if (grown == NULL) {
+                        ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                        return -1;
+                }
+                term->postings = grown;
+                term->capacity = capacity;
+        }
+        term->postings[term->len++] = (search_posting){.doc = doc, .count = weight};
+
+        return 0;
+}
+
+// past a tag, or past the element for those whose content isn't text
+static const char *__search_skip_tag(const char *p) {
+        static const char *raw_tags[] = {"script", "style"};
+
+        if (strncmp(p, "<!--", 4) == 0) {
+                const char *end = strstr(p + 4, "-->");
+                return end ? end + 3 : p + strlen(p);
+        }
+
+        for (size_t i = 0; i < sizeof(raw_tags) / sizeof(raw_tags[0]); i++) {
+                size_t len = strlen(raw_tags[i]);
+                if (strncasecmp(p + 1, raw_tags[i], len) != 0) continue;
+                if (isalnum((unsigned char)p[len + 1])) continue;
+
+                for (p += len + 1; *p; p++) {
+                        if (p[0] == '<' && p[1] == '/' && strncasecmp(p + 2, raw_tags[i], len) == 0)
+                                break;
+                }
+                break;
+        }
+
+        const char *end = strchr(p, '>');
+        return end ? end + 1 : p + strlen(p);
+}
+
+// split text into terms, lower-casing ASCII. the loader splits queries the same way
+static int __search_tokenise(search_table *table, const char *text, int doc, int weight,
+                             bool markup) {
+        char word[_SITE_SEARCH_TERM_MAX];
+        size_t len = 0;
+        bool too_long = false;
+
+        for (const char *p = text;;) {
+                unsigned char c = (unsigned char)*p;
+                if (isalnum(c) || c >= 0x80) {
+                        if (len == sizeof(word)) {
+                                too_long = true;
+                        } else {
+                                word[len++] = (char)(c < 0x80 ? tolower(c) : c);
+                        }
+                        p++;
+                        continue;
+                }
+
+                if (len > 0 && !too_long && __search_add(table, word, len, doc, weight) != 0) {
+                        return -1;
+                }
+                len = 0;
+                too_long = false;
+
+                if (c == '\0') break;
+
+                if (markup && c == '<') {
+                        p = __search_skip_tag(p);
+                } else if (markup && c == '&') {
+                        // entities separate words like the characters they stand for
+                        const char *end = strchr(p, ';');
+                        p = end && end - p <= 10 ? end + 1 : p + 1;
+                } else {
+                        p++;
+                }
+        }
+
+        return 0;
+}
+
+static void __search_free(search_table *table) {
+        for (int i = 0; i < table->capacity; i++) {
+                free(table->elems[i].term);
+                free(table->elems[i].postings);
+        }
+        free(table->elems);
+}
+
+static int __search_cmp(const void *a, const void *b) {
+        return strcmp((*(search_term *const *)a)->term, (*(search_term *const *)b)->term);
+}
+
+static int __search_varint(text_buf *out, uint64_t value) {
+        char bytes[10];
+        size_t len = 0;
+
+        do {
+                unsigned char byte = value & 0x7f;
+                value >>= 7;
+                if (value) byte |= 0x80;
+                bytes[len++] = (char)byte;
+        } while (value);
+
+        return buf_append(out, bytes, len);
+}
+
+// shards and lists are fingerprinted, only the manifest pointing to them is revalidated
+static int __search_write_file(const char *stem, const char *ext, const text_buf *content,
+                               time_t modified, text_buf *manifest) {
+        char hash[_SITE_HASH_HEX_SIZE];
+        hash_hex(content->data ? content->data : "", content->len, hash);
+
+        char name[_SITE_PATH_MAX];
+        snprintf(name, sizeof(name), "%s/%s.%.*s.%s", _SITE_SEARCH_DIR, stem,
+                 _SITE_SEARCH_HASH_LEN, hash, ext);
+
+        output_meta meta = {.modified = modified, .tier = OUTPUT_CACHE_IMMUTABLE};
+        if (output_write(name, &meta, content->data ? content->data : "", content->len) != 0) {
+                return -1;
+        }
+
+        // entries follow the opening brace of the file map
+        const char *separator = manifest->data[manifest->len - 1] == '{' ? "" : ",";
+        return buf_printf(manifest, "%s\"%s\":\"/%s\"", separator, stem, name);
+}
+
+// [[path, title], ...] for a range of documents
+static int __search_write_docs(page_header_arr *header_arr, time_t modified,
+                               text_buf *manifest) {
+        int res = 0;
+
+        for (int first = 0; first < header_arr->len; first += _SITE_SEARCH_DOCS_PER_LIST) {
+                text_buf list = {0};
+                res = buf_puts(&list, "[");
+                for (int i = first;
+                     res == 0 && i < header_arr->len && i < first + _SITE_SEARCH_DOCS_PER_LIST;
+                     i++) {
+                        if (buf_puts(&list, i == first ? "[" : ",[") != 0 ||
+                            buf_json_string(&list, header_arr->elems[i]->meta.path) != 0 ||
+                            buf_puts(&list, ",") != 0 ||
+                            buf_json_string(&list, header_arr->elems[i]->title) != 0 ||
+                            buf_puts(&list, "]") != 0) {
+                                res = -1;
+                        }
+                }
+                if (res == 0) res = buf_puts(&list, "]");
+
+                char stem[32];
+                snprintf(stem, sizeof(stem), "docs-%d", first / _SITE_SEARCH_DOCS_PER_LIST);
+                if (res == 0) res = __search_write_file(stem, "json", &list, modified, manifest);
+                buf_free(&list);
+                if (res != 0) return -1;
+        }
+
+        return 0;
+}
+
+// shard of a term, its first byte
+static void __search_shard(const char *term, char *stem, size_t size) {
+        unsigned char c = (unsigned char)term[0];
+        if (c < 0x80) {
+                snprintf(stem, size, "%c", c);
+        } else {
+                snprintf(stem, size, "x%02x", c);
+        }
+}
+
+// front-coded terms, each followed by its postings as delta-coded documents and counts:
+// version, documents, terms, then per term shared prefix length, suffix length, suffix,
+// postings and pairs of document delta and count, all varints
+static int __search_write_shards(search_term **terms, int len, int docs, time_t modified,
+                                 text_buf *manifest) {
+        for (int first = 0; first < len;) {
+                char stem[8];
+                __search_shard(terms[first]->term, stem, sizeof(stem));
+
+                int last = first;
+                while (last < len && terms[last]->term[0] == terms[first]->term[0]) {
+                        last++;
+                }
+
+                text_buf shard = {0};
+                int res = 0;
+                if (__search_varint(&shard, _SITE_SEARCH_VERSION) != 0 ||
+                    __search_varint(&shard, (uint64_t)docs) != 0 ||
+                    __search_varint(&shard, (uint64_t)(last - first)) != 0) {
+                        res = -1;
+                }
+
+                const char *previous = "";
+                for (int i = first; res == 0 && i < last; i++) {
+                        const char *term = terms[i]->term;
+                        size_t shared = 0;
+                        while (term[shared] && term[shared] == previous[shared]) {
+                                shared++;
+                        }
+                        size_t suffix = strlen(term + shared);
+
+                        if (__search_varint(&shard, shared) != 0 ||
+                            __search_varint(&shard, suffix) != 0 ||
+                            buf_append(&shard, term + shared, suffix) != 0 ||
+                            __search_varint(&shard, (uint64_t)terms[i]->len) != 0) {
+                                res = -1;
+                        }
+
+                        int doc = 0;
+                        for (int j = 0; res == 0 && j < terms[i]->len; j++) {
+                                search_posting *posting = &terms[i]->postings[j];
+                                if (__search_varint(&shard, (uint64_t)(posting->doc - doc)) != 0 ||
+                                    __search_varint(&shard, (uint64_t)posting->count) != 0) {
+                                        res = -1;
+                                }
+                                doc = posting->doc;
+                        }
+                        previous = term;
+                }
+
+                if (res == 0) res = __search_write_file(stem, "idx", &shard, modified, manifest);
+                buf_free(&shard);
+                if (res != 0) return -1;
+
+                first = last;
+        }
+
+        return 0;
+}
+
+// shards and lists of earlier builds, "<stem>.<hash>.<ext>"
+static bool __search_is_fingerprinted(const char *name) {
+        const char *ext = strrchr(name, '.');
+        if (ext == NULL || (strcmp(ext, ".idx") != 0 && strcmp(ext, ".json") != 0)) return false;
+
+        const char *hash = ext - _SITE_SEARCH_HASH_LEN;
+        if (hash - 1 <= name || hash[-1] != '.') return false;
+        for (const char *p = hash; p < ext; p++) {
+                if (!isxdigit((unsigned char)*p)) return false;
+        }
+
+        return true;
+}
+
+// a new manifest never points to the old files again, remove those this build didn't write
+static void __search_prune(void) {
+        char dir_path[_SITE_PATH_MAX * 2];
+        output_path(_SITE_SEARCH_DIR, dir_path, sizeof(dir_path));
+
+        DIR *dir = NULL;
+        if ((dir = opendir(dir_path)) == NULL) return;
+
+        struct dirent *entry = NULL;
+        while ((entry = readdir(dir)) != NULL) {
+                if (!__search_is_fingerprinted(entry->d_name)) continue;
+
+                char name[_SITE_PATH_MAX];
+                snprintf(name, sizeof(name), "%s/%s", _SITE_SEARCH_DIR, entry->d_name);
+
+                bool written = false;
+                for (int i = 0; i < output_entries.len && !written; i++) {
+                        written = strcmp(output_entries.elems[i].name, name) == 0;
+                }
+                if (written) continue;
+
+                // a file left behind only takes up space
+                char path[_SITE_PATH_MAX * 3];
+                snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+                unlink(path);
+        }
+
+        closedir(dir);
+}
+
+int search_write(page_header_arr *header_arr) {
+        int res = 0;
+        search_table table = {0};
+        search_term **terms = NULL;
+        text_buf manifest = {0};
+
+        // the rendered content of every page is still around for the feed
+        for (int i = 0; i < header_arr->len; i++) {
+                page_header *header = header_arr->elems[i];
+
+                int idx = 0;
+                while (idx < content_arr.len &&
+                       strcmp(content_arr.elems[idx]->meta.path, header->meta.path) != 0) {
+                        idx++;
+                }
+                if (idx == content_arr.len) continue;
+
+                if (__search_tokenise(&table, header->title, i, _SITE_SEARCH_TITLE_WEIGHT,
+                                      false) != 0 ||
+                    __search_tokenise(&table, content_arr.elems[idx]->content, i, 1, true) != 0) {
+                        goto error;
+                }
+        }
+
+        if (table.len > 0 && (terms = malloc(table.len * sizeof(search_term *))) == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                goto error;
+        }
+        int terms_len = 0;
+        for (int i = 0; i < table.capacity; i++) {
+                if (table.elems[i].term) terms[terms_len++] = &table.elems[i];
+        }
+        qsort(terms, terms_len, sizeof(search_term *), __search_cmp);
+
+        time_t modified = html_last_modified(header_arr);
+        if (buf_printf(&manifest, "{\"version\":%d,\"docs\":%d,\"per_list\":%d,\"files\":{",
+                       _SITE_SEARCH_VERSION, header_arr->len, _SITE_SEARCH_DOCS_PER_LIST) != 0) {
+                goto error;
+        }
+        if (__search_write_docs(header_arr, modified, &manifest) != 0) goto error;
+        if (__search_write_shards(terms, terms_len, header_arr->len, modified, &manifest) != 0) {
+                goto error;
+        }
+        if (buf_puts(&manifest, "}}\n") != 0) goto error;
+
+        output_meta meta = {.modified = modified, .tier = OUTPUT_CACHE_REVALIDATE};
+        if (output_write(_SITE_SEARCH_DIR "/index.json", &meta, manifest.data, manifest.len) !=
+            0) {
+                goto error;
+        }
+        __search_prune();
+
+        goto cleanup;
+
+error:
+        res = -1;
+
+cleanup:
+        __search_free(&table);
+        free(terms);
+        buf_free(&manifest);
+
+        return res;
+}
@@ -0,0 +1,30 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "page.h"
+
+// write an inverted index of all pages for the search component
+#ifndef _SITE_EXT_SEARCH
+#define _SITE_EXT_SEARCH 1
+#endif
+
+// shards and document lists live below this dir of the output
+#define _SITE_SEARCH_DIR "search"
+
+// terms are runs of ASCII letters and digits or non-ASCII bytes of this many bytes
+#define _SITE_SEARCH_TERM_MIN 2
+#define _SITE_SEARCH_TERM_MAX 32
+
+// occurrences in the title count this many times
+#define _SITE_SEARCH_TITLE_WEIGHT 4
+
+// documents listed per file, results only fetch the lists they point into
+#define _SITE_SEARCH_DOCS_PER_LIST 256
+
+// bump whenever the shard format changes, the loader checks it
+#define _SITE_SEARCH_VERSION 1
+
+// index the rendered content of every page, in the order of the given headers
+int search_write(page_header_arr *);
+
+#endif // SEARCH_H
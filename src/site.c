@@ -0,0 +1,166 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "error.h"
+#include "site.h"
+
+site_config site;
+
+// settable keys and the fields they fill
+static const struct {
+        const char *key;
+        size_t offset;
+} site_keys[] = {
+    {"root", offsetof(site_config, root)},
+    {"title", offsetof(site_config, title)},
+    {"author", offsetof(site_config, author)},
+    {"host", offsetof(site_config, host)},
+    {"feed_id", offsetof(site_config, feed_id)},
+    {"tag_date", offsetof(site_config, tag_date)},
+    {"source", offsetof(site_config, source_dir)},
+    {"target", offsetof(site_config, target_dir)},
+    {"git_dir", offsetof(site_config, git_dir)},
+    {"cache", offsetof(site_config, cache_dir)},
+};
+
+void site_defaults(site_config *config) {
+        memset(config, 0, sizeof(site_config));
+
+        snprintf(config->root, sizeof(config->root), "%s", ".");
+        snprintf(config->title, sizeof(config->title), "%s", _SITE_TITLE);
+        snprintf(config->author, sizeof(config->author), "%s", _SITE_AUTHOR);
+        snprintf(config->host, sizeof(config->host), "%s", _SITE_HOST);
+        snprintf(config->feed_id, sizeof(config->feed_id), "%s", _SITE_FEED_ID);
+        snprintf(config->tag_date, sizeof(config->tag_date), "%s", _SITE_TAG_SCHEME_DATE);
+        snprintf(config->source_dir, sizeof(config->source_dir), "%s", _SITE_SOURCE_DIR);
+        snprintf(config->target_dir, sizeof(config->target_dir), "%s", _SITE_EXT_TARGET_DIR);
+        snprintf(config->git_dir, sizeof(config->git_dir), "%s", _SITE_EXT_GIT_DIR);
+        snprintf(config->cache_dir, sizeof(config->cache_dir), "%s", _SITE_EXT_CACHE_DIR);
+}
+
+static char *__site_trim(char *str) {
+        while (isspace((unsigned char)*str)) {
+                str++;
+        }
+
+        char *end = str + strlen(str);
+        while (end > str && isspace((unsigned char)end[-1])) {
+                end--;
+        }
+        *end = '\0';
+
+        return str;
+}
+
+static int __site_set(site_config *config, const char *key, const char *value) {
+        if (strlen(value) >= _SITE_CONFIG_VALUE_MAX) return -1;
+
+        for (size_t i = 0; i < sizeof(site_keys) / sizeof(site_keys[0]); i++) {
+                if (strcmp(site_keys[i].key, key) != 0) continue;
+
+                char *field = (char *)config + site_keys[i].offset;
+                snprintf(field, _SITE_CONFIG_VALUE_MAX, "%s", value);
+                return 0;
+        }
+
+        return -1;
+}
+
+static site_config *__site_add(site_config_arr *sites, const site_config *defaults,
+                               const char *name) {
+        for (int i = 0; i < sites->len; i++) {
+                if (strcmp(sites->elems[i].name, name) == 0) return NULL;
+        }
+
+        if (sites->len == sites->capacity) {
+                int capacity = sites->capacity ? sites->capacity * 2 : 16;
+                void *grown = realloc(sites->elems, capacity * sizeof(site_config));
+                if (grown == NULL) return NULL;
+                sites->elems = grown;
+                sites->capacity = capacity;
+        }
+
+        // a site lives in the dir named after it unless told otherwise
+        site_config *config = &sites->elems[sites->len++];
+        *config = *defaults;
+        snprintf(config->name, sizeof(config->name), "%s", name);
+        if (strcmp(defaults->root, ".") == 0) {
+                snprintf(config->root, sizeof(config->root), "%s", name);
+        }
+        config->share_assets = true;
+
+        return config;
+}
+
+int site_load(const char *path, site_config_arr *sites) {
+        int res = 0;
+        FILE *file = NULL;
+        char *line = NULL;
+        size_t line_size = 0;
+        int line_no = 0;
+
+        site_config defaults;
+        site_defaults(&defaults);
+        site_config *current = &defaults;
+
+        if ((file = fopen(path, "r")) == NULL) {
+                ERRORF(SITE_ERROR_FILE_OPEN_READ, path);
+                return -1;
+        }
+
+        while (getline(&line, &line_size, file) != -1) {
+                line_no++;
+
+                char *start = __site_trim(line);
+                if (*start == '\0' || *start == '#') continue;
+
+                // [name] starts a site
+                size_t len = strlen(start);
+                if (start[0] == '[') {
+                        if (len < 3 || start[len - 1] != ']' || len - 2 >= _SITE_CONFIG_VALUE_MAX)
+                                goto invalid;
+                        start[len - 1] = '\0';
+                        if ((current = __site_add(sites, &defaults, start + 1)) == NULL) {
+                                goto invalid;
+                        }
+                        continue;
+                }
+
+                char *equals = strchr(start, '=');
+                if (equals == NULL) goto invalid;
+                *equals = '\0';
+                if (__site_set(current, __site_trim(start), __site_trim(equals + 1)) != 0) {
+                        goto invalid;
+                }
+        }
+
+        if (ferror(file)) {
+                ERRORF(SITE_ERROR_FILE_READ, path);
+                goto error;
+        }
+
+        goto cleanup;
+
+invalid:
+        errno = 0;
+        ERRORF(SITE_ERROR_SITE_CONFIG, path, line_no);
+
+error:
+        res = -1;
+
+cleanup:
+        free(line);
+        fclose(file);
+
+        return res;
+}
+
+void site_free(site_config_arr *sites) {
+        free(sites->elems);
+        *sites = (site_config_arr){0};
+}
@@ -0,0 +1,62 @@
+#ifndef SITE_H
+#define SITE_H
+
+#include <stdbool.h>
+
+// identity and layout compiled in, a site config may override them per site
+#define _SITE_TITLE           "Max's Homepage"
+#define _SITE_AUTHOR          "Maximilian Hoenig"
+#define _SITE_FEED_ID         "F2B3E23B-ECB6-4EE7-8197-D3C6C2594701"
+#define _SITE_HOST            "maxh.site"
+#define _SITE_TAG_SCHEME_DATE "2024-02-12"
+#define _SITE_SOURCE_DIR      "content"
+
+#ifndef _SITE_EXT_TARGET_DIR
+#define _SITE_EXT_TARGET_DIR "docs"
+#endif
+
+#ifndef _SITE_EXT_GIT_DIR
+#define _SITE_EXT_GIT_DIR ".git"
+#endif
+
+// templates and blocks, relative to the source dir
+#define _SITE_BLOCK_DIR "blocks"
+
+// sites of a batch built at the same time at most
+#define _SITE_JOBS_MAX 32
+
+#define _SITE_CONFIG_VALUE_MAX 256
+
+typedef struct {
+        char name[_SITE_CONFIG_VALUE_MAX];
+        char root[_SITE_CONFIG_VALUE_MAX]; // dir the site is built in, the paths below are
+                                           // relative to it
+        char title[_SITE_CONFIG_VALUE_MAX];
+        char author[_SITE_CONFIG_VALUE_MAX];
+        char host[_SITE_CONFIG_VALUE_MAX];
+        char feed_id[_SITE_CONFIG_VALUE_MAX];
+        char tag_date[_SITE_CONFIG_VALUE_MAX];
+        char source_dir[_SITE_CONFIG_VALUE_MAX];
+        char target_dir[_SITE_CONFIG_VALUE_MAX];
+        char git_dir[_SITE_CONFIG_VALUE_MAX];
+        char cache_dir[_SITE_CONFIG_VALUE_MAX];
+        bool share_assets; // link assets through the cache, which sites of a batch may share
+} site_config;
+
+typedef struct {
+        site_config *elems;
+        int len;
+        int capacity;
+} site_config_arr;
+
+// the site being built
+extern site_config site;
+
+// the compiled in site, built from the working dir
+void site_defaults(site_config *);
+
+// read [name] sections of key = value lines, keys before the first section apply to all sites
+int site_load(const char *, site_config_arr *);
+void site_free(site_config_arr *);
+
+#endif // SITE_H
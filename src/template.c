@@ -0,0 +1,92 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "error.h"
+#include "template.h"
+
+static const char *template_slot_names[TEMPLATE_SLOT_COUNT] = {
+    [TEMPLATE_SLOT_STYLES] = "styles", [TEMPLATE_SLOT_FONTS] = "fonts",
+    [TEMPLATE_SLOT_TITLE] = "title",   [TEMPLATE_SLOT_SCRIPTS] = "scripts",
+    [TEMPLATE_SLOT_MENU] = "menu",     [TEMPLATE_SLOT_CONTENT] = "content",
+};
+
+static int __template_add(page_template *template, size_t offset, size_t len, int slot) {
+        if (template->len == _SITE_TEMPLATE_SEGMENTS_MAX) return -1;
+
+        template->segments[template->len++] = (template_segment){
+            .offset = offset,
+            .len = len,
+            .slot = slot,
+        };
+
+        return 0;
+}
+
+int template_compile(page_template *template, const char *source, size_t len, const char *name) {
+        size_t pos = 0;
+        size_t copied = 0;
+
+        template->source = source;
+        template->source_len = len;
+        template->len = 0;
+
+        while (pos + 1 < len) {
+                if (source[pos] != '{' || source[pos + 1] != '{') {
+                        pos++;
+                        continue;
+                }
+
+                const char *close = strstr(source + pos + 2, "}}");
+                if (close == NULL) break;
+
+                size_t slot_len = (size_t)(close - (source + pos + 2));
+                int slot = TEMPLATE_SLOT_NONE;
+                for (int i = 0; i < TEMPLATE_SLOT_COUNT; i++) {
+                        if (strlen(template_slot_names[i]) == slot_len &&
+                            strncmp(source + pos + 2, template_slot_names[i], slot_len) == 0) {
+                                slot = i;
+                        }
+                }
+                if (slot == TEMPLATE_SLOT_NONE) {
+                        ERRORF(SITE_ERROR_TEMPLATE_SLOT, (int)slot_len, source + pos + 2, name);
+                        return -1;
+                }
+
+                if (pos > copied && __template_add(template, copied, pos - copied, -1) != 0) {
+                        ERRORF(SITE_ERROR_TEMPLATE_SIZE, name);
+                        return -1;
+                }
+                if (__template_add(template, 0, 0, slot) != 0) {
+                        ERRORF(SITE_ERROR_TEMPLATE_SIZE, name);
+                        return -1;
+                }
+
+                pos = copied = (size_t)(close - source) + 2;
+        }
+
+        if (len > copied && __template_add(template, copied, len - copied, -1) != 0) {
+                ERRORF(SITE_ERROR_TEMPLATE_SIZE, name);
+                return -1;
+        }
+
+        return 0;
+}
+
+int template_render(const page_template *template, const struct iovec slots[TEMPLATE_SLOT_COUNT],
+                    struct iovec iov[_SITE_TEMPLATE_SEGMENTS_MAX]) {
+        int iov_len = 0;
+
+        for (int i = 0; i < template->len; i++) {
+                const template_segment *segment = &template->segments[i];
+                if (segment->slot == TEMPLATE_SLOT_NONE) {
+                        iov[iov_len].iov_base = (void *)(template->source + segment->offset);
+                        iov[iov_len].iov_len = segment->len;
+                } else {
+                        iov[iov_len] = slots[segment->slot];
+                }
+                if (iov[iov_len].iov_len > 0) iov_len++;
+        }
+
+        return iov_len;
+}
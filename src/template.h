@@ -0,0 +1,43 @@
+#ifndef TEMPLATE_H
+#define TEMPLATE_H
+
+#include <stddef.h>
+
+#include <sys/uio.h>
+
+#define _SITE_TEMPLATE_SEGMENTS_MAX 32
+
+// named slots, written as {{name}} in template files
+typedef enum {
+        TEMPLATE_SLOT_NONE = -1,
+        TEMPLATE_SLOT_STYLES,
+        TEMPLATE_SLOT_FONTS,
+        TEMPLATE_SLOT_TITLE,
+        TEMPLATE_SLOT_SCRIPTS,
+        TEMPLATE_SLOT_MENU,
+        TEMPLATE_SLOT_CONTENT,
+        TEMPLATE_SLOT_COUNT
+} template_slot;
+
+// static text of the template source or a slot to be filled per page
+typedef struct {
+        size_t offset;
+        size_t len;
+        int slot;
+} template_segment;
+
+typedef struct {
+        const char *source;
+        size_t source_len;
+        template_segment segments[_SITE_TEMPLATE_SEGMENTS_MAX];
+        int len;
+} page_template;
+
+// split a template into static segments and slots, the source must outlive the template
+int template_compile(page_template *, const char *, size_t, const char *);
+
+// assemble a page from the template and its slots into an iovec array, ready for a single writev
+int template_render(const page_template *, const struct iovec[TEMPLATE_SLOT_COUNT],
+                    struct iovec[_SITE_TEMPLATE_SEGMENTS_MAX]);
+
+#endif // TEMPLATE_H
@@ -0,0 +1,128 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "embed.h"
+#include "error.h"
+#include "template.h"
+
+// turn a file name into a C identifier
+static void __embed_ident(const char *name, char *ident, size_t ident_size) {
+        size_t i = 0;
+        for (; name[i] && i + 1 < ident_size; i++) {
+                char c = name[i];
+                ident[i] = ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                            (c >= '0' && c <= '9'))
+                               ? c
+                               : '_';
+        }
+        ident[i] = '\0';
+}
+
+static char *__embed_read(const char *path, size_t *len) {
+        FILE *file = NULL;
+        char *content = NULL;
+
+        if ((file = fopen(path, "r")) == NULL) {
+                ERRORF(SITE_ERROR_FILE_OPEN_READ, path);
+                return NULL;
+        }
+
+        size_t capacity = 4096;
+        *len = 0;
+        if ((content = malloc(capacity)) == NULL) {
+                ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                fclose(file);
+                return NULL;
+        }
+
+        size_t n = 0;
+        while ((n = fread(content + *len, 1, capacity - *len - 1, file)) > 0) {
+                *len += n;
+                if (capacity - *len - 1 > 0) continue;
+
+                capacity *= 2;
+                char *grown = realloc(content, capacity);
+                if (grown == NULL) {
+                        ERROR(SITE_ERROR_MEMORY_ALLOCATION);
+                        free(content);
+                        fclose(file);
+                        return NULL;
+                }
+                content = grown;
+        }
+
+        if (ferror(file)) {
+                ERRORF(SITE_ERROR_FILE_READ, path);
+                free(content);
+                fclose(file);
+                return NULL;
+        }
+        content[*len] = '\0';
+        fclose(file);
+
+        return content;
+}
+
+// usage: embed.out <block>... > blocks.c
+int main(int argc, char **argv) {
+        int res = 0;
+
+        printf("// generated by tools/embed.c, do not edit\n\n"
+               "#include \"embed.h\"\n\n");
+
+        for (int i = 1; i < argc; i++) {
+                const char *name = strrchr(argv[i], '/');
+                name = name ? name + 1 : argv[i];
+
+                char ident[256];
+                __embed_ident(name, ident, sizeof(ident));
+
+                size_t len = 0;
+                char *content = NULL;
+                if ((content = __embed_read(argv[i], &len)) == NULL) return 1;
+
+                page_template template;
+                if (template_compile(&template, content, len, argv[i]) != 0) {
+                        free(content);
+                        return 1;
+                }
+
+                // content including the terminating NUL, so it can be used as a string
+                printf("static const char __embed_%s[] = {", ident);
+                for (size_t j = 0; j <= len; j++) {
+                        printf("%s0x%02x,", j % 16 ? " " : "\n    ", (unsigned char)content[j]);
+                }
+                printf("\n};\n\n");
+
+                printf("static const template_segment __embed_%s_segments[] = {\n", ident);
+                for (int j = 0; j < template.len; j++) {
+                        printf("    {%zu, %zu, %d},\n", template.segments[j].offset,
+                               template.segments[j].len, template.segments[j].slot);
+                }
+                printf("};\n\n");
+
+                free(content);
+        }
+
+        printf("const embedded_block embedded_blocks[] = {\n");
+        for (int i = 1; i < argc; i++) {
+                const char *name = strrchr(argv[i], '/');
+                name = name ? name + 1 : argv[i];
+
+                char ident[256];
+                __embed_ident(name, ident, sizeof(ident));
+
+                printf("    {\"%s\", __embed_%s, sizeof(__embed_%s) - 1, __embed_%s_segments,\n"
+                       "     sizeof(__embed_%s_segments) / sizeof(template_segment)},\n",
+                       name, ident, ident, ident, ident);
+        }
+        printf("};\n\n"
+               "const int embedded_blocks_len = %d;\n",
+               argc - 1);
+
+        if (fflush(stdout) != 0) res = 1;
+
+        return res;
+}